@@ -0,0 +1,208 @@
+
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+// Microbenchmark for the 64x64 tile kernels registered in `kernels.h`.
+//
+// Every kernel is timed on a tile that stays in L1, first on its own and
+// then together with the strided bswap gather and scatter that
+// `rotate_bit_matrix` wraps around it. Times are in rdtsc ticks per tile.
+// Before timing, the output of every kernel is checked against the others.
+//
+// Usage: ./kernelbench [tiles-per-sample]
+
+#include "./kernels.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <x86intrin.h>
+
+// Words per row of the image the gather/scatter stage works on. The
+// 64-row block is small enough to stay in L1 but has a realistic stride
+#define ROW_WORDS 4
+#define BLOCK_COLUMN 1
+#define SAMPLES 15
+#define CHECK_TILES 64
+
+static uint64_t image[64 * ROW_WORDS];
+
+// Sink for results the compiler must not optimize away
+static volatile uint64_t sink;
+
+static inline uint64_t read_tsc(void) {
+  _mm_lfence();
+  uint64_t t = __rdtsc();
+  _mm_lfence();
+  return t;
+}
+
+static uint64_t xorshift64(uint64_t *state) {
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *state = x;
+}
+
+// The gather/scatter stages of `rotate_bit_matrix` around one block of `image`
+static inline void gather(uint64_t *tile) {
+  for (int k = 0; k < 64; k++) {
+    tile[k] = __builtin_bswap64(image[k * ROW_WORDS + BLOCK_COLUMN]);
+  }
+}
+
+static inline void scatter(const uint64_t *tile) {
+  for (int k = 0; k < 64; k++) {
+    image[k * ROW_WORDS + BLOCK_COLUMN] = __builtin_bswap64(tile[k]);
+  }
+}
+
+static void identity_kernel(uint64_t *tile, uint64_t* restrict scratch) {
+  (void)tile;
+  (void)scratch;
+}
+
+// Returns the fewest ticks per tile over `SAMPLES` runs of `ntiles` tiles
+static double time_kernel(tile_kernel_t fn, bool with_gather, uint32_t ntiles) {
+  uint64_t tile[64];
+  uint64_t scratch[64];
+  double best = -1;
+
+  memcpy(tile, image, sizeof(tile));
+  for (int s = 0; s < SAMPLES; s++) {
+    uint64_t start = read_tsc();
+    if (with_gather) {
+      for (uint32_t t = 0; t < ntiles; t++) {
+        gather(tile);
+        fn(tile, scratch);
+        scatter(tile);
+      }
+    } else {
+      for (uint32_t t = 0; t < ntiles; t++) {
+        fn(tile, scratch);
+      }
+    }
+    double ticks = (double)(read_tsc() - start) / ntiles;
+    if (best < 0 || ticks < best) {
+      best = ticks;
+    }
+  }
+  sink = tile[0] ^ image[BLOCK_COLUMN];
+  return best;
+}
+
+// Checks that all kernels agree on random tiles, both on their own and
+// through the gather/scatter stages, and that four rotations are the identity
+static bool cross_check(void) {
+  uint64_t state = 0x9E3779B97F4A7C15ull;
+  uint64_t scratch[64];
+  uint64_t input[64];
+  uint64_t expected[64];
+  uint64_t actual[64];
+  bool ok = true;
+
+  for (int n = 0; n < CHECK_TILES; n++) {
+    for (int k = 0; k < 64; k++) {
+      // Include sparse and dense tiles as well as uniform ones
+      uint64_t x = xorshift64(&state);
+      input[k] = n % 4 == 1 ? x & xorshift64(&state) :
+                 n % 4 == 2 ? x | xorshift64(&state) : x;
+    }
+
+    for (uint32_t v = 0; v < num_tile_kernels; v++) {
+      tile_kernel_t fn = tile_kernels[v].fn;
+
+      memcpy(actual, input, sizeof(input));
+      fn(actual, scratch);
+      if (v == 0) {
+        memcpy(expected, actual, sizeof(actual));
+      } else if (memcmp(expected, actual, sizeof(actual))) {
+        printf("FAIL: %s disagrees with %s on tile %d\n",
+               tile_kernels[v].name, tile_kernels[0].name, n);
+        ok = false;
+      }
+
+      for (int r = 0; r < 3; r++) {
+        fn(actual, scratch);
+      }
+      if (memcmp(input, actual, sizeof(actual))) {
+        printf("FAIL: four rotations by %s are not the identity on tile %d\n",
+               tile_kernels[v].name, n);
+        ok = false;
+      }
+
+      for (int k = 0; k < 64; k++) {
+        image[k * ROW_WORDS + BLOCK_COLUMN] = __builtin_bswap64(input[k]);
+      }
+      gather(actual);
+      fn(actual, scratch);
+      scatter(actual);
+      for (int k = 0; k < 64; k++) {
+        if (__builtin_bswap64(image[k * ROW_WORDS + BLOCK_COLUMN]) != expected[k]) {
+          printf("FAIL: %s through gather/scatter differs on tile %d\n",
+                 tile_kernels[v].name, n);
+          ok = false;
+          break;
+        }
+      }
+    }
+  }
+  return ok;
+}
+
+int main(int argc, char *argv[]) {
+  uint32_t ntiles = 20000;
+  if (argc > 1) {
+    ntiles = (uint32_t)strtoul(argv[1], NULL, 10);
+  }
+  if (argc > 2 || ntiles == 0) {
+    printf("Usage: %s [tiles-per-sample]\n", argv[0]);
+    return 1;
+  }
+
+  if (!cross_check()) {
+    return 1;
+  }
+  printf("PASS: %u kernels agree on %d random tiles\n\n",
+         num_tile_kernels, CHECK_TILES);
+
+  uint64_t state = 1;
+  for (int k = 0; k < 64 * ROW_WORDS; k++) {
+    image[k] = xorshift64(&state);
+  }
+
+  printf("%-20s %14s %14s %14s\n", "kernel", "kernel-only", "with-gather",
+         "gather-cost");
+  double overhead = time_kernel(identity_kernel, true, ntiles);
+  for (uint32_t v = 0; v < num_tile_kernels; v++) {
+    // The naive kernel is thousands of times slower; keep it brief
+    uint32_t n = strcmp(tile_kernels[v].name, "naive") ? ntiles : ntiles / 20 + 1;
+    double alone = time_kernel(tile_kernels[v].fn, false, n);
+    double full = time_kernel(tile_kernels[v].fn, true, n);
+    printf("%-20s %14.1f %14.1f %14.1f\n", tile_kernels[v].name, alone, full,
+           full - alone);
+  }
+  printf("%-20s %14s %14.1f\n", "(gather/scatter)", "-", overhead);
+  printf("\nrdtsc ticks per 64x64 tile, best of %d samples\n", SAMPLES);
+  return 0;
+}
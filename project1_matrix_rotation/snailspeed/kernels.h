@@ -0,0 +1,43 @@
+
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <stdint.h>
+
+// A 64x64 tile kernel rotates `tile` clockwise in place. Row k of the tile
+// holds image row k with its leftmost pixel in the most significant bit;
+// `scratch` is 64 words of working space
+typedef void (*tile_kernel_t)(uint64_t *tile, uint64_t* restrict scratch);
+
+struct tile_kernel_s {
+  const char *name;
+  tile_kernel_t fn;
+};
+
+// The registered tile kernels. The first one is what `rotate_bit_matrix` uses
+extern const struct tile_kernel_s tile_kernels[];
+extern const uint32_t num_tile_kernels;
+
+#endif  // KERNELS_H
@@ -22,11 +22,19 @@
  **/
 
 #include "../utils/utils.h"
+#include "../utils/parallel.h"
+#include "../utils/topology.h"
+#include "../utils/trace.h"
+#include "./kernels.h"
 #include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
+#include <x86intrin.h>
 
 void row_column_row(uint64_t *img, uint64_t* restrict C);
 void rotate_columns(uint64_t *B, uint64_t* restrict scratch);
+void transpose_flip(uint64_t *img, uint64_t* restrict scratch);
+void naive_tile_rotation(uint64_t *img, uint64_t* restrict scratch);
 void byte_swap(uint64_t *a);
 void print_bit_matrix(uint8_t *bit_matrix, const bits_t N, int32_t ncolumns); 
 
@@ -39,15 +47,125 @@ void print_bit_matrix(uint8_t *bit_matrix, const bits_t N, int32_t ncolumns);
 #define stay_mask2 0xFFFF0000FFFF0000ull
 #define stay_mask1 0xFFFFFFFF00000000ull
 
+// Finds the 4-cycle of 64x64 blocks whose upper left member is the
+// block in block-row `j` and block-column `i`
+static inline void block_cycle_offsets(uint64_t* img_64, const uint64_t row_size,
+                                       uint64_t i, uint64_t j,
+                                       uint64_t* offsets[4]) {
+  // Offset of a block in upper left quadrant
+  offsets[0] = img_64 + 64*j*row_size + i;
+  // Offset of a block in upper right quadrant
+  offsets[1] = img_64 + 64*i*row_size + row_size-j-1;
+  // Offset of a block in lower right quadrant
+  offsets[2] = img_64 + 64*(row_size-j-1)*row_size + row_size-i-1;
+  // Offset of a block in lower left quadrant
+  offsets[3] = img_64 + 64*(row_size-i-1)*row_size + j;
+}
+
+static inline void gather_block_cycle(uint64_t* const offsets[4],
+                                      const uint64_t row_size,
+                                      uint64_t tiles[4][64]) {
+  for (uint64_t k=0; k < 64; k++){
+    tiles[0][k] = __builtin_bswap64(offsets[0][k*row_size]);
+    tiles[1][k] = __builtin_bswap64(offsets[1][k*row_size]);
+    tiles[2][k] = __builtin_bswap64(offsets[2][k*row_size]);
+    tiles[3][k] = __builtin_bswap64(offsets[3][k*row_size]);
+  }
+}
+
+// Displace first block to the second position,
+// second to third position and so on
+static inline void scatter_block_cycle(uint64_t* const offsets[4],
+                                       const uint64_t row_size,
+                                       uint64_t tiles[4][64]) {
+  for (int k=0; k<64; k++){
+    offsets[1][k*row_size] = __builtin_bswap64(tiles[0][k]);
+    offsets[2][k*row_size] = __builtin_bswap64(tiles[1][k]);
+    offsets[3][k*row_size] = __builtin_bswap64(tiles[2][k]);
+    offsets[0][k*row_size] = __builtin_bswap64(tiles[3][k]);
+  }
+}
+
+// Rotates the 4-cycle of 64x64 blocks whose upper left member is the
+// block in block-row `j` and block-column `i`
+static inline void rotate_block_cycle(uint64_t* img_64, const uint64_t row_size,
+                                      uint64_t i, uint64_t j,
+                                      uint64_t* restrict scratch,
+                                      struct trace_phases_s* phases) {
+  uint64_t* offsets[4];
+  uint64_t tiles[4][64];
+
+  block_cycle_offsets(img_64, row_size, i, j, offsets);
+  gather_block_cycle(offsets, row_size, tiles);
+  trace_phase_end(phases, TRACE_GATHER);
+
+  // Rotate the 64x64 matrix efficiently
+  row_column_row(tiles[0], scratch);
+  row_column_row(tiles[1], scratch);
+  row_column_row(tiles[2], scratch);
+  row_column_row(tiles[3], scratch);
+  trace_phase_end(phases, TRACE_KERNEL);
+
+  scatter_block_cycle(offsets, row_size, tiles);
+  trace_phase_end(phases, TRACE_SCATTER);
+}
+
+// Rotates the middle block, which exists if we have an odd number of
+// 64x64 blocks per image side
+static inline void rotate_middle_block(uint64_t* img_64, const bits_t N,
+                                       const uint64_t row_size,
+                                       uint64_t* restrict scratch) {
+  uint64_t A[64];
+  int j = N/128;
+  uint64_t* offset = img_64 + 64*j*row_size + j;
+  for (int k=0; k < 64; k++){
+    A[k] = __builtin_bswap64(offset[k*row_size]);
+  }
+  row_column_row(A, scratch);
+  for (int k=0; k<64; k++){
+    offset[k*row_size] = __builtin_bswap64(A[k]);
+  }
+}
+
+// Number of block cycles in an N by N image. Cycle `c` starts at
+// block-column `c % (N/128)` of block-row `c / (N/128)`
+static inline uint64_t num_block_cycles(const bits_t N) {
+  bits_t big_N = N % 128 == 0 ? N : N+128;
+  return (uint64_t)(big_N/128) * (N/128);
+}
+
+// Block cycles per span in tracing builds
+#define TRACE_BATCH_CYCLES 256
+
+// Rotates block cycles [begin, end)
+static void rotate_block_cycles(uint64_t* img_64, const bits_t N,
+                                uint64_t begin, uint64_t end) {
+  const uint64_t row_size = (N+63)/64;
+  const uint64_t cycles_per_row = N/128;
+  uint64_t scratch_space[64];
+  uint64_t* restrict scratch = scratch_space;
+
+  // Tracing builds record one span per batch of cycles
+  struct trace_phases_s phases;
+  uint64_t batch_start = begin;
+  trace_phases_start(&phases);
+
+  for (uint64_t c = begin; c < end; c++) {
+    rotate_block_cycle(img_64, row_size, c % cycles_per_row, c / cycles_per_row,
+                       scratch, &phases);
+    if (TRACE_ENABLED && (c + 1 - batch_start == TRACE_BATCH_CYCLES || c + 1 == end)) {
+      trace_phases_record("block cycles", &phases, batch_start, c + 1);
+      trace_phases_start(&phases);
+      batch_start = c + 1;
+    }
+  }
+}
+
 void rotate_bit_matrix(uint8_t *img, const bits_t N) {
 
   const uint64_t row_size = (N+63)/64;
-  // Define scratch spaces for block rotation
-  uint64_t A[64];
-  uint64_t B[64];
-  uint64_t C[64];
-  uint64_t D[64];
-  uint64_t* restrict scratch = (uint64_t*) malloc(64*sizeof(uint64_t));
+  uint64_t scratch_space[64];
+  uint64_t* restrict scratch = scratch_space;
 
   uint64_t* img_64 = (uint64_t*) img; 
 
@@ -67,58 +185,477 @@ void rotate_bit_matrix(uint8_t *img, const bits_t N) {
   }
 
   // Look at all (i, j) in first quadrant
+  rotate_block_cycles(img_64, N, 0, num_block_cycles(N));
+
+  // Rotate middle block if we have odd number of 64x64
+  // blocks per image side
+  if (N/64 % 2 ==1) {
+    rotate_middle_block(img_64, N, row_size, scratch);
+  }
+}
+
+// Number of threads used by `rotate_bit_matrix_parallel`
+static uint32_t rotate_threads = 1;
+
+void set_rotate_threads(uint32_t nthreads) {
+  rotate_threads = nthreads > 0 ? nthreads : 1;
+}
+
+struct parallel_rotation_s {
+  uint64_t* img_64;
+  bits_t N;
+};
+
+// Each thread rotates one contiguous range of block cycles
+static void rotate_parallel_worker(void *arg, uint32_t tid, uint32_t nthreads) {
+  struct parallel_rotation_s *job = arg;
+  const uint64_t ncycles = num_block_cycles(job->N);
+  uint64_t trace_start = trace_now();
+
+  rotate_block_cycles(job->img_64, job->N, ncycles * tid / nthreads,
+                      ncycles * (tid + 1) / nthreads);
+
+  if (tid == 0 && job->N/64 % 2 == 1) {
+    uint64_t scratch_space[64];
+    rotate_middle_block(job->img_64, job->N, (job->N+63)/64, scratch_space);
+  }
+  trace_span("parallel worker", trace_start);
+}
+
+// Rotates `img` like `rotate_bit_matrix`, splitting the block cycles
+// between the threads set by `set_rotate_threads`
+void rotate_bit_matrix_parallel(uint8_t *img, const bits_t N) {
+  // Block cycles are independent, but small images are not worth the
+  // thread start-up cost
+  uint64_t ncycles = num_block_cycles(N);
+  uint32_t nthreads = rotate_threads < ncycles ? rotate_threads : (uint32_t)ncycles;
+
+  if (nthreads <= 1) {
+    rotate_bit_matrix(img, N);
+    return;
+  }
+
+  struct parallel_rotation_s job = {.img_64 = (uint64_t*) img, .N = N};
+  run_parallel(nthreads, rotate_parallel_worker, &job);
+}
+
+// The NUMA engine gives each node a band of block-rows in the upper half
+// of the image together with their mirror images in the lower half. Block
+// cycle (i, j) has its A and C blocks in block-rows j and N/64-j-1, so
+// handing it to the node that owns row j keeps at least half of its
+// traffic local, and all of it when i falls in the same band.
+struct numa_rotation_s {
+  uint64_t* img_64;
+  bits_t N;
+  uint32_t nnodes;
+};
+
+// First block-row of the upper-half band owned by `node`
+static inline uint64_t numa_band_start(const bits_t N, uint32_t node, uint32_t nnodes) {
   bits_t big_N = N % 128 == 0 ? N : N+128;
-  for (uint32_t j=0; j < big_N/128; j++) {
-    for (uint32_t i=0; i < N/128; i++) {
-      // Offset of a block in upper left quadrant
-      uint64_t* offset_A = img_64 + 64*j*row_size + i;
-      // Offset of a block in upper right quadrant
-      uint64_t* offset_B = img_64 + 64*i*row_size + row_size-j-1;
-      // Offset of a block in lower right quadrant
-      uint64_t* offset_C = img_64 + 64*(row_size-j-1)*row_size + row_size-i-1;
-      // Offset of a block in lower left quadrant
-      uint64_t* offset_D = img_64 + 64*(row_size-i-1)*row_size + j;
-      
-      for (uint64_t k=0; k < 64; k++){
-        A[k] = __builtin_bswap64(offset_A[k*row_size]);
-        B[k] = __builtin_bswap64(offset_B[k*row_size]);
-        C[k] = __builtin_bswap64(offset_C[k*row_size]);
-        D[k] = __builtin_bswap64(offset_D[k*row_size]);
-      }
+  return (uint64_t)(big_N/128) * node / nnodes;
+}
 
-      // Rotate the 64x64 matrix efficiently
-      row_column_row(A, scratch);
-      row_column_row(B, scratch);
-      row_column_row(C, scratch);
-      row_column_row(D, scratch);
-
-      // Displace first block to the second position,
-      // second to third position and so on
-      for (int k=0; k<64; k++){
-        offset_B[k*row_size] = __builtin_bswap64(A[k]);
-        offset_C[k*row_size] = __builtin_bswap64(B[k]);
-        offset_D[k*row_size] = __builtin_bswap64(C[k]);
-        offset_A[k*row_size] = __builtin_bswap64(D[k]);
-      }
+// First thread of those assigned to `node`
+static inline uint32_t numa_first_thread(uint32_t node, uint32_t nthreads, uint32_t nnodes) {
+  return (node * nthreads + nnodes - 1) / nnodes;
+}
+
+static void rotate_numa_worker(void *arg, uint32_t tid, uint32_t nthreads) {
+  struct numa_rotation_s *job = arg;
+  const uint64_t cycles_per_row = job->N/128;
+  const uint32_t node = (uint64_t)tid * job->nnodes / nthreads;
+  uint64_t trace_start = trace_now();
+
+  pin_thread_to_node(node);
+
+  // Split the node's cycles between its threads
+  uint64_t begin = numa_band_start(job->N, node, job->nnodes) * cycles_per_row;
+  uint64_t end = numa_band_start(job->N, node + 1, job->nnodes) * cycles_per_row;
+  uint32_t first = numa_first_thread(node, nthreads, job->nnodes);
+  uint32_t nlocal = numa_first_thread(node + 1, nthreads, job->nnodes) - first;
+  uint32_t t = tid - first;
+
+  rotate_block_cycles(job->img_64, job->N, begin + (end - begin) * t / nlocal,
+                      begin + (end - begin) * (t + 1) / nlocal);
+
+  // The middle block-row belongs to the last node
+  if (tid == nthreads - 1 && job->N/64 % 2 == 1) {
+    uint64_t scratch_space[64];
+    rotate_middle_block(job->img_64, job->N, (job->N+63)/64, scratch_space);
+  }
+
+  if (tid == 0) {
+    unpin_thread();
+  }
+  trace_span("numa worker", trace_start);
+}
+
+// Moves each block-row of `img` to the node whose threads rotate it
+static void numa_place_bit_matrix(uint8_t *img, const bits_t N, uint32_t nnodes) {
+  const uint64_t block_rows = N/64;
+  const uint64_t block_row_bytes = 64 * bits_to_bytes(N);
+
+  for (uint32_t node = 0; node < nnodes; node++) {
+    uint64_t first = numa_band_start(N, node, nnodes);
+    uint64_t last = numa_band_start(N, node + 1, nnodes);
+    if (first == last) {
+      continue;
+    }
+    place_on_node(img + first * block_row_bytes, (last - first) * block_row_bytes, node);
+    // Mirror rows; for an odd number of block-rows the middle one is in
+    // both ranges of the last node
+    place_on_node(img + (block_rows - last) * block_row_bytes,
+                  (last - first) * block_row_bytes, node);
+  }
+}
+
+// Rotates `img` like `rotate_bit_matrix_parallel`, with the threads spread
+// over the NUMA nodes and the image pages moved next to the threads that
+// rotate them
+void rotate_bit_matrix_numa(uint8_t *img, const bits_t N) {
+  uint64_t ncycles = num_block_cycles(N);
+  uint32_t nthreads = rotate_threads < ncycles ? rotate_threads : (uint32_t)ncycles;
+  if (nthreads <= 1) {
+    rotate_bit_matrix(img, N);
+    return;
+  }
+
+  // Each used node needs at least one thread and one band of cycles
+  uint32_t nnodes = numa_nodes();
+  if (nnodes > nthreads) {
+    nnodes = nthreads;
+  }
+  if (nnodes > N/128) {
+    nnodes = N/128;
+  }
+
+  // The pages are placed on every call: the engine may run on several
+  // buffers at once, and `mbind` leaves pages already on their node alone
+  numa_place_bit_matrix(img, N, nnodes);
+
+  struct numa_rotation_s job = {.img_64 = (uint64_t*) img, .N = N, .nnodes = nnodes};
+  run_parallel(nthreads, rotate_numa_worker, &job);
+}
+
+// Prefetch distance of `rotate_bit_matrix_pipelined`, in block cycles
+static uint32_t prefetch_distance = 2;
+
+void set_prefetch_distance(uint32_t distance) {
+  prefetch_distance = distance;
+}
+
+// Prefetches the 256 cache lines of block cycle `c` for writing
+static inline void prefetch_block_cycle(uint64_t* img_64, const bits_t N, uint64_t c) {
+  const uint64_t row_size = (N+63)/64;
+  const uint64_t cycles_per_row = N/128;
+  uint64_t* offsets[4];
+
+  block_cycle_offsets(img_64, row_size, c % cycles_per_row, c / cycles_per_row, offsets);
+  for (uint64_t k=0; k < 64; k++){
+    __builtin_prefetch(offsets[0] + k*row_size, 1, 3);
+    __builtin_prefetch(offsets[1] + k*row_size, 1, 3);
+    __builtin_prefetch(offsets[2] + k*row_size, 1, 3);
+    __builtin_prefetch(offsets[3] + k*row_size, 1, 3);
+  }
+}
+
+// Rotates `img` like `rotate_bit_matrix`, but software-pipelined: while
+// cycle k is rotated, cycle k + `prefetch_distance` is being prefetched
+// and cycle k + 1 has already been gathered into the other set of tiles,
+// so the strided loads overlap with the rotation work instead of stalling
+// it. Distance 0 turns the prefetches off
+void rotate_bit_matrix_pipelined(uint8_t *img, const bits_t N) {
+  const uint64_t row_size = (N+63)/64;
+  const uint64_t cycles_per_row = N/128;
+  const uint64_t ncycles = num_block_cycles(N);
+  const uint64_t distance = prefetch_distance;
+  uint64_t scratch_space[64];
+  uint64_t* restrict scratch = scratch_space;
+  uint64_t* img_64 = (uint64_t*) img;
+
+  if (ncycles == 0) {
+    rotate_bit_matrix(img, N);
+    return;
+  }
+
+  uint64_t* offsets[2][4];
+  uint64_t tiles[2][4][64];
+  struct trace_phases_s phases;
+  uint64_t batch_start = 0;
+
+  for (uint64_t c = 0; c < distance && c < ncycles; c++) {
+    prefetch_block_cycle(img_64, N, c);
+  }
+  block_cycle_offsets(img_64, row_size, 0, 0, offsets[0]);
+  gather_block_cycle(offsets[0], row_size, tiles[0]);
+  trace_phases_start(&phases);
+
+  for (uint64_t c = 0; c < ncycles; c++) {
+    const int cur = c & 1;
+    const int next = cur ^ 1;
+
+    if (distance > 0 && c + distance < ncycles) {
+      prefetch_block_cycle(img_64, N, c + distance);
+    }
+
+    // Block cycles are disjoint, so the next one can be loaded before
+    // this one is stored
+    if (c + 1 < ncycles) {
+      block_cycle_offsets(img_64, row_size, (c+1) % cycles_per_row,
+                          (c+1) / cycles_per_row, offsets[next]);
+      gather_block_cycle(offsets[next], row_size, tiles[next]);
+    }
+    trace_phase_end(&phases, TRACE_GATHER);
+
+    row_column_row(tiles[cur][0], scratch);
+    row_column_row(tiles[cur][1], scratch);
+    row_column_row(tiles[cur][2], scratch);
+    row_column_row(tiles[cur][3], scratch);
+    trace_phase_end(&phases, TRACE_KERNEL);
+
+    scatter_block_cycle(offsets[cur], row_size, tiles[cur]);
+    trace_phase_end(&phases, TRACE_SCATTER);
+
+    if (TRACE_ENABLED && (c + 1 - batch_start == TRACE_BATCH_CYCLES || c + 1 == ncycles)) {
+      trace_phases_record("pipelined cycles", &phases, batch_start, c + 1);
+      trace_phases_start(&phases);
+      batch_start = c + 1;
+    }
+  }
+
+  if (N/64 % 2 == 1) {
+    rotate_middle_block(img_64, N, row_size, scratch);
+  }
+}
+
+// Loads the 64 pixels of `row` starting at bit column `x`, with the
+// pixel at `x` in the most significant bit. `x` need not be byte aligned
+static inline uint64_t load_bits(const uint8_t* row, bits_t x) {
+  const uint8_t* p = row + x/8;
+  const uint32_t shift = x % 8;
+  uint64_t word;
+
+  memcpy(&word, p, sizeof(word));
+  word = __builtin_bswap64(word);
+  if (shift != 0) {
+    word = (word << shift) | (p[8] >> (8 - shift));
+  }
+  return word;
+}
+
+// Stores `word` as the 64 pixels of `row` starting at bit column `x`,
+// leaving the pixels around them untouched
+static inline void store_bits(uint8_t* row, bits_t x, uint64_t word) {
+  uint8_t* p = row + x/8;
+  const uint32_t shift = x % 8;
+  uint64_t out = word;
+
+  if (shift != 0) {
+    uint64_t old;
+    memcpy(&old, p, sizeof(old));
+    old = __builtin_bswap64(old);
+    out = (old & (~0ull << (64 - shift))) | (word >> shift);
+    p[8] = (p[8] & (0xFF >> shift)) | (uint8_t)(word << (8 - shift));
+  }
+  out = __builtin_bswap64(out);
+  memcpy(p, &out, sizeof(out));
+}
+
+// Rotates the 4-cycle of 64x64 blocks of a region of interest whose upper
+// left member is the block in block-row `j` and block-column `i`. `base`
+// points at the first row of the region, which starts at bit column `x`
+// and is `nblocks` blocks on a side
+static inline void rotate_roi_block_cycle(uint8_t* base, const bytes_t row_size,
+                                          bits_t x, uint64_t nblocks,
+                                          uint64_t i, uint64_t j,
+                                          uint64_t* restrict scratch) {
+  // Upper left bit of each block in the cycle, as in `block_cycle_offsets`
+  const uint64_t block_row[4] = {j, i, nblocks-j-1, nblocks-i-1};
+  const uint64_t block_col[4] = {i, nblocks-j-1, nblocks-i-1, j};
+  uint8_t* rows[4];
+  bits_t cols[4];
+  uint64_t tiles[4][64];
+
+  for (int b = 0; b < 4; b++) {
+    rows[b] = base + 64*block_row[b]*row_size;
+    cols[b] = x + 64*block_col[b];
+  }
+
+  for (uint64_t k=0; k < 64; k++){
+    for (int b = 0; b < 4; b++) {
+      tiles[b][k] = load_bits(rows[b] + k*row_size, cols[b]);
+    }
+  }
+
+  for (int b = 0; b < 4; b++) {
+    row_column_row(tiles[b], scratch);
+  }
+
+  // Displace each block to the next position of the cycle. Blocks of one
+  // cycle may share a byte, so the stores must stay read-modify-write
+  for (uint64_t k=0; k < 64; k++){
+    for (int b = 0; b < 4; b++) {
+      store_bits(rows[(b+1) % 4] + k*row_size, cols[(b+1) % 4], tiles[b][k]);
+    }
+  }
+}
+
+// Rotates the `side` by `side` square whose upper left pixel is at bit
+// column `x` of row `y` of an image with `row_size` bytes per row. The
+// rest of the image is left untouched. `side` must be a multiple of 64,
+// but `x` need not be aligned to anything
+void rotate_bit_matrix_roi(uint8_t *base, const bytes_t row_size,
+                           bits_t x, bits_t y, const bits_t side) {
+  // Sanity check the input
+  assert(side % 64 == 0);
+  assert(x + side <= row_size * 8);
+
+  const uint64_t nblocks = side/64;
+  uint64_t scratch_space[64];
+  uint64_t* restrict scratch = scratch_space;
+  uint8_t* roi = base + y*row_size;
+
+  // Look at all (i, j) in first quadrant
+  for (uint64_t j = 0; j < (nblocks+1)/2; j++) {
+    for (uint64_t i = 0; i < nblocks/2; i++) {
+      rotate_roi_block_cycle(roi, row_size, x, nblocks, i, j, scratch);
     }
   }
 
   // Rotate middle block if we have odd number of 64x64
-  // blocks per image side
-  if (N/64 % 2 ==1) {
-    int j = N/128;
-    uint64_t* offset = img_64 + 64*j*row_size + j;
+  // blocks per side
+  if (nblocks % 2 == 1) {
+    uint64_t tile[64];
+    uint8_t* middle = roi + 64*(nblocks/2)*row_size;
+    bits_t middle_x = x + 64*(nblocks/2);
     for (int k=0; k < 64; k++){
-      A[k] = __builtin_bswap64(offset[k*row_size]);
+      tile[k] = load_bits(middle + k*row_size, middle_x);
     }
-    row_column_row(A, scratch);
-    for (int k=0; k<64; k++){
-      offset[k*row_size] = __builtin_bswap64(A[k]);
+    row_column_row(tile, scratch);
+    for (int k=0; k < 64; k++){
+      store_bits(middle + k*row_size, middle_x, tile[k]);
     }
   }
-  free(scratch);
 }
-    
+
+// Packs every `factor`-th bit of `word`, starting with the most
+// significant one, into the low 64/`factor` bits of the result
+static inline uint64_t pack_group_bits(uint64_t word, uint32_t factor) {
+  const uint64_t group_msbs = factor == 2 ? 0xAAAAAAAAAAAAAAAAull :
+                              factor == 4 ? 0x8888888888888888ull :
+                                            0x8080808080808080ull;
+#ifdef __BMI2__
+  return _pext_u64(word, group_msbs);
+#else
+  uint64_t packed = 0;
+  for (int bit = 63; bit >= 0; bit -= factor) {
+    packed = (packed << 1) | ((word & group_msbs) >> bit & 1);
+  }
+  return packed;
+#endif
+}
+
+// Reduces a rotated 64x64 tile to (64/`factor`)x(64/`factor`) pixels in
+// place. With `majority`, an output pixel is set when more than half of
+// its `factor`x`factor` cell is; otherwise when any pixel of the cell is
+static inline void downsample_tile(uint64_t* tile, uint32_t factor, bool majority) {
+  const uint32_t out_side = 64 / factor;
+
+  for (uint32_t r = 0; r < out_side; r++) {
+    const uint64_t* cell_rows = tile + r*factor;
+    uint64_t reduced = 0;
+
+    if (majority) {
+      const uint64_t cell_mask = (1ull << factor) - 1;
+      for (uint32_t c = 0; c < out_side; c++) {
+        const uint32_t shift = 64 - (c+1)*factor;
+        uint32_t count = 0;
+        for (uint32_t k = 0; k < factor; k++) {
+          count += __builtin_popcountll((cell_rows[k] >> shift) & cell_mask);
+        }
+        reduced = (reduced << 1) | (count > factor*factor/2);
+      }
+    } else {
+      uint64_t folded = 0;
+      for (uint32_t k = 0; k < factor; k++) {
+        folded |= cell_rows[k];
+      }
+      // OR every cell into its most significant bit
+      for (uint32_t width = 1; width < factor; width <<= 1) {
+        folded |= folded << width;
+      }
+      reduced = pack_group_bits(folded, factor);
+    }
+    tile[r] = reduced;
+  }
+}
+
+struct downsample_s {
+  const uint8_t* img;
+  bits_t N;
+  uint32_t factor;
+  bool majority;
+  uint8_t* out;
+};
+
+// Rotates and reduces the blocks of block-rows [begin, end) one at a time
+static void rotate_downsample_rows(const struct downsample_s *job,
+                                   uint64_t begin, uint64_t end) {
+  const bits_t N = job->N;
+  const uint64_t row_size = N/64;
+  const uint64_t nblocks = N/64;
+  const uint32_t out_side = 64 / job->factor;
+  const bytes_t out_row_size = bits_to_bytes(N / job->factor);
+  const uint64_t* img_64 = (const uint64_t*) job->img;
+  uint64_t scratch_space[64];
+  uint64_t* restrict scratch = scratch_space;
+  uint64_t tile[64];
+
+  for (uint64_t br = begin; br < end; br++) {
+    for (uint64_t bc = 0; bc < nblocks; bc++) {
+      const uint64_t* offset = img_64 + 64*br*row_size + bc;
+      for (int k=0; k < 64; k++){
+        tile[k] = __builtin_bswap64(offset[k*row_size]);
+      }
+      row_column_row(tile, scratch);
+      downsample_tile(tile, job->factor, job->majority);
+
+      // Block (br, bc) lands in block-row `bc` and block-column
+      // `nblocks-br-1` of the rotated image; its reduced rows are whole bytes
+      uint8_t* dest = job->out + bc*out_side*out_row_size + (nblocks-br-1)*out_side/8;
+      for (uint32_t r = 0; r < out_side; r++) {
+        for (uint32_t byte = 0; byte < out_side/8; byte++) {
+          dest[r*out_row_size + byte] = tile[r] >> (out_side - 8*(byte+1));
+        }
+      }
+    }
+  }
+}
+
+static void rotate_downsample_worker(void *arg, uint32_t tid, uint32_t nthreads) {
+  const struct downsample_s *job = arg;
+  const uint64_t nblocks = job->N/64;
+  rotate_downsample_rows(job, nblocks * tid / nthreads, nblocks * (tid + 1) / nthreads);
+}
+
+// Writes `img` rotated and reduced by `factor` (2, 4 or 8) on each side
+// to the (N/factor)x(N/factor) bit matrix `out`, without materializing the
+// full-size rotation. Reductions OR each cell, or take its majority with
+// `majority`. Block-rows are split between the threads set by
+// `set_rotate_threads`
+void rotate_bit_matrix_downsample(const uint8_t *img, const bits_t N,
+                                  uint32_t factor, bool majority, uint8_t *out) {
+  // Sanity check the input
+  assert(N % 64 == 0);
+  assert(factor == 2 || factor == 4 || factor == 8);
+
+  struct downsample_s job = {.img = img, .N = N, .factor = factor,
+                             .majority = majority, .out = out};
+  uint32_t nthreads = rotate_threads < N/64 ? rotate_threads : N/64;
+  run_parallel(nthreads, rotate_downsample_worker, &job);
+}
+
 void row_column_row(uint64_t *img, uint64_t* restrict scratch){
   // First, rotate all rows to the left by their index + 1
   for (int i = 0; i < 64; i++){
@@ -191,3 +728,45 @@ void rotate_columns(uint64_t *B, uint64_t* restrict C){
   return;
 }
 
+
+// Rotates by transposing with 6 rounds of masked block swaps, then
+// reversing the order of the rows
+void transpose_flip(uint64_t *img, uint64_t* restrict scratch){
+  (void)scratch;  // Works in place
+  uint64_t mask = 0x00000000FFFFFFFFull;
+  for (int width = 32; width != 0; width >>= 1, mask ^= mask << width){
+    for (int k = 0; k < 64; k = ((k | width) + 1) & ~width){
+      uint64_t t = ((img[k] >> width) ^ img[k | width]) & mask;
+      img[k] ^= t << width;
+      img[k | width] ^= t;
+    }
+  }
+  for (int i = 0; i < 32; i++){
+    uint64_t tmp = img[i];
+    img[i] = img[63-i];
+    img[63-i] = tmp;
+  }
+  return;
+}
+
+// Rotates one bit at a time. Slow, but obviously correct
+void naive_tile_rotation(uint64_t *img, uint64_t* restrict scratch){
+  for (int r = 0; r < 64; r++){
+    uint64_t row = 0;
+    for (int b = 0; b < 64; b++){
+      row |= ((img[b] >> (63-r)) & 1) << b;
+    }
+    scratch[r] = row;
+  }
+  for (int r = 0; r < 64; r++){
+    img[r] = scratch[r];
+  }
+  return;
+}
+
+const struct tile_kernel_s tile_kernels[] = {
+  {"row_column_row", row_column_row},
+  {"transpose_flip", transpose_flip},
+  {"naive", naive_tile_rotation},
+};
+const uint32_t num_tile_kernels = sizeof(tile_kernels) / sizeof(tile_kernels[0]);
@@ -0,0 +1,825 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#ifndef NO_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+#include "./utils.h"
+#include "./libbmp.h"
+#include "./batch.h"
+
+// An image moves through its slot as read -> rotate -> write. The slot
+// buffers are kept across images so steady state does not allocate
+enum slot_state_e {SLOT_FREE, SLOT_READING, SLOT_ROTATING, SLOT_WRITING};
+
+struct batch_slot_s {
+  enum slot_state_e state;
+  const char *input_fname;
+  int fd;
+
+  // Raw input file, then the encoded output file
+  uint8_t *file;
+  size_t file_capacity;
+  size_t file_size;
+  size_t io_done;
+
+  // Decoded image that gets rotated
+  uint8_t *img;
+  size_t img_capacity;
+  size_t img_size;
+  bool failed;
+};
+
+enum io_event_e {EVENT_READ_DONE, EVENT_WRITE_DONE, EVENT_ROTATED};
+
+struct io_event_s {
+  enum io_event_e kind;
+  uint32_t slot;
+  int64_t res;
+};
+
+// A mutex-protected FIFO of events or requests
+struct event_queue_s {
+  pthread_mutex_t lock;
+  pthread_cond_t nonempty;
+  struct io_event_s *events;
+  uint32_t capacity;
+  uint32_t head;
+  uint32_t len;
+};
+
+static void event_queue_init(struct event_queue_s *q, uint32_t capacity) {
+  pthread_mutex_init(&q->lock, NULL);
+  pthread_cond_init(&q->nonempty, NULL);
+  q->events = malloc(capacity * sizeof(struct io_event_s));
+  assert(q->events);
+  q->capacity = capacity;
+  q->head = q->len = 0;
+}
+
+static void event_queue_destroy(struct event_queue_s *q) {
+  free(q->events);
+  pthread_mutex_destroy(&q->lock);
+  pthread_cond_destroy(&q->nonempty);
+}
+
+// Every slot has at most one outstanding event, so `capacity` >= slots
+// plus the shutdown sentinels never overflows
+static void event_queue_push(struct event_queue_s *q, struct io_event_s event) {
+  pthread_mutex_lock(&q->lock);
+  assert(q->len < q->capacity);
+  q->events[(q->head + q->len) % q->capacity] = event;
+  q->len++;
+  pthread_cond_signal(&q->nonempty);
+  pthread_mutex_unlock(&q->lock);
+}
+
+// Pops the oldest event. If `block` is false and the queue is empty,
+// returns `false` right away
+static bool event_queue_pop(struct event_queue_s *q, struct io_event_s *event, bool block) {
+  pthread_mutex_lock(&q->lock);
+  while (block && q->len == 0) {
+    pthread_cond_wait(&q->nonempty, &q->lock);
+  }
+  bool popped = q->len > 0;
+  if (popped) {
+    *event = q->events[q->head];
+    q->head = (q->head + 1) % q->capacity;
+    q->len--;
+  }
+  pthread_mutex_unlock(&q->lock);
+  return popped;
+}
+
+//
+// Asynchronous I/O backends. Only the coordinating thread submits I/O and
+// waits for events; rotation workers report finished images through
+// `io_notify_rotated`
+//
+
+#define IO_THREADS_MAX 8
+
+struct io_backend_s {
+  bool use_uring;
+  struct batch_slot_s *slots;
+
+  // Images finished by the rotation workers
+  struct event_queue_s rotated;
+
+#ifndef NO_IO_URING
+  // io_uring state, driven directly through the system calls
+  int ring_fd;
+  uint32_t ring_entries;
+  void *sq_ptr;
+  void *cq_ptr;
+  size_t sq_len;
+  size_t cq_len;
+  struct io_uring_sqe *sqes;
+  size_t sqes_len;
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned *sq_mask;
+  unsigned *sq_array;
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned *cq_mask;
+  struct io_uring_cqe *cqes;
+  uint32_t to_submit;
+
+  // Rotation workers bump `rotated_efd`; a read on it is always in flight
+  // so the coordinator wakes up from `io_uring_enter`
+  int rotated_efd;
+  uint64_t rotated_efd_value;
+#endif
+
+  // Thread pool fallback: requests in, completions out
+  struct event_queue_s requests;
+  struct event_queue_s completions;
+  pthread_t io_threads[IO_THREADS_MAX];
+  uint32_t nio_threads;
+};
+
+#ifndef NO_IO_URING
+// `user_data` of the read on `rotated_efd`; slots use `2 * slot + is_write`
+#define URING_EFD_TAG UINT64_MAX
+
+static void uring_teardown(struct io_backend_s *be);
+
+static bool uring_setup(struct io_backend_s *be, uint32_t entries) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+
+  // Nothing is mapped or open yet, so `uring_teardown` can undo a partial
+  // setup
+  be->sq_ptr = be->cq_ptr = MAP_FAILED;
+  be->sqes = MAP_FAILED;
+  be->rotated_efd = -1;
+
+  be->ring_fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+  if (be->ring_fd < 0) {
+    return false;
+  }
+  be->ring_entries = params.sq_entries;
+
+  be->sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  be->cq_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    be->sq_len = be->cq_len = be->sq_len > be->cq_len ? be->sq_len : be->cq_len;
+  }
+
+  be->sq_ptr = mmap(NULL, be->sq_len, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, be->ring_fd, IORING_OFF_SQ_RING);
+  if (be->sq_ptr == MAP_FAILED) {
+    uring_teardown(be);
+    return false;
+  }
+  be->cq_ptr = single_mmap ? be->sq_ptr
+      : mmap(NULL, be->cq_len, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, be->ring_fd, IORING_OFF_CQ_RING);
+  be->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+  be->sqes = mmap(NULL, be->sqes_len, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, be->ring_fd, IORING_OFF_SQES);
+  if (be->cq_ptr == MAP_FAILED || be->sqes == MAP_FAILED) {
+    uring_teardown(be);
+    return false;
+  }
+
+  uint8_t *sq = be->sq_ptr;
+  uint8_t *cq = be->cq_ptr;
+  be->sq_head = (unsigned *)(sq + params.sq_off.head);
+  be->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+  be->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+  be->sq_array = (unsigned *)(sq + params.sq_off.array);
+  be->cq_head = (unsigned *)(cq + params.cq_off.head);
+  be->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+  be->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+  be->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+  be->to_submit = 0;
+
+  be->rotated_efd = eventfd(0, EFD_CLOEXEC);
+  if (be->rotated_efd < 0) {
+    uring_teardown(be);
+    return false;
+  }
+  return true;
+}
+
+static int uring_enter(struct io_backend_s *be, uint32_t min_complete) {
+  unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+  int ret = (int)syscall(__NR_io_uring_enter, be->ring_fd, be->to_submit,
+                         min_complete, flags, NULL, 0);
+  if (ret >= 0) {
+    be->to_submit -= ret;
+  }
+  return ret;
+}
+
+// Queues a read or write of `len` bytes; the submission happens on the next
+// `uring_enter`
+static void uring_queue_rw(struct io_backend_s *be, uint8_t opcode, int fd,
+                           void *buf, size_t len, uint64_t offset,
+                           uint64_t user_data) {
+  unsigned tail = *be->sq_tail;
+  while (tail - __atomic_load_n(be->sq_head, __ATOMIC_ACQUIRE) >= be->ring_entries) {
+    // The submission ring is full, hand what we have to the kernel
+    uring_enter(be, 0);
+  }
+
+  unsigned index = tail & *be->sq_mask;
+  struct io_uring_sqe *sqe = &be->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)(uintptr_t)buf;
+  sqe->len = len > UINT32_MAX / 2 ? UINT32_MAX / 2 : (uint32_t)len;
+  sqe->off = offset;
+  sqe->user_data = user_data;
+
+  be->sq_array[index] = index;
+  __atomic_store_n(be->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  be->to_submit++;
+}
+
+static void uring_arm_rotated_efd(struct io_backend_s *be) {
+  uring_queue_rw(be, IORING_OP_READ, be->rotated_efd, &be->rotated_efd_value,
+                 sizeof(be->rotated_efd_value), 0, URING_EFD_TAG);
+}
+
+static bool uring_reap(struct io_backend_s *be, struct io_uring_cqe *cqe) {
+  unsigned head = *be->cq_head;
+  if (head == __atomic_load_n(be->cq_tail, __ATOMIC_ACQUIRE)) {
+    return false;
+  }
+  *cqe = be->cqes[head & *be->cq_mask];
+  __atomic_store_n(be->cq_head, head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+// Unmaps and closes whatever `uring_setup` got to
+static void uring_teardown(struct io_backend_s *be) {
+  if (be->sqes != MAP_FAILED) {
+    munmap(be->sqes, be->sqes_len);
+  }
+  if (be->cq_ptr != MAP_FAILED && be->cq_ptr != be->sq_ptr) {
+    munmap(be->cq_ptr, be->cq_len);
+  }
+  if (be->sq_ptr != MAP_FAILED) {
+    munmap(be->sq_ptr, be->sq_len);
+  }
+  close(be->ring_fd);
+  if (be->rotated_efd >= 0) {
+    close(be->rotated_efd);
+  }
+}
+#endif  // NO_IO_URING
+
+// A thread of the fallback pool performing one blocking pread/pwrite per
+// request
+static void *io_thread_main(void *arg) {
+  struct io_backend_s *be = arg;
+  struct io_event_s request;
+
+  while (event_queue_pop(&be->requests, &request, true)) {
+    if (request.slot == UINT32_MAX) {  // Shutdown sentinel
+      break;
+    }
+    struct batch_slot_s *slot = &be->slots[request.slot];
+    uint8_t *buf = slot->file + slot->io_done;
+    size_t len = slot->file_size - slot->io_done;
+
+    request.res = request.kind == EVENT_READ_DONE
+        ? pread(slot->fd, buf, len, slot->io_done)
+        : pwrite(slot->fd, buf, len, slot->io_done);
+    if (request.res < 0) {
+      request.res = -errno;
+    }
+    event_queue_push(&be->completions, request);
+  }
+  return NULL;
+}
+
+static void io_backend_init(struct io_backend_s *be, struct batch_slot_s *slots,
+                            uint32_t nslots) {
+  memset(be, 0, sizeof(*be));
+  be->slots = slots;
+  event_queue_init(&be->rotated, nslots + 1);
+
+#ifndef NO_IO_URING
+  // Each slot has at most one read or write in flight, plus the eventfd read
+  if (uring_setup(be, 2 * nslots + 2)) {
+    be->use_uring = true;
+    uring_arm_rotated_efd(be);
+    return;
+  }
+#endif
+
+  event_queue_init(&be->requests, nslots + IO_THREADS_MAX);
+  event_queue_init(&be->completions, 2 * nslots + 1);
+  be->nio_threads = nslots < IO_THREADS_MAX ? nslots : IO_THREADS_MAX;
+  uint32_t i;
+  for (i = 0; i < be->nio_threads; i++) {
+    pthread_create(&be->io_threads[i], NULL, io_thread_main, be);
+  }
+}
+
+static void io_backend_destroy(struct io_backend_s *be) {
+#ifndef NO_IO_URING
+  if (be->use_uring) {
+    uring_teardown(be);
+    event_queue_destroy(&be->rotated);
+    return;
+  }
+#endif
+
+  uint32_t i;
+  for (i = 0; i < be->nio_threads; i++) {
+    event_queue_push(&be->requests, (struct io_event_s){.slot = UINT32_MAX});
+  }
+  for (i = 0; i < be->nio_threads; i++) {
+    pthread_join(be->io_threads[i], NULL);
+  }
+  event_queue_destroy(&be->requests);
+  event_queue_destroy(&be->completions);
+  event_queue_destroy(&be->rotated);
+}
+
+// Submits the next read or write of the remaining bytes of slot `index`
+static void io_submit(struct io_backend_s *be, uint32_t index, bool is_write) {
+#ifndef NO_IO_URING
+  if (be->use_uring) {
+    struct batch_slot_s *slot = &be->slots[index];
+    uring_queue_rw(be, is_write ? IORING_OP_WRITE : IORING_OP_READ, slot->fd,
+                   slot->file + slot->io_done, slot->file_size - slot->io_done,
+                   slot->io_done, 2 * (uint64_t)index + is_write);
+    return;
+  }
+#endif
+
+  event_queue_push(&be->requests, (struct io_event_s){
+      .kind = is_write ? EVENT_WRITE_DONE : EVENT_READ_DONE, .slot = index});
+}
+
+// Called from a rotation worker once slot `index` is ready to be written
+static void io_notify_rotated(struct io_backend_s *be, uint32_t index) {
+  struct io_event_s event = {.kind = EVENT_ROTATED, .slot = index};
+
+#ifndef NO_IO_URING
+  if (be->use_uring) {
+    event_queue_push(&be->rotated, event);
+    uint64_t one = 1;
+    ssize_t ret = write(be->rotated_efd, &one, sizeof(one));
+    assert(ret == sizeof(one));
+    (void)ret;
+    return;
+  }
+#endif
+
+  event_queue_push(&be->completions, event);
+}
+
+// Blocks until the next read, write or rotation finishes
+static void io_wait_event(struct io_backend_s *be, struct io_event_s *event) {
+#ifndef NO_IO_URING
+  if (be->use_uring) {
+    while (true) {
+      if (event_queue_pop(&be->rotated, event, false)) {
+        return;
+      }
+
+      struct io_uring_cqe cqe;
+      if (uring_reap(be, &cqe)) {
+        if (cqe.user_data == URING_EFD_TAG) {
+          // Some rotations finished; re-arm and pick them up above
+          uring_arm_rotated_efd(be);
+          continue;
+        }
+        event->slot = cqe.user_data / 2;
+        event->kind = cqe.user_data % 2 ? EVENT_WRITE_DONE : EVENT_READ_DONE;
+        event->res = cqe.res;
+        return;
+      }
+
+      if (uring_enter(be, 1) < 0 && errno != EINTR) {
+        perror("Error waiting on io_uring");
+        assert(false);
+      }
+    }
+  }
+#endif
+
+  event_queue_pop(&be->completions, event, true);
+}
+
+//
+// Rotation workers
+//
+
+struct batch_s {
+  struct io_backend_s io;
+  struct batch_slot_s *slots;
+  void (*rotate_fn)(uint8_t*, const bits_t);
+
+  // Slots whose input has been read completely
+  struct event_queue_s to_rotate;
+};
+
+// Decodes, rotates and re-encodes the image in slot `index`
+static void rotate_slot(struct batch_s *batch, uint32_t index) {
+  struct batch_slot_s *slot = &batch->slots[index];
+  struct color_table_s color_tables[2];
+  int width, height, row_size;
+
+  if (!decode_binary_bmp(slot->file, slot->file_size, &slot->img, &slot->img_capacity,
+                         &width, &height, &row_size, color_tables)
+      || width != height || width < 64 || width % 64 != 0 || width != 8 * row_size) {
+    fprintf(stderr, "Error: %s is not a square binary BMP with a side multiple of 64\n",
+            slot->input_fname);
+    slot->failed = true;
+    return;
+  }
+
+  batch->rotate_fn(slot->img, width);
+
+  // The encoded output reuses the input file buffer
+  size_t out_size = binary_bmp_file_size(width);
+  if (slot->file_capacity < out_size) {
+    uint8_t *grown = realloc(slot->file, out_size);
+    if (!grown) {
+      slot->failed = true;
+      return;
+    }
+    slot->file = grown;
+    slot->file_capacity = out_size;
+  }
+  encode_binary_bmp(slot->file, slot->img, color_tables, width);
+  slot->file_size = out_size;
+  slot->img_size = (size_t)height * row_size;
+}
+
+static void *rotate_worker_main(void *arg) {
+  struct batch_s *batch = arg;
+  struct io_event_s job;
+
+  while (event_queue_pop(&batch->to_rotate, &job, true)) {
+    if (job.slot == UINT32_MAX) {  // Shutdown sentinel
+      break;
+    }
+    rotate_slot(batch, job.slot);
+    io_notify_rotated(&batch->io, job.slot);
+  }
+  return NULL;
+}
+
+//
+// Input enumeration
+//
+
+static int compare_strings(const void *a, const void *b) {
+  return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+// The name an input is written under in the output directory: its last
+// path component
+static const char *output_name(const char *fname) {
+  const char *slash = strrchr(fname, '/');
+  return slash ? slash + 1 : fname;
+}
+
+static int compare_output_names(const void *a, const void *b) {
+  return strcmp(output_name(*(char * const *)a), output_name(*(char * const *)b));
+}
+
+// Returns `false`, after naming them, if two inputs would be written to the
+// same output file
+static bool check_output_names(char **fnames, uint32_t count) {
+  char **sorted = malloc(count * sizeof(char *));
+  assert(sorted);
+  memcpy(sorted, fnames, count * sizeof(char *));
+  qsort(sorted, count, sizeof(char *), compare_output_names);
+
+  bool unique = true;
+  uint32_t i;
+  for (i = 1; i < count; i++) {
+    if (!strcmp(output_name(sorted[i - 1]), output_name(sorted[i]))) {
+      fprintf(stderr, "Error: %s and %s would both be written as %s\n",
+              sorted[i - 1], sorted[i], output_name(sorted[i]));
+      unique = false;
+    }
+  }
+  free(sorted);
+  return unique;
+}
+
+static void free_inputs(char **fnames, uint32_t count) {
+  uint32_t i;
+  for (i = 0; i < count; i++) {
+    free(fnames[i]);
+  }
+  free(fnames);
+}
+
+static bool has_bmp_suffix(const char *name) {
+  size_t len = strlen(name);
+  return len > 4 && !strcasecmp(name + len - 4, ".bmp");
+}
+
+// Collects the input file names from a directory or a list file.
+//
+// Returns the number of names stored in `*fnames`
+static uint32_t collect_inputs(const char *input, char ***fnames) {
+  uint32_t count = 0, capacity = 64;
+  char **names = malloc(capacity * sizeof(char *));
+  assert(names);
+
+  struct stat st;
+  if (stat(input, &st) != 0) {
+    perror("Error reading batch input");
+    *fnames = names;
+    return 0;
+  }
+
+  if (S_ISDIR(st.st_mode)) {
+    DIR *dir = opendir(input);
+    struct dirent *entry;
+    while (dir && (entry = readdir(dir))) {
+      if (!has_bmp_suffix(entry->d_name)) {
+        continue;
+      }
+      if (count == capacity) {
+        capacity *= 2;
+        names = realloc(names, capacity * sizeof(char *));
+        assert(names);
+      }
+      size_t len = strlen(input) + strlen(entry->d_name) + 2;
+      names[count] = malloc(len);
+      snprintf(names[count], len, "%s/%s", input, entry->d_name);
+      count++;
+    }
+    if (dir) {
+      closedir(dir);
+    }
+    // Directory order is arbitrary; process files in a stable order
+    qsort(names, count, sizeof(char *), compare_strings);
+  } else {
+    FILE *list = fopen(input, "r");
+    char line[4096];
+    while (list && fgets(line, sizeof(line), list)) {
+      line[strcspn(line, "\r\n")] = '\0';
+      if (line[0] == '\0') {
+        continue;
+      }
+      if (count == capacity) {
+        capacity *= 2;
+        names = realloc(names, capacity * sizeof(char *));
+        assert(names);
+      }
+      names[count++] = strdup(line);
+    }
+    if (list) {
+      fclose(list);
+    }
+  }
+
+  *fnames = names;
+  return count;
+}
+
+static double now_sec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//
+// The coordinator
+//
+
+// Opens `fname` and starts reading it into free slot `index`.
+//
+// Returns `false` if the file could not be opened
+static bool start_read(struct batch_s *batch, uint32_t index, const char *fname) {
+  struct batch_slot_s *slot = &batch->slots[index];
+  struct stat st;
+
+  slot->fd = open(fname, O_RDONLY | O_CLOEXEC);
+  if (slot->fd < 0 || fstat(slot->fd, &st) != 0 || st.st_size == 0) {
+    fprintf(stderr, "Error reading %s: %s\n", fname, strerror(errno));
+    if (slot->fd >= 0) {
+      close(slot->fd);
+    }
+    return false;
+  }
+
+  if (slot->file_capacity < (size_t)st.st_size) {
+    uint8_t *grown = realloc(slot->file, st.st_size);
+    if (!grown) {
+      close(slot->fd);
+      return false;
+    }
+    slot->file = grown;
+    slot->file_capacity = st.st_size;
+  }
+
+  slot->state = SLOT_READING;
+  slot->input_fname = fname;
+  slot->file_size = st.st_size;
+  slot->io_done = 0;
+  slot->failed = false;
+  io_submit(&batch->io, index, false);
+  return true;
+}
+
+// Opens the output file of slot `index` and starts writing it
+static bool start_write(struct batch_s *batch, uint32_t index, const char *output_dir) {
+  struct batch_slot_s *slot = &batch->slots[index];
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/%s", output_dir, output_name(slot->input_fname));
+
+  slot->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (slot->fd < 0) {
+    fprintf(stderr, "Error writing %s: %s\n", path, strerror(errno));
+    return false;
+  }
+
+  slot->state = SLOT_WRITING;
+  slot->io_done = 0;
+  io_submit(&batch->io, index, true);
+  return true;
+}
+
+bool run_batch_rotation(const char *input, const char *output_dir,
+                        uint32_t nthreads, uint32_t max_inflight,
+                        void (*rotate_fn)(uint8_t*, const bits_t)) {
+  // Sanity check the input
+  assert(input);
+  assert(output_dir);
+  assert(rotate_fn);
+  assert(nthreads > 0);
+  assert(max_inflight > 0);
+
+  char **fnames;
+  uint32_t nfiles = collect_inputs(input, &fnames);
+  if (nfiles == 0) {
+    printf("Error: No BMP files found in %s\n", input);
+    free(fnames);
+    return false;
+  }
+
+  // Every output goes straight into `output_dir`, so inputs from different
+  // directories must not share a name
+  if (!check_output_names(fnames, nfiles)) {
+    free_inputs(fnames, nfiles);
+    return false;
+  }
+
+  if (mkdir(output_dir, 0755) != 0 && errno != EEXIST) {
+    perror("Error creating output directory");
+    free_inputs(fnames, nfiles);
+    return false;
+  }
+
+  struct batch_s batch;
+  batch.rotate_fn = rotate_fn;
+  batch.slots = calloc(max_inflight, sizeof(struct batch_slot_s));
+  assert(batch.slots);
+  event_queue_init(&batch.to_rotate, max_inflight + nthreads);
+  io_backend_init(&batch.io, batch.slots, max_inflight);
+
+  pthread_t *workers = malloc(nthreads * sizeof(pthread_t));
+  assert(workers);
+  uint32_t i;
+  for (i = 0; i < nthreads; i++) {
+    pthread_create(&workers[i], NULL, rotate_worker_main, &batch);
+  }
+
+  printf("Rotating %u files with %u threads, %u images in flight (%s)\n",
+         nfiles, nthreads, max_inflight,
+         batch.io.use_uring ? "io_uring" : "I/O thread pool");
+
+  uint32_t next_file = 0, finished = 0, failures = 0, inflight = 0;
+  uint64_t bytes = 0;
+  double start = now_sec();
+
+  while (finished < nfiles) {
+    // Keep the pipeline full
+    for (i = 0; i < max_inflight && inflight < max_inflight && next_file < nfiles; i++) {
+      if (batch.slots[i].state != SLOT_FREE) {
+        continue;
+      }
+      if (start_read(&batch, i, fnames[next_file++])) {
+        inflight++;
+      } else {
+        failures++;
+        finished++;
+      }
+    }
+    if (inflight == 0) {
+      continue;
+    }
+
+    struct io_event_s event;
+    io_wait_event(&batch.io, &event);
+    struct batch_slot_s *slot = &batch.slots[event.slot];
+    bool slot_done = false;
+
+    switch (event.kind) {
+    case EVENT_READ_DONE:
+    case EVENT_WRITE_DONE:
+      if (event.res <= 0) {
+        fprintf(stderr, "Error %s %s: %s\n",
+                event.kind == EVENT_READ_DONE ? "reading" : "writing",
+                slot->input_fname, event.res ? strerror(-event.res) : "end of file");
+        close(slot->fd);
+        failures++;
+        slot_done = true;
+        break;
+      }
+      slot->io_done += event.res;
+      if (slot->io_done < slot->file_size) {
+        // Short read or write, continue with the rest
+        io_submit(&batch.io, event.slot, event.kind == EVENT_WRITE_DONE);
+        break;
+      }
+      close(slot->fd);
+      if (event.kind == EVENT_READ_DONE) {
+        slot->state = SLOT_ROTATING;
+        event_queue_push(&batch.to_rotate, (struct io_event_s){.slot = event.slot});
+      } else {
+        bytes += slot->img_size;
+        slot_done = true;
+      }
+      break;
+
+    case EVENT_ROTATED:
+      if (slot->failed || !start_write(&batch, event.slot, output_dir)) {
+        failures++;
+        slot_done = true;
+      }
+      break;
+    }
+
+    if (slot_done) {
+      slot->state = SLOT_FREE;
+      inflight--;
+      finished++;
+    }
+  }
+
+  double elapsed = now_sec() - start;
+
+  // Clean up after ourselves!
+  for (i = 0; i < nthreads; i++) {
+    event_queue_push(&batch.to_rotate, (struct io_event_s){.slot = UINT32_MAX});
+  }
+  for (i = 0; i < nthreads; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  io_backend_destroy(&batch.io);
+  event_queue_destroy(&batch.to_rotate);
+  for (i = 0; i < max_inflight; i++) {
+    free(batch.slots[i].file);
+    free(batch.slots[i].img);
+  }
+  free(batch.slots);
+  free(workers);
+  free_inputs(fnames, nfiles);
+
+  printf("Rotated %u of %u files (%.1f MB) in %.3f seconds: %.1f files/s, %.1f MB/s\n",
+         nfiles - failures, nfiles, bytes / 1e6, elapsed,
+         (nfiles - failures) / elapsed, bytes / 1e6 / elapsed);
+
+  return failures == 0;
+}
@@ -0,0 +1,45 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "./utils.h"
+
+// Rotates every BMP named by `input` and writes each result under
+// `output_dir` with the same base name. `input` is either a directory (all
+// of its *.bmp files are rotated) or a text file listing one path per line.
+// A list naming two files with the same base name is rejected before
+// anything is written.
+//
+// Reads and writes are issued asynchronously through io_uring (or through
+// a pool of I/O threads if io_uring is not available) and overlap with the
+// rotations running on `nthreads` worker threads. At most `max_inflight`
+// images are held in memory at any time.
+//
+// Returns `true` if every image was rotated and written
+bool run_batch_rotation(const char *input, const char *output_dir,
+                        uint32_t nthreads, uint32_t max_inflight,
+                        void (*rotate_fn)(uint8_t*, const bits_t));
+
+#endif  // BATCH_H
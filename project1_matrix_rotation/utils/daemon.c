@@ -0,0 +1,523 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "./utils.h"
+#include "./libbmp.h"
+#include "./daemon.h"
+
+// Maximum number of accepted connections waiting for a worker
+#define DAEMON_QUEUE_SIZE 256
+
+// Number of recent request latencies kept for the STATS percentiles
+#define DAEMON_LATENCY_SAMPLES 4096
+
+// Longest request or reply line
+#define DAEMON_LINE_SIZE 4096
+
+struct daemon_stats_s {
+  pthread_mutex_t lock;
+  uint64_t requests;
+  uint64_t errors;
+  uint64_t bytes;
+  uint64_t total_usec;
+  uint64_t max_usec;
+  uint64_t latencies[DAEMON_LATENCY_SAMPLES];
+};
+
+struct daemon_s {
+  int listen_fd;
+  bool shutting_down;
+  bytes_t prefault_bytes;
+  void (*rotate_fn)(uint8_t*, const bits_t);
+
+  // Accepted connections that no worker has picked up yet
+  pthread_mutex_t queue_lock;
+  pthread_cond_t queue_nonempty;
+  pthread_cond_t queue_nonfull;
+  int queue[DAEMON_QUEUE_SIZE];
+  uint32_t queue_head;
+  uint32_t queue_len;
+
+  uint64_t start_usec;
+  struct daemon_stats_s stats;
+};
+
+// A warm worker thread. `buffer` is pre-faulted once and then reused for
+// every image this worker rotates
+struct daemon_worker_s {
+  struct daemon_s *daemon;
+  pthread_t thread;
+  uint8_t *buffer;
+  size_t capacity;
+};
+
+static uint64_t now_usec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+// Records a finished request of `bytes` bytes that took `usec` microseconds
+static void record_request(struct daemon_stats_s *stats, bool ok,
+                           uint64_t bytes, uint64_t usec) {
+  pthread_mutex_lock(&stats->lock);
+  if (ok) {
+    stats->latencies[stats->requests % DAEMON_LATENCY_SAMPLES] = usec;
+    stats->requests++;
+    stats->bytes += bytes;
+    stats->total_usec += usec;
+    if (usec > stats->max_usec) {
+      stats->max_usec = usec;
+    }
+  } else {
+    stats->errors++;
+  }
+  pthread_mutex_unlock(&stats->lock);
+}
+
+// Formats the throughput and latency counters into `reply`
+static void format_stats(struct daemon_s *daemon, char *reply, size_t reply_size) {
+  struct daemon_stats_s *stats = &daemon->stats;
+  static __thread uint64_t sorted[DAEMON_LATENCY_SAMPLES];
+
+  pthread_mutex_lock(&stats->lock);
+  uint64_t requests = stats->requests;
+  uint64_t nsamples = requests < DAEMON_LATENCY_SAMPLES ? requests : DAEMON_LATENCY_SAMPLES;
+  memcpy(sorted, stats->latencies, nsamples * sizeof(uint64_t));
+  uint64_t errors = stats->errors;
+  uint64_t bytes = stats->bytes;
+  uint64_t total_usec = stats->total_usec;
+  uint64_t max_usec = stats->max_usec;
+  pthread_mutex_unlock(&stats->lock);
+
+  qsort(sorted, nsamples, sizeof(uint64_t), compare_u64);
+
+  double uptime_sec = (now_usec() - daemon->start_usec) / 1e6;
+  uint64_t p50 = nsamples ? sorted[(nsamples - 1) * 50 / 100] : 0;
+  uint64_t p99 = nsamples ? sorted[(nsamples - 1) * 99 / 100] : 0;
+
+  snprintf(reply, reply_size,
+           "OK requests=%" PRIu64 " errors=%" PRIu64 " uptime_s=%.3f"
+           " req_per_s=%.2f mb_per_s=%.2f mean_us=%" PRIu64
+           " p50_us=%" PRIu64 " p99_us=%" PRIu64 " max_us=%" PRIu64,
+           requests, errors, uptime_sec,
+           requests / uptime_sec, bytes / 1e6 / uptime_sec,
+           requests ? total_usec / requests : 0, p50, p99, max_usec);
+}
+
+// Handles "ROTATE <input.bmp> <output.bmp>"
+static bool handle_rotate_file(struct daemon_worker_s *worker, const char *input,
+                               const char *output, char *reply, size_t reply_size) {
+  struct daemon_s *daemon = worker->daemon;
+  uint64_t start = now_usec();
+
+  struct color_table_s color_tables[2];
+  int width, height, row_size;
+  uint8_t *img = read_binary_bmp_into(input, &worker->buffer, &worker->capacity,
+                                      &width, &height, &row_size, color_tables);
+  if (!img) {
+    snprintf(reply, reply_size, "ERR cannot read %s", input);
+    return false;
+  }
+
+  // Same restrictions as the file tester, reported instead of asserted
+  if (width != height || width < 64 || width % 64 != 0 || width != 8 * row_size) {
+    snprintf(reply, reply_size,
+             "ERR %s is %dx%d, expected a square multiple of 64", input, width, height);
+    return false;
+  }
+
+  daemon->rotate_fn(img, width);
+  if (!write_binary_bmp(output, img, color_tables, width)) {
+    snprintf(reply, reply_size, "ERR cannot write %s: %s", output, strerror(errno));
+    return false;
+  }
+
+  uint64_t usec = now_usec() - start;
+  record_request(&daemon->stats, true, (uint64_t)height * row_size, usec);
+  snprintf(reply, reply_size, "OK %s %" PRIu64, output, usec);
+  return true;
+}
+
+// Handles "ROTATE_SHM <shm-name> <N>"
+static bool handle_rotate_shm(struct daemon_worker_s *worker, const char *name,
+                              const bits_t N, char *reply, size_t reply_size) {
+  struct daemon_s *daemon = worker->daemon;
+  uint64_t start = now_usec();
+
+  if (N < 64 || N % 64 != 0) {
+    snprintf(reply, reply_size, "ERR dimension %zu is not a multiple of 64", N);
+    return false;
+  }
+  const bytes_t size = N * bits_to_bytes(N);
+
+  int fd = shm_open(name, O_RDWR, 0);
+  if (fd < 0) {
+    snprintf(reply, reply_size, "ERR cannot open %s: %s", name, strerror(errno));
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (bytes_t)st.st_size < size) {
+    snprintf(reply, reply_size, "ERR %s is smaller than %zux%zu bits", name, N, N);
+    close(fd);
+    return false;
+  }
+
+  uint8_t *img = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (img == MAP_FAILED) {
+    snprintf(reply, reply_size, "ERR cannot map %s: %s", name, strerror(errno));
+    return false;
+  }
+
+  daemon->rotate_fn(img, N);
+  munmap(img, size);
+
+  uint64_t usec = now_usec() - start;
+  record_request(&daemon->stats, true, size, usec);
+  snprintf(reply, reply_size, "OK %s %" PRIu64, name, usec);
+  return true;
+}
+
+// Parses and executes one request line, writing the reply into `reply`.
+//
+// Returns `false` if the connection should be closed afterwards
+static bool handle_request(struct daemon_worker_s *worker, char *line,
+                           char *reply, size_t reply_size) {
+  struct daemon_s *daemon = worker->daemon;
+  char command[32];
+  char arg1[DAEMON_LINE_SIZE];
+  char arg2[DAEMON_LINE_SIZE];
+
+  int nargs = sscanf(line, "%31s %4095s %4095s", command, arg1, arg2);
+
+  if (nargs == 3 && !strcmp(command, "ROTATE")) {
+    if (!handle_rotate_file(worker, arg1, arg2, reply, reply_size)) {
+      record_request(&daemon->stats, false, 0, 0);
+    }
+  } else if (nargs == 3 && !strcmp(command, "ROTATE_SHM")) {
+    if (!handle_rotate_shm(worker, arg1, (bits_t)strtoull(arg2, NULL, 10),
+                           reply, reply_size)) {
+      record_request(&daemon->stats, false, 0, 0);
+    }
+  } else if (nargs == 1 && !strcmp(command, "STATS")) {
+    format_stats(daemon, reply, reply_size);
+  } else if (nargs == 1 && !strcmp(command, "SHUTDOWN")) {
+    __atomic_store_n(&daemon->shutting_down, true, __ATOMIC_SEQ_CST);
+    // Wakes up the `accept` in the main thread
+    shutdown(daemon->listen_fd, SHUT_RDWR);
+    snprintf(reply, reply_size, "OK shutting down");
+    return false;
+  } else {
+    snprintf(reply, reply_size, "ERR malformed request");
+  }
+  return true;
+}
+
+// Serves requests on `fd` until the client hangs up
+static void handle_connection(struct daemon_worker_s *worker, int fd) {
+  FILE *in = fdopen(fd, "r");
+  FILE *out = fdopen(dup(fd), "w");
+  if (!in || !out) {
+    perror("Error opening client connection");
+    if (in) {
+      fclose(in);
+    } else {
+      close(fd);
+    }
+    if (out) {
+      fclose(out);
+    }
+    return;
+  }
+
+  char line[DAEMON_LINE_SIZE];
+  char reply[DAEMON_LINE_SIZE];
+  while (fgets(line, sizeof(line), in)) {
+    bool keep_open = handle_request(worker, line, reply, sizeof(reply));
+    fprintf(out, "%s\n", reply);
+    fflush(out);
+    if (!keep_open) {
+      break;
+    }
+  }
+
+  fclose(in);
+  fclose(out);
+}
+
+static void *worker_main(void *arg) {
+  struct daemon_worker_s *worker = arg;
+  struct daemon_s *daemon = worker->daemon;
+
+  // Pre-fault the buffer from this thread so its pages are ready (and
+  // local) before the first request arrives
+  worker->capacity = daemon->prefault_bytes;
+  worker->buffer = malloc(worker->capacity);
+  if (!worker->buffer) {
+    worker->capacity = 0;
+  } else {
+    memset(worker->buffer, 0, worker->capacity);
+  }
+
+  while (true) {
+    pthread_mutex_lock(&daemon->queue_lock);
+    while (daemon->queue_len == 0 && !daemon->shutting_down) {
+      pthread_cond_wait(&daemon->queue_nonempty, &daemon->queue_lock);
+    }
+    if (daemon->queue_len == 0) {
+      pthread_mutex_unlock(&daemon->queue_lock);
+      break;
+    }
+    int fd = daemon->queue[daemon->queue_head];
+    daemon->queue_head = (daemon->queue_head + 1) % DAEMON_QUEUE_SIZE;
+    daemon->queue_len--;
+    pthread_cond_signal(&daemon->queue_nonfull);
+    pthread_mutex_unlock(&daemon->queue_lock);
+
+    handle_connection(worker, fd);
+  }
+
+  return NULL;
+}
+
+// Runs the daemon until a client sends SHUTDOWN. Connections that are still
+// open at that point are served until their clients hang up
+bool run_rotation_daemon(const char *socket_path, uint32_t nworkers,
+                         bytes_t prefault_bytes,
+                         void (*rotate_fn)(uint8_t*, const bits_t)) {
+  // Sanity check the input
+  assert(socket_path);
+  assert(rotate_fn);
+  assert(nworkers > 0);
+
+  // A client hanging up mid-reply must not kill the daemon
+  signal(SIGPIPE, SIG_IGN);
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    printf("Error: Socket path %s is too long\n", socket_path);
+    return false;
+  }
+  strcpy(addr.sun_path, socket_path);
+
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd < 0) {
+    perror("Error creating daemon socket");
+    return false;
+  }
+
+  // Replace a stale socket left behind by a previous daemon
+  unlink(socket_path);
+  if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0
+      || listen(listen_fd, DAEMON_QUEUE_SIZE) != 0) {
+    perror("Error binding daemon socket");
+    close(listen_fd);
+    return false;
+  }
+
+  struct daemon_s *daemon = calloc(1, sizeof(struct daemon_s));
+  struct daemon_worker_s *workers = calloc(nworkers, sizeof(struct daemon_worker_s));
+  assert(daemon && workers);
+
+  daemon->listen_fd = listen_fd;
+  daemon->prefault_bytes = prefault_bytes;
+  daemon->rotate_fn = rotate_fn;
+  daemon->start_usec = now_usec();
+  pthread_mutex_init(&daemon->queue_lock, NULL);
+  pthread_cond_init(&daemon->queue_nonempty, NULL);
+  pthread_cond_init(&daemon->queue_nonfull, NULL);
+  pthread_mutex_init(&daemon->stats.lock, NULL);
+
+  uint32_t i;
+  for (i = 0; i < nworkers; i++) {
+    workers[i].daemon = daemon;
+    pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+  }
+
+  printf("Rotation daemon listening on %s with %u workers\n", socket_path, nworkers);
+  fflush(stdout);
+
+  while (true) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+      if (__atomic_load_n(&daemon->shutting_down, __ATOMIC_SEQ_CST)) {
+        break;
+      }
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      perror("Error accepting connection");
+      break;
+    }
+
+    pthread_mutex_lock(&daemon->queue_lock);
+    while (daemon->queue_len == DAEMON_QUEUE_SIZE) {
+      pthread_cond_wait(&daemon->queue_nonfull, &daemon->queue_lock);
+    }
+    daemon->queue[(daemon->queue_head + daemon->queue_len) % DAEMON_QUEUE_SIZE] = fd;
+    daemon->queue_len++;
+    pthread_cond_signal(&daemon->queue_nonempty);
+    pthread_mutex_unlock(&daemon->queue_lock);
+  }
+
+  // Let the workers drain the queue and exit
+  pthread_mutex_lock(&daemon->queue_lock);
+  bool requested = daemon->shutting_down;
+  daemon->shutting_down = true;
+  pthread_cond_broadcast(&daemon->queue_nonempty);
+  pthread_mutex_unlock(&daemon->queue_lock);
+
+  for (i = 0; i < nworkers; i++) {
+    pthread_join(workers[i].thread, NULL);
+    free(workers[i].buffer);
+  }
+
+  char summary[DAEMON_LINE_SIZE];
+  format_stats(daemon, summary, sizeof(summary));
+  printf("Rotation daemon stopped: %s\n", summary + strlen("OK "));
+
+  close(listen_fd);
+  unlink(socket_path);
+  free(workers);
+  free(daemon);
+
+  return requested;
+}
+
+bool daemon_request(const char *socket_path, const char *request,
+                    char *reply, size_t reply_size) {
+  // Sanity check the input
+  assert(socket_path);
+  assert(request);
+  assert(reply && reply_size > 0);
+
+  reply[0] = '\0';
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    snprintf(reply, reply_size, "ERR socket path too long");
+    return false;
+  }
+  strcpy(addr.sun_path, socket_path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    snprintf(reply, reply_size, "ERR cannot connect to %s: %s",
+             socket_path, strerror(errno));
+    if (fd >= 0) {
+      close(fd);
+    }
+    return false;
+  }
+
+  FILE *conn = fdopen(fd, "r+");
+  assert(conn);
+  fprintf(conn, "%s\n", request);
+  fflush(conn);
+
+  if (!fgets(reply, reply_size, conn)) {
+    snprintf(reply, reply_size, "ERR no reply from daemon");
+  }
+  fclose(conn);
+
+  // Strip the trailing newline
+  reply[strcspn(reply, "\n")] = '\0';
+
+  return !strncmp(reply, "OK", 2);
+}
+
+bool run_daemon_shm_tester(const char *socket_path, const bits_t N,
+                           void (*rotate_fn)(uint8_t*, const bits_t)) {
+  // Sanity check the input
+  assert(socket_path);
+  assert(rotate_fn);
+  assert(N > 0 && !(N % 64));
+
+  const bytes_t size = N * bits_to_bytes(N);
+
+  char name[64];
+  snprintf(name, sizeof(name), "/rotate-shm-%d", (int)getpid());
+
+  int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) {
+    perror("Error creating shared memory");
+    return false;
+  }
+  if (ftruncate(fd, size) != 0) {
+    perror("Error sizing shared memory");
+    close(fd);
+    shm_unlink(name);
+    return false;
+  }
+  uint8_t *shared = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (shared == MAP_FAILED) {
+    perror("Error mapping shared memory");
+    shm_unlink(name);
+    return false;
+  }
+
+  // Fill the shared matrix, and rotate a private copy locally for reference
+  uint8_t *expected = generate_bit_matrix(N, false);
+  assert(expected);
+  memcpy(shared, expected, size);
+  rotate_fn(expected, N);
+
+  char request[128];
+  char reply[DAEMON_LINE_SIZE];
+  snprintf(request, sizeof(request), "ROTATE_SHM %s %zu", name, N);
+  bool result = daemon_request(socket_path, request, reply, sizeof(reply));
+  printf("Daemon reply: %s\n", reply);
+
+  result = result && memcmp(shared, expected, size) == 0;
+
+  // Clean up after ourselves!
+  munmap(shared, size);
+  shm_unlink(name);
+  free(expected);
+
+  return result;
+}
@@ -0,0 +1,63 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "./utils.h"
+
+// The rotation daemon speaks a line-based protocol over a Unix domain
+// socket. A client may send any number of requests on one connection:
+//
+//   ROTATE <input.bmp> <output.bmp>  Rotate a BMP file, reply with the output
+//   ROTATE_SHM <shm-name> <N>        Rotate an N by N bit matrix in place in
+//                                    the POSIX shared memory object `shm-name`
+//   STATS                            Reply with throughput/latency counters
+//   SHUTDOWN                         Stop the daemon
+//
+// Every reply is a single line starting with "OK" or "ERR".
+
+// Runs the rotation daemon on `socket_path` with `nworkers` warm worker
+// threads. Every worker keeps a pre-faulted image buffer of at least
+// `prefault_bytes` bytes that is reused across requests.
+//
+// Returns `true` if the daemon was shut down by a client
+bool run_rotation_daemon(const char *socket_path, uint32_t nworkers,
+                         bytes_t prefault_bytes,
+                         void (*rotate_fn)(uint8_t*, const bits_t));
+
+// Sends the request line `request` to the daemon on `socket_path` and copies
+// the reply line (without the trailing newline) into `reply`.
+//
+// Returns `true` if the daemon replied with "OK"
+bool daemon_request(const char *socket_path, const char *request,
+                    char *reply, size_t reply_size);
+
+// Asks the daemon on `socket_path` to rotate a generated `N` by `N` bit
+// matrix through shared memory and checks the result against `rotate_fn`.
+//
+// Returns `true` if the daemon's rotation matches
+bool run_daemon_shm_tester(const char *socket_path, const bits_t N,
+                           void (*rotate_fn)(uint8_t*, const bits_t));
+
+#endif  // DAEMON_H
@@ -24,8 +24,15 @@
 #include <string.h>
 #include <malloc.h>
 #include <assert.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "./libbmp.h"
+#include "./parallel.h"
+#include "./trace.h"
 
 // Read the BMP headers and color tables
 static bool read_headers(FILE *f, struct header_s *header,
@@ -37,18 +44,19 @@ static bool read_headers(FILE *f, struct header_s *header,
   }
 
   // The signature "BM" for bitmap files
-  assert(header->signature == 0x4D42);
+  if (header->signature != 0x4D42) {
+    goto bad;
+  }
 
   // Read the BMP info header
   if (!fread(info_header, 1, sizeof(*info_header), f)) {
     goto bad;
   }
 
-  // Make sure this is a binary BMP image
-  assert(info_header->bits_per_pixel == 1);
-
-  // Make sure that this image is not compressed
-  assert(info_header->compression == 0);
+  // Make sure this is a binary BMP image that is not compressed
+  if (info_header->bits_per_pixel != 1 || info_header->compression != 0) {
+    goto bad;
+  }
 
   // Seek to the 2 color tables
   fseek(f, sizeof(*header) + info_header->size, SEEK_SET);
@@ -65,17 +73,26 @@ static bool read_headers(FILE *f, struct header_s *header,
     return false;
 }
 
-// Reads the binary image from `fname` and saves the bit width and height
-// in `_w` and `_h` respectively. Additionally saves the size of a single
-// row in the image in bytes in `_row_size` and the 2 color tables used
-// in the BMP file in `color_tables`
-uint8_t *read_binary_bmp(const char *fname, int *_w, int *_h, int *_row_size,
-                         struct color_table_s color_tables[2]) {
+// Reads the binary image from `fname` into `*buffer`, which holds
+// `*capacity` bytes. If the image does not fit, `*buffer` is grown with
+// `realloc` and `*capacity` is updated, so a caller that reads many images
+// can keep reusing (and keep warm) the same allocation. Saves the bit width
+// and height in `_w` and `_h` respectively, the size of a single row in
+// bytes in `_row_size` and the 2 color tables in `color_tables`.
+//
+// Returns `*buffer`, or NULL if there was an error
+uint8_t *read_binary_bmp_into(const char *fname, uint8_t **buffer,
+                              size_t *capacity, int *_w, int *_h,
+                              int *_row_size,
+                              struct color_table_s color_tables[2]) {
   // Sanity checks as per the BMP standard
   static_assert(sizeof(struct header_s) == 14, "Incorrect size of BMP file header struct");
   static_assert(sizeof(struct info_header_s) == 40, "Incorrect size of BMP info header struct");
   static_assert(sizeof(struct color_table_s) == 4, "Incorrect size of color table struct");
 
+  assert(buffer);
+  assert(capacity);
+
   // Read `fname`
   FILE *f = fopen(fname, "rb");
 
@@ -91,53 +108,66 @@ uint8_t *read_binary_bmp(const char *fname, int *_w, int *_h, int *_row_size,
 
   if (!read_headers(f, &header, &info_header, color_tables)) {
     // There was some sort of error
-    perror("Error reading BMP headers");
+    fprintf(stderr, "Error reading BMP headers: %s is not an uncompressed binary BMP\n",
+            fname);
+    fclose(f);
     return NULL;
   }
 
   // If the height is negative, then the origin is the top-left of the image.
   // Otherwise the origin is the bottom-left
-  int scan_dir = -1;
-  uint32_t inverted = 1;
-  if (info_header.height < 0) {
-    scan_dir = 1;
-    inverted = 0;
-    info_header.height = -1 * info_header.height;
+  bool inverted = true;
+  int32_t height = (int32_t)info_header.height;
+  if (height < 0) {
+    inverted = false;
+    height = -height;
   }
+  info_header.height = height;
 
   // Rows are aligned on 4-byte boundary
   int row_size = ((info_header.bits_per_pixel * info_header.width + 31) / 32) * 4;
-  uint32_t image_size = row_size * info_header.height;
-
-  uint8_t *ret_img = malloc(info_header.height * row_size);
-  uint8_t *image_data = malloc(image_size);
-
-  if (!ret_img || !image_data) {
-    printf("Error: Image size is too large to fit in heap space!\n");
-    assert(false);
+  size_t image_size = (size_t)row_size * info_header.height;
+
+  // Grow the caller's buffer if this image does not fit
+  if (*capacity < image_size) {
+    uint8_t *grown = realloc(*buffer, image_size);
+    if (!grown) {
+      printf("Error: Image size is too large to fit in heap space!\n");
+      fclose(f);
+      return NULL;
+    }
+    *buffer = grown;
+    *capacity = image_size;
   }
+  uint8_t *ret_img = *buffer;
 
   // Offset to and read the image data
   fseek(f, header.data_offset, SEEK_SET);
-  if (!fread(image_data, 1, image_size, f)) {
+  if (fread(ret_img, 1, image_size, f) != image_size) {
     // There was some sort of error
-    assert(false);
+    fprintf(stderr, "Error reading BMP image data from %s\n", fname);
+    fclose(f);
+    return NULL;
   }
 
-  uint8_t *image_offset = image_data + inverted * ((info_header.height - 1) * row_size);
-  uint8_t *ret_img_offset = ret_img;
-  uint32_t h;
-  for (h = 0; h < info_header.height; h++) {
-    memcpy(ret_img_offset, image_offset, row_size);
+  fclose(f);
 
-    image_offset += scan_dir * row_size;
-    ret_img_offset += row_size;
+  // A bottom-up image gets its rows reversed in place so the origin
+  // becomes the top-left
+  if (inverted) {
+    uint32_t h;
+    for (h = 0; h < info_header.height / 2; h++) {
+      uint8_t *top = ret_img + (size_t)h * row_size;
+      uint8_t *bottom = ret_img + (size_t)(info_header.height - 1 - h) * row_size;
+      int k;
+      for (k = 0; k < row_size; k++) {
+        uint8_t tmp = top[k];
+        top[k] = bottom[k];
+        bottom[k] = tmp;
+      }
+    }
   }
 
-  free(image_data);
-
-  fclose(f);
-
   // Set the return dimension values
   *_w = info_header.width;
   *_h = info_header.height;
@@ -146,6 +176,24 @@ uint8_t *read_binary_bmp(const char *fname, int *_w, int *_h, int *_row_size,
   return ret_img;
 }
 
+// Reads the binary image from `fname` and saves the bit width and height
+// in `_w` and `_h` respectively. Additionally saves the size of a single
+// row in the image in bytes in `_row_size` and the 2 color tables used
+// in the BMP file in `color_tables`
+uint8_t *read_binary_bmp(const char *fname, int *_w, int *_h, int *_row_size,
+                         struct color_table_s color_tables[2]) {
+  uint8_t *ret_img = NULL;
+  size_t capacity = 0;
+
+  if (!read_binary_bmp_into(fname, &ret_img, &capacity, _w, _h, _row_size,
+                            color_tables)) {
+    free(ret_img);
+    return NULL;
+  }
+
+  return ret_img;
+}
+
 static void init_header(struct header_s *header,
        const uint32_t file_size, const uint32_t data_offset) {
   // The signature "BM" for bitmap files
@@ -190,11 +238,123 @@ static void init_info_header(struct info_header_s *info_header, const uint32_t N
   return;
 }
 
+// Decodes the binary BMP held in memory at `file` (`file_size` bytes) into
+// `*img`, growing it like `read_binary_bmp_into` does. Rows are copied so
+// that the origin of `*img` is the top-left.
+//
+// Returns `false` if `file` is not an uncompressed binary BMP
+bool decode_binary_bmp(const uint8_t *file, size_t file_size,
+                       uint8_t **img, size_t *capacity,
+                       int *_w, int *_h, int *_row_size,
+                       struct color_table_s color_tables[2]) {
+  struct header_s header;
+  struct info_header_s info_header;
+
+  if (file_size < sizeof(header) + sizeof(info_header)) {
+    return false;
+  }
+  memcpy(&header, file, sizeof(header));
+  memcpy(&info_header, file + sizeof(header), sizeof(info_header));
+
+  if (header.signature != 0x4D42 || info_header.bits_per_pixel != 1
+      || info_header.compression != 0) {
+    return false;
+  }
+
+  // The 2 color tables follow the info header
+  size_t color_offset = sizeof(header) + info_header.size;
+  if (color_offset + 2 * sizeof(struct color_table_s) > file_size) {
+    return false;
+  }
+  memcpy(color_tables, file + color_offset, 2 * sizeof(struct color_table_s));
+
+  // If the height is negative, then the origin is the top-left of the image.
+  // Otherwise the origin is the bottom-left
+  bool inverted = true;
+  int32_t height = (int32_t)info_header.height;
+  if (height < 0) {
+    inverted = false;
+    height = -height;
+  }
+
+  // Rows are aligned on 4-byte boundary
+  int row_size = ((info_header.width + 31) / 32) * 4;
+  size_t image_size = (size_t)row_size * height;
+  if (header.data_offset + image_size > file_size) {
+    return false;
+  }
+
+  if (*capacity < image_size) {
+    uint8_t *grown = realloc(*img, image_size);
+    if (!grown) {
+      return false;
+    }
+    *img = grown;
+    *capacity = image_size;
+  }
+
+  const uint8_t *data = file + header.data_offset;
+  int32_t h;
+  for (h = 0; h < height; h++) {
+    int32_t src_row = inverted ? height - 1 - h : h;
+    memcpy(*img + (size_t)h * row_size, data + (size_t)src_row * row_size, row_size);
+  }
+
+  *_w = info_header.width;
+  *_h = height;
+  *_row_size = row_size;
+  return true;
+}
+
+// Returns the size in bytes of the file `encode_binary_bmp` produces for an
+// image of `N` by `N` bits
+size_t binary_bmp_file_size(const uint32_t N) {
+  const size_t padded_row_size = ((N + 31) / 32) * 4;
+  return sizeof(struct header_s) + sizeof(struct info_header_s)
+      + 2 * sizeof(struct color_table_s) + padded_row_size * N;
+}
+
+// Encodes `image_data` of `N` by `N` bits as a complete binary BMP file into
+// `file`, which must hold `binary_bmp_file_size(N)` bytes. The layout matches
+// what `write_binary_bmp` writes.
+void encode_binary_bmp(uint8_t *file, const uint8_t *image_data,
+                       struct color_table_s color_tables[2],
+                       const uint32_t N) {
+  // For now, writes will only support 1-byte aligned images
+  assert(N > 0);
+  assert(!(N % 8));
+
+  struct header_s header;
+  struct info_header_s info_header;
+  const uint32_t data_offset = sizeof(header) + sizeof(info_header) + 2 * sizeof(color_tables[0]);
+
+  init_info_header(&info_header, N);
+  init_header(&header, binary_bmp_file_size(N), data_offset);
+
+  memcpy(file, &header, sizeof(header));
+  memcpy(file + sizeof(header), &info_header, sizeof(info_header));
+  memcpy(file + sizeof(header) + sizeof(info_header), color_tables,
+         2 * sizeof(color_tables[0]));
+
+  // Rows are stored bottom to top, each padded to a 4-byte alignment
+  const uint32_t row_size = N / 8;
+  const uint32_t padded_row_size = ((N + 31) / 32) * 4;
+  uint8_t *out = file + data_offset;
+  uint32_t i;
+  for (i = 0; i < N; i++) {
+    memcpy(out, image_data + (size_t)(N - 1 - i) * row_size, row_size);
+    memset(out + row_size, 0, padded_row_size - row_size);
+    out += padded_row_size;
+  }
+}
+
 // Write the binary `image_data` encoding an image `N` by `N` bits to `output_fname`.
 //
 // The output image will use the 2 color tables supplied. Bits set to 0 will use the
 // color in the 0th color table and likewise bits set to 1 will use the 1st color table
-void write_binary_bmp(const char *output_fname, uint8_t *image_data,
+//
+// Returns false on errors, with `errno` set by the call that failed
+bool write_binary_bmp(const char *output_fname, uint8_t *image_data,
                       struct color_table_s color_tables[2],
                       const uint32_t N) {
   // Sanity checks as per the BMP standard
@@ -214,8 +374,10 @@ void write_binary_bmp(const char *output_fname, uint8_t *image_data,
 
   // There was some sort of error
   if (!f) {
+    int error = errno;
     perror("Error writing BMP file");
-    return;
+    errno = error;
+    return false;
   }
 
   // First set the `info_header` accordingly
@@ -234,7 +396,7 @@ void write_binary_bmp(const char *output_fname, uint8_t *image_data,
   uint8_t *image_data_offset = image_data + (N - 1) * row_size;
 
   // Have an array of 0's to pad each row to a 4-byte alignment as per the BMP file format
-  const uint32_t npad = row_size & 0b11;
+  const uint32_t npad = (4 - (row_size & 0b11)) & 0b11;
   uint8_t zeros[3] = {0};
 
   // The `image_data` gets traversed from bottom to top since our `height`
@@ -278,8 +440,265 @@ void write_binary_bmp(const char *output_fname, uint8_t *image_data,
   fwrite(&color_tables[0], 1, sizeof(color_tables[0]), f);
   fwrite(&color_tables[1], 1, sizeof(color_tables[1]), f);
 
-  // Close the file once finished!
+  // Close the file once finished! Buffered writes may only fail here
+  bool failed = ferror(f);
+  int error = errno;
+  if (fclose(f) != 0 && !failed) {
+    failed = true;
+    error = errno;
+  }
+  if (failed) {
+    perror("Error writing BMP file");
+    errno = error;
+    return false;
+  }
+  return true;
+}
+
+// Each thread of the parallel reader and writer moves its rows through a
+// bounce buffer of about this many bytes, so the row reversal and padding
+// happen while the rows are still in cache
+#define BMP_IO_CHUNK (1 << 20)
+
+// A range of file rows copied between a BMP file and an image in memory.
+// File row `r` is image row `height - 1 - r`
+struct bmp_io_s {
+  int fd;
+  uint8_t *img;
+  size_t data_offset;
+  size_t row_size;         // Bytes per row of `img`
+  size_t padded_row_size;  // Bytes per row in the file
+  uint32_t height;
+  // Set by any thread that fails; the others poll it to stop early
+  atomic_bool failed;
+};
+
+static inline bool bmp_io_failed(struct bmp_io_s *io) {
+  return atomic_load_explicit(&io->failed, memory_order_relaxed);
+}
+
+static inline void bmp_io_fail(struct bmp_io_s *io) {
+  atomic_store_explicit(&io->failed, true, memory_order_relaxed);
+}
+
+// Reads `nbytes` at `offset`, retrying short reads and `EINTR`. Returns
+// false on errors or if the file ends first
+static bool pread_full(int fd, uint8_t *buf, size_t nbytes, off_t offset) {
+  while (nbytes > 0) {
+    ssize_t n = pread(fd, buf, nbytes, offset);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    buf += n;
+    nbytes -= n;
+    offset += n;
+  }
+  return true;
+}
+
+// Writes `nbytes` at `offset`, retrying short writes and `EINTR`. Returns
+// false on errors
+static bool pwrite_full(int fd, const uint8_t *buf, size_t nbytes, off_t offset) {
+  while (nbytes > 0) {
+    ssize_t n = pwrite(fd, buf, nbytes, offset);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    buf += n;
+    nbytes -= n;
+    offset += n;
+  }
+  return true;
+}
+
+static void read_rows_worker(void *arg, uint32_t tid, uint32_t nthreads) {
+  struct bmp_io_s *io = arg;
+  const uint32_t first = (uint64_t)io->height * tid / nthreads;
+  const uint32_t last = (uint64_t)io->height * (tid + 1) / nthreads;
+  const uint32_t rows_per_chunk = BMP_IO_CHUNK / io->padded_row_size + 1;
+  uint64_t trace_start = trace_now();
+
+  uint8_t *bounce = malloc((size_t)rows_per_chunk * io->padded_row_size);
+  if (!bounce) {
+    bmp_io_fail(io);
+    return;
+  }
+
+  uint32_t r;
+  for (r = first; r < last && !bmp_io_failed(io); r += rows_per_chunk) {
+    const uint32_t nrows = last - r < rows_per_chunk ? last - r : rows_per_chunk;
+    const size_t nbytes = (size_t)nrows * io->padded_row_size;
+    const off_t offset = io->data_offset + (size_t)r * io->padded_row_size;
+    if (!pread_full(io->fd, bounce, nbytes, offset)) {
+      bmp_io_fail(io);
+      break;
+    }
+
+    uint32_t k;
+    for (k = 0; k < nrows; k++) {
+      memcpy(io->img + (size_t)(io->height - 1 - r - k) * io->row_size,
+             bounce + (size_t)k * io->padded_row_size, io->row_size);
+    }
+  }
+  free(bounce);
+  trace_span("read rows", trace_start);
+}
+
+// Reads `fname` like `read_binary_bmp`, with `nthreads` threads each
+// reading a contiguous range of rows with `pread`
+uint8_t *read_binary_bmp_parallel(const char *fname, int *_w, int *_h,
+                                  int *_row_size,
+                                  struct color_table_s color_tables[2],
+                                  uint32_t nthreads) {
+  // Read the headers through stdio, as the serial reader does
+  FILE *f = fopen(fname, "rb");
+  if (!f) {
+    perror("Error reading BMP file");
+    return NULL;
+  }
+
+  struct header_s header;
+  struct info_header_s info_header;
+  bool headers_ok = read_headers(f, &header, &info_header, color_tables);
   fclose(f);
+  if (!headers_ok) {
+    fprintf(stderr, "Error reading BMP headers: %s is not an uncompressed binary BMP\n",
+            fname);
+    return NULL;
+  }
 
-  return;
+  // Top-down images are rare; leave them to the serial reader
+  if ((int32_t)info_header.height < 0) {
+    return read_binary_bmp(fname, _w, _h, _row_size, color_tables);
+  }
+
+  // Rows are aligned on 4-byte boundary, and are kept that way in memory
+  const int row_size = ((info_header.bits_per_pixel * info_header.width + 31) / 32) * 4;
+  uint8_t *img = malloc((size_t)row_size * info_header.height);
+  if (!img) {
+    printf("Error: Image size is too large to fit in heap space!\n");
+    return NULL;
+  }
+
+  struct bmp_io_s io = {
+    .fd = open(fname, O_RDONLY),
+    .img = img,
+    .data_offset = header.data_offset,
+    .row_size = row_size,
+    .padded_row_size = row_size,
+    .height = info_header.height,
+    .failed = false,
+  };
+  if (io.fd < 0) {
+    perror("Error reading BMP file");
+    free(img);
+    return NULL;
+  }
+
+  run_parallel(nthreads, read_rows_worker, &io);
+  close(io.fd);
+
+  if (bmp_io_failed(&io)) {
+    fprintf(stderr, "Error reading BMP image data from %s\n", fname);
+    free(img);
+    return NULL;
+  }
+
+  *_w = info_header.width;
+  *_h = info_header.height;
+  *_row_size = row_size;
+
+  return img;
+}
+
+static void write_rows_worker(void *arg, uint32_t tid, uint32_t nthreads) {
+  struct bmp_io_s *io = arg;
+  const uint32_t first = (uint64_t)io->height * tid / nthreads;
+  const uint32_t last = (uint64_t)io->height * (tid + 1) / nthreads;
+  const uint32_t rows_per_chunk = BMP_IO_CHUNK / io->padded_row_size + 1;
+
+  uint64_t trace_start = trace_now();
+
+  // The padding bytes stay zero; only the rows are copied in
+  uint8_t *bounce = calloc(rows_per_chunk, io->padded_row_size);
+  if (!bounce) {
+    bmp_io_fail(io);
+    return;
+  }
+
+  uint32_t r;
+  for (r = first; r < last && !bmp_io_failed(io); r += rows_per_chunk) {
+    const uint32_t nrows = last - r < rows_per_chunk ? last - r : rows_per_chunk;
+
+    uint32_t k;
+    for (k = 0; k < nrows; k++) {
+      memcpy(bounce + (size_t)k * io->padded_row_size,
+             io->img + (size_t)(io->height - 1 - r - k) * io->row_size, io->row_size);
+    }
+
+    const size_t nbytes = (size_t)nrows * io->padded_row_size;
+    const off_t offset = io->data_offset + (size_t)r * io->padded_row_size;
+    if (!pwrite_full(io->fd, bounce, nbytes, offset)) {
+      bmp_io_fail(io);
+    }
+  }
+  free(bounce);
+  trace_span("write rows", trace_start);
+}
+
+// Writes the same file as `write_binary_bmp`, with `nthreads` threads each
+// writing a contiguous range of rows with `pwrite`. Returns false on errors
+bool write_binary_bmp_parallel(const char *output_fname, uint8_t *image_data,
+                               struct color_table_s color_tables[2],
+                               const uint32_t N, uint32_t nthreads) {
+  // For now, writes will only support 1-byte aligned images
+  assert(N > 0);
+  assert(!(N % 8));
+
+  struct header_s header;
+  struct info_header_s info_header;
+  const uint32_t data_offset = sizeof(header) + sizeof(info_header) + 2 * sizeof(color_tables[0]);
+  const size_t file_size = binary_bmp_file_size(N);
+
+  int fd = open(output_fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    perror("Error writing BMP file");
+    return false;
+  }
+
+  // The metadata goes in first; `pwrite` extends the file as the threads
+  // fill in their rows
+  uint8_t metadata[sizeof(header) + sizeof(info_header) + 2 * sizeof(struct color_table_s)];
+  init_info_header(&info_header, N);
+  init_header(&header, file_size, data_offset);
+  memcpy(metadata, &header, sizeof(header));
+  memcpy(metadata + sizeof(header), &info_header, sizeof(info_header));
+  memcpy(metadata + sizeof(header) + sizeof(info_header), color_tables,
+         2 * sizeof(color_tables[0]));
+
+  struct bmp_io_s io = {
+    .fd = fd,
+    .img = image_data,
+    .data_offset = data_offset,
+    .row_size = N / 8,
+    .padded_row_size = ((N + 31) / 32) * 4,
+    .height = N,
+    .failed = !pwrite_full(fd, metadata, sizeof(metadata), 0),
+  };
+
+  if (!bmp_io_failed(&io)) {
+    run_parallel(nthreads, write_rows_worker, &io);
+  }
+
+  if (close(fd) != 0 || bmp_io_failed(&io)) {
+    perror("Error writing BMP file");
+    return false;
+  }
+  return true;
 }
@@ -24,6 +24,8 @@
 #define LIBBMP_H
 
 #include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
 
 // BMP standard read from:
 //  http://www.ece.ualberta.ca/~elliott/ee552/studentAppNotes/2003_w/misc/bmp_file_format/bmp_file_format.htm
@@ -60,8 +62,33 @@ struct color_table_s {
 uint8_t *read_binary_bmp(const char *fname, int *_w, int *_h, int *_row_size,
                          struct color_table_s color_tables[2]);
 
-void write_binary_bmp(const char *output_fname, uint8_t *image_data,
+uint8_t *read_binary_bmp_into(const char *fname, uint8_t **buffer,
+                              size_t *capacity, int *_w, int *_h,
+                              int *_row_size,
+                              struct color_table_s color_tables[2]);
+
+bool write_binary_bmp(const char *output_fname, uint8_t *image_data,
                       struct color_table_s color_tables[2],
                       const uint32_t N);
 
+bool decode_binary_bmp(const uint8_t *file, size_t file_size,
+                       uint8_t **img, size_t *capacity,
+                       int *_w, int *_h, int *_row_size,
+                       struct color_table_s color_tables[2]);
+
+size_t binary_bmp_file_size(const uint32_t N);
+
+void encode_binary_bmp(uint8_t *file, const uint8_t *image_data,
+                       struct color_table_s color_tables[2],
+                       const uint32_t N);
+
+uint8_t *read_binary_bmp_parallel(const char *fname, int *_w, int *_h,
+                                  int *_row_size,
+                                  struct color_table_s color_tables[2],
+                                  uint32_t nthreads);
+
+bool write_binary_bmp_parallel(const char *output_fname, uint8_t *image_data,
+                               struct color_table_s color_tables[2],
+                               const uint32_t N, uint32_t nthreads);
+
 #endif  // LIBBMP_H
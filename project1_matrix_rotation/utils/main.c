@@ -25,8 +25,36 @@
 
 #include "./utils.h"
 #include "./tester.h"
+#include "./daemon.h"
+#include "./batch.h"
+#include "./stream.h"
+#include "./parallel.h"
 
 extern void rotate_bit_matrix(uint8_t *img, const bits_t N);
+extern void rotate_bit_matrix_parallel(uint8_t *img, const bits_t N);
+extern void rotate_bit_matrix_numa(uint8_t *img, const bits_t N);
+extern void rotate_bit_matrix_pipelined(uint8_t *img, const bits_t N);
+extern void set_prefetch_distance(uint32_t distance);
+extern void rotate_bit_matrix_roi(uint8_t *base, const bytes_t row_size,
+                                  bits_t x, bits_t y, const bits_t side);
+extern void rotate_bit_matrix_downsample(const uint8_t *img, const bits_t N,
+                                         uint32_t factor, bool majority,
+                                         uint8_t *out);
+extern void set_rotate_threads(uint32_t nthreads);
+
+// The rotation engines selectable with `-e`
+struct rotate_engine_s {
+  const char *name;
+  void (*rotate_fn)(uint8_t*, const bits_t);
+};
+
+static const struct rotate_engine_s ENGINES[] = {
+  {"serial", rotate_bit_matrix},
+  {"parallel", rotate_bit_matrix_parallel},
+  {"numa", rotate_bit_matrix_numa},
+  {"pipelined", rotate_bit_matrix_pipelined},
+};
+static const uint32_t NENGINES = sizeof(ENGINES) / sizeof(ENGINES[0]);
 
 const uint64_t UNUSED = (uint64_t)-1;
 
@@ -38,7 +66,9 @@ const uint64_t UNUSED = (uint64_t)-1;
 int main(int argc, char *argv[]) {
   int opt;
 
-  enum test_type_e {TEST_NOT_SET, TEST_FILE, TEST_GENERATED, TEST_CORRECTNESS, TEST_TIERS};
+  enum test_type_e {TEST_NOT_SET, TEST_FILE, TEST_GENERATED, TEST_CORRECTNESS, TEST_TIERS,
+                    TEST_DAEMON, TEST_CLIENT, TEST_BATCH, TEST_STREAM, TEST_SCALING,
+                    TEST_ROI, TEST_PREVIEW, TEST_BMPIO};
   enum test_type_e test_type = TEST_NOT_SET;
 
   // The flags for a `TEST_FILE` test type
@@ -51,13 +81,31 @@ int main(int argc, char *argv[]) {
   uint32_t DEFAULT_MAX_TIER = 10;
   uint32_t MAX_TIER_ALLOW = 40;
 
+  // The flags for the `TEST_DAEMON` and `TEST_CLIENT` test types
+  char *socket_path = NULL;
+  int nworkers = -1;
+
+  // The flags for a `TEST_BATCH` test type
+  int max_inflight = -1;
+
+  // The rotation engine, for every test type
+  char *engine_name = NULL;
+  int prefetch_distance = -1;
+
+  // The seed for generated matrices, for every test type that generates them
+  char *seed = NULL;
+
+  // The flags for a `TEST_PREVIEW` test type
+  int factor = -1;
+  char *reduction = NULL;
+
   // If the program was called without arguments, this is malformed input
   if (argc == 1) {
     goto help;
   }
 
   // Parse the CLI input!
-  while ((opt = getopt(argc, argv, "ht:f:o:N:s:M:")) != -1) {
+  while ((opt = getopt(argc, argv, "ht:f:o:N:s:M:j:q:e:p:r:d:S:")) != -1) {
     switch (opt) {
     case 'h':  // Help
       goto help;
@@ -75,6 +123,8 @@ int main(int argc, char *argv[]) {
         // The fields that should be unused
         SET_UNUSED(N);
         SET_UNUSED(max_tier);
+        SET_UNUSED(socket_path);
+        SET_UNUSED(max_inflight);
 
       } else if (!strcmp("generated", optarg)) {
         test_type = TEST_GENERATED;
@@ -83,6 +133,8 @@ int main(int argc, char *argv[]) {
         SET_UNUSED(fname);
         SET_UNUSED(output_fname);
         SET_UNUSED(max_tier);
+        SET_UNUSED(socket_path);
+        SET_UNUSED(max_inflight);
 
       } else if (!strcmp("correctness", optarg)) {
         test_type = TEST_CORRECTNESS;
@@ -92,6 +144,8 @@ int main(int argc, char *argv[]) {
         SET_UNUSED(output_fname);
         SET_UNUSED(N);
         SET_UNUSED(max_tier);
+        SET_UNUSED(socket_path);
+        SET_UNUSED(max_inflight);
 
       } else if (!strcmp("tiers", optarg)) {
         test_type = TEST_TIERS;
@@ -100,6 +154,80 @@ int main(int argc, char *argv[]) {
         SET_UNUSED(fname);
         SET_UNUSED(output_fname);
         SET_UNUSED(N);
+        SET_UNUSED(socket_path);
+        SET_UNUSED(max_inflight);
+
+      } else if (!strcmp("daemon", optarg)) {
+        test_type = TEST_DAEMON;
+
+        // The fields that should be unused
+        SET_UNUSED(fname);
+        SET_UNUSED(output_fname);
+        SET_UNUSED(max_tier);
+        SET_UNUSED(max_inflight);
+
+      } else if (!strcmp("client", optarg)) {
+        test_type = TEST_CLIENT;
+
+        // The fields that should be unused
+        SET_UNUSED(max_tier);
+        SET_UNUSED(nworkers);
+        SET_UNUSED(max_inflight);
+
+      } else if (!strcmp("batch", optarg)) {
+        test_type = TEST_BATCH;
+
+        // The fields that should be unused
+        SET_UNUSED(N);
+        SET_UNUSED(max_tier);
+        SET_UNUSED(socket_path);
+
+      } else if (!strcmp("stream", optarg)) {
+        test_type = TEST_STREAM;
+
+        // The fields that should be unused
+        SET_UNUSED(fname);
+        SET_UNUSED(output_fname);
+        SET_UNUSED(max_tier);
+        SET_UNUSED(socket_path);
+
+      } else if (!strcmp("scaling", optarg)) {
+        test_type = TEST_SCALING;
+
+        // The fields that should be unused
+        SET_UNUSED(fname);
+        SET_UNUSED(output_fname);
+        SET_UNUSED(N);
+        SET_UNUSED(socket_path);
+        SET_UNUSED(max_inflight);
+
+      } else if (!strcmp("roi", optarg)) {
+        test_type = TEST_ROI;
+
+        // The fields that should be unused
+        SET_UNUSED(fname);
+        SET_UNUSED(output_fname);
+        SET_UNUSED(N);
+        SET_UNUSED(max_tier);
+        SET_UNUSED(socket_path);
+        SET_UNUSED(nworkers);
+        SET_UNUSED(max_inflight);
+
+      } else if (!strcmp("preview", optarg)) {
+        test_type = TEST_PREVIEW;
+
+        // The fields that should be unused
+        SET_UNUSED(max_tier);
+        SET_UNUSED(socket_path);
+        SET_UNUSED(max_inflight);
+
+      } else if (!strcmp("bmpio", optarg)) {
+        test_type = TEST_BMPIO;
+
+        // The fields that should be unused
+        SET_UNUSED(fname);
+        SET_UNUSED(socket_path);
+        SET_UNUSED(max_inflight);
 
       } else {
         // Malformed input
@@ -125,6 +253,94 @@ int main(int argc, char *argv[]) {
       output_fname = optarg;
       break;
 
+    case 's':  // Daemon socket path
+      // Make sure the input is fresh
+      if (socket_path != NULL) {  // Also triggered by `UNUSED`
+        goto help;
+      }
+
+      socket_path = optarg;
+      break;
+
+    case 'j':  // Number of worker threads
+      if (nworkers != -1) {  // Also triggered by `UNUSED`
+        goto help;
+      }
+
+      nworkers = atoi(optarg);
+      if (nworkers <= 0) {
+        printf("Number of workers must be positive\n");
+        goto help;
+      }
+      break;
+
+    case 'e':  // Rotation engine
+      // Make sure the input is fresh
+      if (engine_name != NULL) {
+        goto help;
+      }
+
+      engine_name = optarg;
+      break;
+
+    case 'p':  // Prefetch distance
+      // Make sure the input is fresh
+      if (prefetch_distance != -1) {
+        goto help;
+      }
+
+      prefetch_distance = atoi(optarg);
+      if (prefetch_distance < 0) {
+        printf("Prefetch distance must not be negative\n");
+        goto help;
+      }
+      break;
+
+    case 'S':  // Generator seed
+      // Make sure the input is fresh
+      if (seed != NULL) {
+        goto help;
+      }
+
+      seed = optarg;
+      break;
+
+    case 'r':  // Downsampling factor
+      if (factor != -1) {  // Also triggered by `UNUSED`
+        goto help;
+      }
+
+      factor = atoi(optarg);
+      if (factor != 2 && factor != 4 && factor != 8) {
+        printf("Downsampling factor must be 2, 4 or 8\n");
+        goto help;
+      }
+      break;
+
+    case 'd':  // Downsampling reduction
+      if (reduction != NULL) {  // Also triggered by `UNUSED`
+        goto help;
+      }
+
+      reduction = optarg;
+      if (strcmp(reduction, "or") && strcmp(reduction, "majority")) {
+        printf("Reduction must be \"or\" or \"majority\"\n");
+        goto help;
+      }
+      break;
+
+    case 'q':  // Images in flight
+      if (max_inflight != -1) {  // Also triggered by `UNUSED`
+        goto help;
+      }
+
+      max_inflight = atoi(optarg);
+      if (max_inflight <= 0) {
+        printf("Number of images in flight must be positive\n");
+        goto help;
+      }
+      break;
+
     case 'M':  // Max tiers
       if (max_tier != -1) {  // Also triggered by `UNUSED`
         goto help;
@@ -178,6 +394,42 @@ int main(int argc, char *argv[]) {
     goto help;
   }
 
+  // Select the rotation engine. The scaling study is about threads, so it
+  // defaults to the parallel engine
+  if (engine_name == NULL) {
+    engine_name = test_type == TEST_SCALING ? "parallel" : "serial";
+  }
+  void (*rotate_fn)(uint8_t*, const bits_t) = NULL;
+  for (uint32_t e = 0; e < NENGINES; e++) {
+    if (!strcmp(ENGINES[e].name, engine_name)) {
+      rotate_fn = ENGINES[e].rotate_fn;
+    }
+  }
+  if (rotate_fn == NULL) {
+    printf("Unknown rotation engine: %s\n", engine_name);
+    goto help;
+  }
+
+  // Parallel engines use `-j` threads. The daemon and batch modes already
+  // run one image per worker, so their engines get a single thread each
+  if (test_type != TEST_DAEMON && test_type != TEST_BATCH) {
+    set_rotate_threads(nworkers > 0 ? (uint32_t)nworkers : available_cpus());
+  }
+  if (prefetch_distance != -1) {
+    set_prefetch_distance(prefetch_distance);
+  }
+
+  // Generated matrices are reproducible with a seed
+  if (seed != NULL) {
+    char *end;
+    uint64_t value = strtoull(seed, &end, 0);
+    if (*seed == '\0' || *end != '\0') {
+      printf("Invalid seed: %s\n", seed);
+      goto help;
+    }
+    seed_bit_matrix_generator(value);
+  }
+
   // Execute the respective tester function based on the CLI input
   switch (test_type) {
   case TEST_FILE:
@@ -189,11 +441,11 @@ int main(int argc, char *argv[]) {
 
     // Whether to disregard the output or not
     if (!output_fname) {
-      bool result = run_tester(fname, rotate_bit_matrix);
+      bool result = run_tester(fname, rotate_fn);
       printf("Result: %s\n", result ? "PASS" : "FAIL");
     } else {
       bool result = run_tester_save_output(fname, output_fname,
-                                           rotate_bit_matrix, true);
+                                           rotate_fn, true);
       printf("Result: %s\n", result ? "PASS" : "FAIL");
     }
 
@@ -207,7 +459,7 @@ int main(int argc, char *argv[]) {
     }
 
     bool result =
-          run_tester_generated_bit_matrix(rotate_bit_matrix, N);
+          run_tester_generated_bit_matrix(rotate_fn, N);
 
     printf("Result: %s\n", result ? "PASS" : "FAIL");
 
@@ -217,7 +469,7 @@ int main(int argc, char *argv[]) {
   {
     bits_t START_SIZE = 64;
 
-    bool correctness = run_correctness_tester(rotate_bit_matrix, START_SIZE);
+    bool correctness = run_correctness_tester(rotate_fn, START_SIZE);
     if (correctness)
         printf("PASS: Congrats! You pass all correctness tests\n");
     else
@@ -234,7 +486,7 @@ int main(int argc, char *argv[]) {
         max_tier = DEFAULT_MAX_TIER;
     }
 
-    uint32_t tier = run_tester_tiers(rotate_bit_matrix, TIER_TIMEOUT, TIMEOUT, 
+    uint32_t tier = run_tester_tiers(rotate_fn, TIER_TIMEOUT, TIMEOUT, 
         START_SIZE, GROWTH_RATE, (uint32_t) max_tier);
 
     if (tier == -1) {
@@ -245,6 +497,174 @@ int main(int argc, char *argv[]) {
 
     break;
   }
+  case TEST_DAEMON:
+  {
+    // The `socket_path` is a required argument
+    if (socket_path == NULL) {
+      goto help;
+    }
+
+    // By default, keep one warm worker per online core and pre-fault
+    // buffers for 4096x4096 images
+    if (nworkers == -1) {
+      nworkers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (N == 0) {
+      N = 4096;
+    }
+
+    bool result = run_rotation_daemon(socket_path, (uint32_t)nworkers,
+                                      N * bits_to_bytes(N), rotate_fn);
+    if (!result) {
+      return 1;
+    }
+    break;
+  }
+  case TEST_CLIENT:
+  {
+    // The `socket_path` is a required argument
+    if (socket_path == NULL) {
+      goto help;
+    }
+
+    if (fname != NULL) {
+      // Rotate a file; the daemon may run in another directory, so send
+      // absolute paths
+      if (output_fname == NULL) {
+        goto help;
+      }
+      char cwd[1024];
+      char request[3 * 1024 + 32];
+      char reply[4096];
+      if (!getcwd(cwd, sizeof(cwd))) {
+        perror("Error getting working directory");
+        return 1;
+      }
+      snprintf(request, sizeof(request), "ROTATE %s%s%s %s%s%s",
+               fname[0] == '/' ? "" : cwd, fname[0] == '/' ? "" : "/", fname,
+               output_fname[0] == '/' ? "" : cwd, output_fname[0] == '/' ? "" : "/",
+               output_fname);
+      bool result = daemon_request(socket_path, request, reply, sizeof(reply));
+      printf("Daemon reply: %s\n", reply);
+      printf("Result: %s\n", result ? "PASS" : "FAIL");
+    } else if (N != 0) {
+      // Round-trip a generated matrix through shared memory
+      bool result = run_daemon_shm_tester(socket_path, N, rotate_fn);
+      printf("Result: %s\n", result ? "PASS" : "FAIL");
+    } else {
+      // Query the throughput/latency counters
+      char reply[4096];
+      bool result = daemon_request(socket_path, "STATS", reply, sizeof(reply));
+      printf("%s\n", reply);
+      if (!result) {
+        return 1;
+      }
+    }
+    break;
+  }
+  case TEST_BATCH:
+  {
+    // The input directory or list and the output directory are required
+    if (fname == NULL || output_fname == NULL) {
+      goto help;
+    }
+
+    if (nworkers == -1) {
+      nworkers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    // Enough images in flight to keep every worker and the disk busy
+    if (max_inflight == -1) {
+      max_inflight = 2 * nworkers + 2;
+    }
+
+    bool result = run_batch_rotation(fname, output_fname, (uint32_t)nworkers,
+                                     (uint32_t)max_inflight, rotate_fn);
+    printf("Result: %s\n", result ? "PASS" : "FAIL");
+    break;
+  }
+  case TEST_STREAM:
+  {
+    // Frames go to stdout, so the outcome is only reported through
+    // stderr and the exit status. Without `N` the input must be PBM P4
+    if (max_inflight == -1) {
+      max_inflight = 4;
+    }
+
+    bool result = run_stream_rotation(STDIN_FILENO, STDOUT_FILENO, N,
+                                      (uint32_t)max_inflight, rotate_fn);
+    if (!result) {
+      return 1;
+    }
+    break;
+  }
+  case TEST_SCALING:
+  {
+    // Same tier sizes as the "tiers" test type, but fewer of them by default
+    bits_t START_SIZE = 26624;
+    double GROWTH_RATE = 1.1;
+    if (max_tier == -1) {
+        max_tier = 3;
+    }
+    if (nworkers == -1) {
+        nworkers = (int)available_cpus();
+    }
+
+    bool result = run_scaling_study(rotate_fn, set_rotate_threads, START_SIZE,
+                                    GROWTH_RATE, (uint32_t)max_tier,
+                                    (uint32_t)nworkers);
+    if (!result) {
+      return 1;
+    }
+    break;
+  }
+  case TEST_PREVIEW:
+  {
+    // Either an input file or a generated dimension is required
+    if (fname == NULL && N == 0) {
+      goto help;
+    }
+
+    bool majority = reduction != NULL && !strcmp(reduction, "majority");
+    bool result = run_downsample_tester(rotate_bit_matrix_downsample, rotate_fn,
+                                        fname, output_fname, N,
+                                        factor == -1 ? 4 : (uint32_t)factor,
+                                        majority);
+    printf("Result: %s\n", result ? "PASS" : "FAIL");
+    break;
+  }
+  case TEST_BMPIO:
+  {
+    // The scratch file is a required argument
+    if (output_fname == NULL) {
+      goto help;
+    }
+
+    // A single size with `-N`, otherwise the first tiers
+    bits_t START_SIZE = N != 0 ? N : 26624;
+    double GROWTH_RATE = 1.1;
+    if (max_tier == -1 || N != 0) {
+        max_tier = N != 0 ? 0 : 3;
+    }
+    if (nworkers == -1) {
+        nworkers = (int)available_cpus();
+    }
+
+    bool result = run_bmp_io_benchmark(output_fname, START_SIZE, GROWTH_RATE,
+                                       (uint32_t)max_tier, (uint32_t)nworkers);
+    if (!result) {
+      return 1;
+    }
+    break;
+  }
+  case TEST_ROI:
+  {
+    bool correctness = run_roi_tester(rotate_bit_matrix_roi);
+    if (correctness)
+        printf("PASS: Congrats! You pass all region of interest tests\n");
+    else
+        printf("FAIL: Too bad. You have to fix bugs :'(\n");
+    break;
+  }
   default:
     // If the `test_type` was not set, this is malformed input
     goto help;
@@ -256,11 +676,31 @@ int main(int argc, char *argv[]) {
   help:
   printf("usage:\n"
          "\t" "-t {file|generated|       \t Select a test type        \t Required to select test type\n"
-         "\t" "  correctness|tiers}\n"
+         "\t" "  correctness|tiers|\n"
+         "\t" "  daemon|client|batch|\n"
+         "\t" "  stream|scaling|roi|\n"
+         "\t" "  preview|bmpio}\n"
          "\t" "-f file-name              \t Input file name           \t Required for \"file\" test type\n"
+         "\t" "                          \t                           \t (\"batch\": a directory of BMPs or a file listing them)\n"
          "\t" "-o output-file-name       \t Output file name          \t Optional for \"file\" test type\n"
+         "\t" "                          \t                           \t (\"batch\": required output directory;\n"
+         "\t" "                          \t                           \t  \"bmpio\": required scratch file, removed after)\n"
          "\t" "-N dimension              \t Generated image dimension \t Required for \"generated\" test type\n"
-         "\t" "-M max-tier               \t Maximum tier              \t Optional for \"tiers\" test type\n"
+         "\t" "                          \t                           \t (\"stream\": raw frame side, PBM P4 input if omitted)\n"
+         "\t" "-M max-tier               \t Maximum tier              \t Optional for \"tiers\" and \"scaling\" test types\n"
+         "\t" "-e {serial|parallel|      \t Rotation engine           \t Optional, \"parallel\" and \"numa\" use -j threads\n"
+         "\t" "  numa|pipelined}\n"
+         "\t" "-p distance               \t Prefetch distance         \t Optional for \"pipelined\" engine, in block cycles\n"
+         "\t" "-r {2|4|8}                \t Downsampling factor       \t Optional for \"preview\" test type (default 4)\n"
+         "\t" "-d {or|majority}          \t Downsampling reduction    \t Optional for \"preview\" test type (default or)\n"
+         "\t" "-S seed                   \t Generator seed            \t Optional for \"generated\" and \"tiers\" test types\n"
+         "\t" "                          \t                           \t (any test type that generates matrices)\n"
+         "\t" "-s socket-path            \t Daemon Unix socket        \t Required for \"daemon\" and \"client\" test types\n"
+         "\t" "                          \t                           \t (\"daemon\" pre-faults buffers for -N; \"client\"\n"
+         "\t" "                          \t                           \t  rotates -f into -o, round-trips a generated -N\n"
+         "\t" "                          \t                           \t  matrix through shared memory, or prints STATS)\n"
+         "\t" "-j workers                \t Number of worker threads  \t Optional (\"scaling\": maximum thread count)\n"
+         "\t" "-q images                 \t Images in flight          \t Optional for \"batch\" and \"stream\" test types\n"
          "\t" "-h                        \t This help message\n");
 
   return 1;
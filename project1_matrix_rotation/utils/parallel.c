@@ -0,0 +1,78 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#define _GNU_SOURCE  // For `sched_getaffinity`
+#include <pthread.h>
+#include <sched.h>
+
+#include "./utils.h"
+#include "./parallel.h"
+
+struct parallel_thread_s {
+  pthread_t thread;
+  parallel_fn_t fn;
+  void *arg;
+  uint32_t tid;
+  uint32_t nthreads;
+};
+
+static void *parallel_thread_main(void *arg) {
+  struct parallel_thread_s *t = arg;
+  t->fn(t->arg, t->tid, t->nthreads);
+  return NULL;
+}
+
+void run_parallel(uint32_t nthreads, parallel_fn_t fn, void *arg) {
+  // Sanity check the input
+  assert(fn);
+
+  if (nthreads <= 1) {
+    fn(arg, 0, 1);
+    return;
+  }
+
+  struct parallel_thread_s threads[nthreads];
+  uint32_t t;
+  for (t = 1; t < nthreads; t++) {
+    threads[t] = (struct parallel_thread_s){
+        .fn = fn, .arg = arg, .tid = t, .nthreads = nthreads};
+    if (pthread_create(&threads[t].thread, NULL, parallel_thread_main, &threads[t])) {
+      perror("Error creating thread");
+      assert(false);
+    }
+  }
+
+  fn(arg, 0, nthreads);
+
+  for (t = 1; t < nthreads; t++) {
+    pthread_join(threads[t].thread, NULL);
+  }
+}
+
+uint32_t available_cpus(void) {
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    return 1;
+  }
+  return CPU_COUNT(&allowed);
+}
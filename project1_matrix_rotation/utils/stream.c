@@ -0,0 +1,440 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#define _GNU_SOURCE  // For `pthread_setaffinity_np`
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "./utils.h"
+#include "./stream.h"
+#include "./trace.h"
+
+// Longest PBM header we accept (magic, comments and dimensions)
+#define PBM_HEADER_MAX 256
+
+// Number of recent frame latencies kept for the percentiles
+#define STREAM_LATENCY_SAMPLES 65536
+
+// The ring of frame buffers shared by the three stages. Frame `k` lives in
+// slot `k % nslots`; the counters only ever grow, so each stage waits for
+// the one before it to get ahead
+struct frame_ring_s {
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+
+  uint8_t **frames;
+  uint64_t *arrival_ns;
+  uint32_t nslots;
+
+  uint64_t produced;
+  uint64_t rotated;
+  uint64_t written;
+  bool eof;
+  bool failed;
+};
+
+struct stream_s {
+  struct frame_ring_s ring;
+  int in_fd;
+  int out_fd;
+  bits_t N;
+  bytes_t frame_bytes;
+  void (*rotate_fn)(uint8_t*, const bits_t);
+
+  // PBM header of the first frame, which every later frame must repeat
+  uint8_t header[PBM_HEADER_MAX];
+  size_t header_len;
+
+  uint64_t *latencies_ns;
+  uint64_t first_written_ns;
+  uint64_t steady_start_ns;
+  uint64_t last_written_ns;
+};
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+// Reads exactly `len` bytes unless the stream ends first.
+//
+// Returns the number of bytes read, or -1 on error
+static ssize_t read_full(int fd, uint8_t *buf, size_t len) {
+  size_t done = 0;
+  while (done < len) {
+    ssize_t ret = read(fd, buf + done, len - done);
+    if (ret == 0) {
+      break;
+    }
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    done += ret;
+  }
+  return done;
+}
+
+static bool write_full(int fd, const uint8_t *buf, size_t len) {
+  size_t done = 0;
+  while (done < len) {
+    ssize_t ret = write(fd, buf + done, len - done);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    done += ret;
+  }
+  return true;
+}
+
+// Parses the PBM P4 header at the start of the stream one byte at a time,
+// keeping its exact bytes so later frames can be checked with a `memcmp`.
+//
+// Returns the image side, or 0 if the header is not a square P4 header
+static bits_t read_pbm_header(struct stream_s *stream) {
+  uint8_t *header = stream->header;
+  size_t len = 0;
+  uint64_t fields[2] = {0, 0};
+  int field = -1;  // -1 while reading the magic number
+  bool in_comment = false;
+  bool in_number = false;
+
+  if (read_full(stream->in_fd, header, 2) != 2 || header[0] != 'P' || header[1] != '4') {
+    return 0;
+  }
+  len = 2;
+
+  while (len < PBM_HEADER_MAX) {
+    uint8_t c;
+    if (read_full(stream->in_fd, &c, 1) != 1) {
+      return 0;
+    }
+    header[len++] = c;
+
+    if (in_comment) {
+      in_comment = c != '\n';
+      continue;
+    }
+    if (c == '#') {
+      in_comment = true;
+    } else if (isdigit(c)) {
+      if (!in_number) {
+        in_number = true;
+        field++;
+      }
+      fields[field] = fields[field] * 10 + (c - '0');
+    } else if (isspace(c)) {
+      in_number = false;
+      // A single whitespace character ends the height, then the data starts
+      if (field == 1) {
+        break;
+      }
+    } else {
+      return 0;
+    }
+  }
+
+  if (field != 1 || fields[0] != fields[1]) {
+    return 0;
+  }
+  stream->header_len = len;
+  return fields[0];
+}
+
+// Pins the calling thread to the `stage`-th CPU it is allowed to run on,
+// if there are enough CPUs to give each stage its own core
+static void pin_stage(uint32_t stage) {
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) < 3) {
+    return;
+  }
+
+  uint32_t cpu, seen = 0;
+  for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &allowed) && seen++ == stage) {
+      cpu_set_t one;
+      CPU_ZERO(&one);
+      CPU_SET(cpu, &one);
+      pthread_setaffinity_np(pthread_self(), sizeof(one), &one);
+      return;
+    }
+  }
+}
+
+static void ring_fail(struct frame_ring_s *ring) {
+  pthread_mutex_lock(&ring->lock);
+  ring->failed = true;
+  pthread_cond_broadcast(&ring->changed);
+  pthread_mutex_unlock(&ring->lock);
+}
+
+static void *reader_main(void *arg) {
+  struct stream_s *stream = arg;
+  struct frame_ring_s *ring = &stream->ring;
+  uint8_t header[PBM_HEADER_MAX];
+  uint64_t k;
+
+  pin_stage(0);
+
+  for (k = 0; ; k++) {
+    // Wait for the writer to hand back the oldest slot
+    pthread_mutex_lock(&ring->lock);
+    while (k - ring->written >= ring->nslots && !ring->failed) {
+      pthread_cond_wait(&ring->changed, &ring->lock);
+    }
+    bool failed = ring->failed;
+    pthread_mutex_unlock(&ring->lock);
+    if (failed) {
+      break;
+    }
+
+    // Every PBM frame after the first repeats the header verbatim
+    if (stream->header_len > 0 && k > 0) {
+      ssize_t got = read_full(stream->in_fd, header, stream->header_len);
+      if (got == 0) {
+        break;
+      }
+      if (got != (ssize_t)stream->header_len
+          || memcmp(header, stream->header, stream->header_len)) {
+        fprintf(stderr, "Error: frame %" PRIu64 " does not repeat the first PBM header\n", k);
+        ring_fail(ring);
+        break;
+      }
+    }
+
+    uint8_t *frame = ring->frames[k % ring->nslots];
+    uint64_t trace_start = trace_now();
+    ssize_t got = read_full(stream->in_fd, frame, stream->frame_bytes);
+    trace_span("read frame", trace_start);
+    if (got == 0 && (stream->header_len == 0 || k == 0)) {
+      break;
+    }
+    if (got != (ssize_t)stream->frame_bytes) {
+      fprintf(stderr, "Error: truncated frame %" PRIu64 " (%zd of %zu bytes)\n",
+              k, got, stream->frame_bytes);
+      ring_fail(ring);
+      break;
+    }
+
+    pthread_mutex_lock(&ring->lock);
+    ring->arrival_ns[k % ring->nslots] = now_ns();
+    ring->produced++;
+    pthread_cond_broadcast(&ring->changed);
+    pthread_mutex_unlock(&ring->lock);
+  }
+
+  pthread_mutex_lock(&ring->lock);
+  ring->eof = true;
+  pthread_cond_broadcast(&ring->changed);
+  pthread_mutex_unlock(&ring->lock);
+  return NULL;
+}
+
+static void *rotator_main(void *arg) {
+  struct stream_s *stream = arg;
+  struct frame_ring_s *ring = &stream->ring;
+  uint64_t k;
+
+  pin_stage(1);
+
+  for (k = 0; ; k++) {
+    pthread_mutex_lock(&ring->lock);
+    while (k == ring->produced && !ring->eof && !ring->failed) {
+      pthread_cond_wait(&ring->changed, &ring->lock);
+    }
+    bool done = k == ring->produced || ring->failed;
+    pthread_mutex_unlock(&ring->lock);
+    if (done) {
+      break;
+    }
+
+    uint64_t trace_start = trace_now();
+    stream->rotate_fn(ring->frames[k % ring->nslots], stream->N);
+    trace_span("rotate frame", trace_start);
+
+    pthread_mutex_lock(&ring->lock);
+    ring->rotated++;
+    pthread_cond_broadcast(&ring->changed);
+    pthread_mutex_unlock(&ring->lock);
+  }
+  return NULL;
+}
+
+static void *writer_main(void *arg) {
+  struct stream_s *stream = arg;
+  struct frame_ring_s *ring = &stream->ring;
+  uint64_t k;
+
+  pin_stage(2);
+
+  for (k = 0; ; k++) {
+    pthread_mutex_lock(&ring->lock);
+    while (k == ring->rotated && !(ring->eof && ring->rotated == ring->produced)
+           && !ring->failed) {
+      pthread_cond_wait(&ring->changed, &ring->lock);
+    }
+    bool done = k == ring->rotated || ring->failed;
+    pthread_mutex_unlock(&ring->lock);
+    if (done) {
+      break;
+    }
+
+    uint32_t slot = k % ring->nslots;
+    uint64_t trace_start = trace_now();
+    if ((stream->header_len > 0
+         && !write_full(stream->out_fd, stream->header, stream->header_len))
+        || !write_full(stream->out_fd, ring->frames[slot], stream->frame_bytes)) {
+      perror("Error writing rotated frame");
+      ring_fail(ring);
+      break;
+    }
+
+    trace_span("write frame", trace_start);
+
+    uint64_t now = now_ns();
+    stream->latencies_ns[k % STREAM_LATENCY_SAMPLES] = now - ring->arrival_ns[slot];
+    if (k == 0) {
+      stream->first_written_ns = now;
+    }
+    // Steady state starts once the ring has been filled and drained once
+    if (k == ring->nslots) {
+      stream->steady_start_ns = now;
+    }
+    stream->last_written_ns = now;
+
+    pthread_mutex_lock(&ring->lock);
+    ring->written++;
+    pthread_cond_broadcast(&ring->changed);
+    pthread_mutex_unlock(&ring->lock);
+  }
+  return NULL;
+}
+
+bool run_stream_rotation(int in_fd, int out_fd, bits_t N, uint32_t nslots,
+                         void (*rotate_fn)(uint8_t*, const bits_t)) {
+  // Sanity check the input
+  assert(rotate_fn);
+  assert(nslots > 0);
+
+  struct stream_s *stream = calloc(1, sizeof(struct stream_s));
+  assert(stream);
+  stream->in_fd = in_fd;
+  stream->out_fd = out_fd;
+  stream->rotate_fn = rotate_fn;
+
+  // Without a dimension, the frame size comes from the first PBM header
+  if (N == 0) {
+    N = read_pbm_header(stream);
+    if (N == 0) {
+      fprintf(stderr, "Error: expected a square PBM P4 stream (or pass -N for raw frames)\n");
+      free(stream);
+      return false;
+    }
+  }
+  if (N < 64 || N % 64 != 0) {
+    fprintf(stderr, "Error: frame side %zu is not a multiple of 64\n", N);
+    free(stream);
+    return false;
+  }
+  stream->N = N;
+  stream->frame_bytes = N * bits_to_bytes(N);
+
+  // All buffers are allocated once; nothing is allocated per frame
+  struct frame_ring_s *ring = &stream->ring;
+  pthread_mutex_init(&ring->lock, NULL);
+  pthread_cond_init(&ring->changed, NULL);
+  ring->nslots = nslots;
+  ring->frames = malloc(nslots * sizeof(uint8_t *));
+  ring->arrival_ns = calloc(nslots, sizeof(uint64_t));
+  stream->latencies_ns = malloc(STREAM_LATENCY_SAMPLES * sizeof(uint64_t));
+  assert(ring->frames && ring->arrival_ns && stream->latencies_ns);
+  uint32_t i;
+  for (i = 0; i < nslots; i++) {
+    ring->frames[i] = aligned_alloc(64, (stream->frame_bytes + 63) / 64 * 64);
+    assert(ring->frames[i]);
+    memset(ring->frames[i], 0, stream->frame_bytes);
+  }
+
+  pthread_t reader, rotator, writer;
+  uint64_t start = now_ns();
+  pthread_create(&reader, NULL, reader_main, stream);
+  pthread_create(&rotator, NULL, rotator_main, stream);
+  pthread_create(&writer, NULL, writer_main, stream);
+  pthread_join(reader, NULL);
+  pthread_join(rotator, NULL);
+  pthread_join(writer, NULL);
+
+  uint64_t nframes = ring->written;
+  bool result = !ring->failed;
+
+  if (nframes > 0) {
+    uint64_t nsamples = nframes < STREAM_LATENCY_SAMPLES ? nframes : STREAM_LATENCY_SAMPLES;
+    qsort(stream->latencies_ns, nsamples, sizeof(uint64_t), compare_u64);
+
+    double total_sec = (stream->last_written_ns - start) / 1e9;
+    double steady_fps = 0;
+    if (nframes > nslots + 1) {
+      steady_fps = (nframes - 1 - nslots) / ((stream->last_written_ns - stream->steady_start_ns) / 1e9);
+    }
+
+    fprintf(stderr, "Rotated %" PRIu64 " %zux%zu frames in %.3f seconds: %.1f frames/s"
+            " (steady state %.1f frames/s)\n",
+            nframes, N, N, total_sec, nframes / total_sec, steady_fps);
+    fprintf(stderr, "Frame latency (us): p50 %.1f, p90 %.1f, p99 %.1f, max %.1f\n",
+            stream->latencies_ns[(nsamples - 1) * 50 / 100] / 1e3,
+            stream->latencies_ns[(nsamples - 1) * 90 / 100] / 1e3,
+            stream->latencies_ns[(nsamples - 1) * 99 / 100] / 1e3,
+            stream->latencies_ns[nsamples - 1] / 1e3);
+  } else {
+    fprintf(stderr, "No frames rotated\n");
+  }
+
+  // Clean up after ourselves!
+  for (i = 0; i < nslots; i++) {
+    free(ring->frames[i]);
+  }
+  free(ring->frames);
+  free(ring->arrival_ns);
+  free(stream->latencies_ns);
+  pthread_mutex_destroy(&ring->lock);
+  pthread_cond_destroy(&ring->changed);
+  free(stream);
+
+  return result;
+}
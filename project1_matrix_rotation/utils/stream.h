@@ -0,0 +1,43 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "./utils.h"
+
+// Rotates a stream of square 1bpp frames read from `in_fd` and writes the
+// rotated frames to `out_fd`. If `N` is nonzero every frame is `N` by `N`
+// raw bits (N * N / 8 bytes, rows top to bottom, most significant bit
+// first). If `N` is 0 the stream is a sequence of PBM P4 images, all of
+// which must carry the same header as the first one.
+//
+// Reading, rotating and writing run as a three-stage pipeline, one thread
+// per stage, passing frames through a ring of `nslots` buffers allocated up
+// front. Throughput and per-frame latency are reported on stderr.
+//
+// Returns `true` if the whole stream was rotated
+bool run_stream_rotation(int in_fd, int out_fd, bits_t N, uint32_t nslots,
+                         void (*rotate_fn)(uint8_t*, const bits_t));
+
+#endif  // STREAM_H
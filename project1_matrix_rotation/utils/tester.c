@@ -22,6 +22,8 @@
 #include <string.h>
 #include "./utils.h"
 #include "./libbmp.h"
+#include "./parallel.h"
+#include "./trace.h"
 #include <math.h>
 #include <signal.h>
 #include <unistd.h>
@@ -65,6 +67,26 @@ static void _rotate_bit_matrix(uint8_t *img, const bits_t N) {
   return;
 }
 
+// Fills `tier_sizes[0..ntiers)` with tier dimensions starting from `start_n`
+// and growing by `increasing_ratio_of_n`, rounded up to a multiple of 64
+static void compute_tier_sizes(bits_t start_n, double increasing_ratio_of_n,
+                               bits_t tier_sizes[], uint32_t ntiers) {
+  bits_t N = start_n;
+  uint32_t i;
+  for (i = 0; i < ntiers; i++) {
+    tier_sizes[i] = N;
+    N = (uint64_t) ceil(N * increasing_ratio_of_n / 64) * 64;
+  }
+}
+
+// Wall-clock time in milliseconds. Unlike `clock`, this does not add up
+// the CPU time of every thread
+static double wall_msec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
 // Runs the tester for the input file `fname`. Tests the
 // user supplied `rotate_fn` function against a working
 // stock rotation function.
@@ -78,8 +100,10 @@ bool run_tester(const char *fname, void (*rotate_fn)(uint8_t*,
 
   struct color_table_s color_tables[2];
   int width, height, row_size;
+  uint64_t trace_start = trace_now();
   uint8_t *img = read_binary_bmp(fname, &width, &height,
                                  &row_size, color_tables);
+  trace_span("load/decode", trace_start);
 
   // Check whether there was an error
   if (!img) {
@@ -103,14 +127,16 @@ bool run_tester(const char *fname, void (*rotate_fn)(uint8_t*,
   memcpy(img_copy, img, img_size);
 
   // Call the user-defined `rotate_fn` and time it
-  clock_t start = clock();
+  double user_start = wall_msec();
+  trace_start = trace_now();
   rotate_fn(img_copy, width);
-  clock_t user_diff = clock() - start;
+  trace_span("rotate", trace_start);
+  double user_diff = wall_msec() - user_start;
 
   // Call our stock rotation function on `img`
-  start = clock();
+  double stock_start = wall_msec();
   _rotate_bit_matrix(img, width);
-  clock_t stock_diff = clock() - start;
+  double stock_diff = wall_msec() - stock_start;
 
   bool result = memcmp(img, img_copy, img_size) == 0;
 
@@ -120,8 +146,8 @@ bool run_tester(const char *fname, void (*rotate_fn)(uint8_t*,
 
   // Print the time taken to rotate the images using the
   // user-define `rotate_fn` and stock function
-  uint32_t user_msec = user_diff * 1000 / CLOCKS_PER_SEC;
-  uint32_t stock_msec = stock_diff * 1000 / CLOCKS_PER_SEC;
+  uint32_t user_msec = (uint32_t)user_diff;
+  uint32_t stock_msec = (uint32_t)stock_diff;
   printf("Your time taken: %d milliseconds\n", user_msec);
   printf("Stock time taken: %d milliseconds\n", stock_msec);
 
@@ -147,8 +173,10 @@ bool run_tester_save_output(const char *fname, const char *output_fname,
 
   struct color_table_s color_tables[2];
   int width, height, row_size;
+  uint64_t trace_start = trace_now();
   uint8_t *img = read_binary_bmp(fname, &width, &height,
                                  &row_size, color_tables);
+  trace_span("load/decode", trace_start);
 
   // Check whether there was an error
   if (!img) {
@@ -176,24 +204,28 @@ bool run_tester_save_output(const char *fname, const char *output_fname,
     memcpy(img_copy, img, img_size);
 
     // Call the user-defined `rotate_fn` and time it
-    clock_t start = clock();
+    double user_start = wall_msec();
+    trace_start = trace_now();
     rotate_fn(img, width);
-    clock_t user_diff = clock() - start;
+    trace_span("rotate", trace_start);
+    double user_diff = wall_msec() - user_start;
 
     // Write the rotated output to `output_fname`
+    trace_start = trace_now();
     write_binary_bmp(output_fname, img, color_tables, width);
+    trace_span("write", trace_start);
 
     // Call our stock rotation function on `img_copy`
-    start = clock();
+    double stock_start = wall_msec();
     _rotate_bit_matrix(img_copy, width);
-    clock_t stock_diff = clock() - start;
+    double stock_diff = wall_msec() - stock_start;
 
     result = memcmp(img_copy, img, img_size) == 0;
 
     // Print the time taken to rotate the images using the
     // user-define `rotate_fn` and stock function
-    uint32_t user_msec = user_diff * 1000 / CLOCKS_PER_SEC;
-    uint32_t stock_msec = stock_diff * 1000 / CLOCKS_PER_SEC;
+    uint32_t user_msec = (uint32_t)user_diff;
+    uint32_t stock_msec = (uint32_t)stock_diff;
     printf("Your time taken: %d milliseconds\n", user_msec);
     printf("Stock time taken: %d milliseconds\n", stock_msec);
 
@@ -201,16 +233,20 @@ bool run_tester_save_output(const char *fname, const char *output_fname,
     // We are not testing for correctness, so just rotate
 
     // Call the user-defined `rotate_fn` and time it
-    clock_t start = clock();
+    double user_start = wall_msec();
+    trace_start = trace_now();
     rotate_fn(img, width);
-    clock_t user_diff = clock() - start;
+    trace_span("rotate", trace_start);
+    double user_diff = wall_msec() - user_start;
 
     // Write the rotated output to `output_fname`
+    trace_start = trace_now();
     write_binary_bmp(output_fname, img, color_tables, width);
+    trace_span("write", trace_start);
 
     // Print the time taken to rotate the image using the
     // user-define `rotate_fn`
-    uint32_t user_msec = user_diff * 1000 / CLOCKS_PER_SEC;
+    uint32_t user_msec = (uint32_t)user_diff;
     printf("Your time taken: %d milliseconds\n", user_msec);
   }
 
@@ -239,18 +275,22 @@ bool run_tester_generated_bit_matrix(void (*rotate_fn)(uint8_t*,
   const bytes_t row_size = bits_to_bytes(N);
 
   const bytes_t bit_matrix_size = N * row_size;
+  uint64_t trace_start = trace_now();
   uint8_t *bit_matrix = generate_bit_matrix(N, false);
+  trace_span("generate", trace_start);
   uint8_t *bit_matrix_copy = copy_bit_matrix(bit_matrix, N);
   
   // Call the user-defined `rotate_fn` and time it
-  clock_t start = clock();
+  double user_start = wall_msec();
+  trace_start = trace_now();
   rotate_fn(bit_matrix, N);
-  clock_t user_diff = clock() - start;
+  trace_span("rotate", trace_start);
+  double user_diff = wall_msec() - user_start;
 
   // Call our stock rotation function on `img`
-  start = clock();
+  double stock_start = wall_msec();
   _rotate_bit_matrix(bit_matrix_copy, N);
-  clock_t stock_diff = clock() - start;
+  double stock_diff = wall_msec() - stock_start;
 
   bool result =
     memcmp(bit_matrix, bit_matrix_copy, bit_matrix_size) == 0;
@@ -261,8 +301,8 @@ bool run_tester_generated_bit_matrix(void (*rotate_fn)(uint8_t*,
 
   // Print the time taken to rotate the images using the
   // user-define `rotate_fn` and stock function
-  uint32_t user_msec = user_diff * 1000 / CLOCKS_PER_SEC;
-  uint32_t stock_msec = stock_diff * 1000 / CLOCKS_PER_SEC;
+  uint32_t user_msec = (uint32_t)user_diff;
+  uint32_t stock_msec = (uint32_t)stock_diff;
   printf("Your time taken: %d milliseconds\n", user_msec);
   printf("Stock time taken: %d milliseconds\n", stock_msec);
 
@@ -301,13 +341,12 @@ uint32_t run_tester_tiers(void (*rotate_fn)(uint8_t*, const bits_t),
   bits_t N = start_n;
   bits_t tier_sizes[MAX_ALLOWED_TIERS + 5];
 
-  uint32_t i = 0;
-  for (N = start_n; i <= MAX_ALLOWED_TIERS; N = (uint64_t) ceil(N * increasing_ratio_of_n / 64) * 64) {
-      tier_sizes[i++] = N;
-  }
+  compute_tier_sizes(start_n, increasing_ratio_of_n, tier_sizes, MAX_ALLOWED_TIERS + 1);
 
   printf("Malloc %zux%zu matrix...\n", tier_sizes[highest_tier], tier_sizes[highest_tier]);
+  uint64_t trace_start = trace_now();
   uint8_t *bit_matrix = generate_bit_matrix(tier_sizes[highest_tier], true);
+  trace_span("generate", trace_start);
 
   if (!bit_matrix) {
       printf("Error: Run out of heap space! Please choose smaller tier\n");
@@ -321,12 +360,14 @@ uint32_t run_tester_tiers(void (*rotate_fn)(uint8_t*, const bits_t),
   for (tier = 0; tier <= highest_tier; tier++) {
     N = tier_sizes[tier];
     // Call the user-defined `rotate_fn` and time it
-    clock_t start = clock();
+    double user_start = wall_msec();
+    trace_start = trace_now();
     rotate_fn(bit_matrix, N);
-    clock_t user_diff = clock() - start;
+    trace_span("rotate", trace_start);
+    double user_diff = wall_msec() - user_start;
 
     // Compute the user time in milliseconds
-    uint32_t user_msec = user_diff * 1000 / CLOCKS_PER_SEC;
+    uint32_t user_msec = (uint32_t)user_diff;
 
     // Exit if the user time is too much, but was still correct!
     if (user_msec >= tier_timeout) {
@@ -395,12 +436,12 @@ bool run_correctness_tester(void (*rotate_fn)(uint8_t*, const bits_t),
     uint32_t user_msec = 0;
     for (i = 0; i < 3; i++, tier++) {
       // Call the user-defined `rotate_fn` and time it
-      clock_t start = clock();
+      double user_start = wall_msec();
       rotate_fn(bit_matrix, N);
-      clock_t user_diff = clock() - start;
+      double user_diff = wall_msec() - user_start;
 
       // Compute the user time in milliseconds
-      user_msec += user_diff * 1000 / CLOCKS_PER_SEC;
+      user_msec += (uint32_t)user_diff;
 
       // Checking correctness - Call our stock rotation function on bit_matrix
       _rotate_bit_matrix(bit_matrix_copy, N);
@@ -429,3 +470,366 @@ bool run_correctness_tester(void (*rotate_fn)(uint8_t*, const bits_t),
   }
   return true;
 }
+
+struct parallel_memcpy_s {
+  uint8_t *dst;
+  const uint8_t *src;
+  bytes_t size;
+};
+
+static void parallel_memcpy_worker(void *arg, uint32_t tid, uint32_t nthreads) {
+  struct parallel_memcpy_s *copy = arg;
+  bytes_t begin = copy->size * tid / nthreads;
+  bytes_t end = copy->size * (tid + 1) / nthreads;
+  memcpy(copy->dst + begin, copy->src + begin, end - begin);
+}
+
+// Runs a scaling study of `rotate_fn` over thread counts 1, 2, 4, ... up to
+// `max_threads` (set through `set_threads_fn`) and over the tier sizes up to
+// `highest_tier`. A `memcpy` of the same number of bytes, split over the
+// same number of threads, serves as the memory bandwidth roof: a rotation
+// reads and writes every byte once, exactly like the copy.
+//
+// Prints one CSV row per configuration with the achieved bandwidth, the
+// roof (the best copy bandwidth seen for that size at any thread count),
+// the efficiency against it and the speedup over one thread.
+//
+// Returns `false` if a matrix could not be allocated
+bool run_scaling_study(void (*rotate_fn)(uint8_t*, const bits_t),
+                       void (*set_threads_fn)(uint32_t),
+                       bits_t start_n,
+                       double increasing_ratio_of_n,
+                       uint32_t highest_tier,
+                       uint32_t max_threads) {
+  // Sanity check the input
+  uint32_t MAX_ALLOWED_TIERS = 40;
+  assert(highest_tier <= MAX_ALLOWED_TIERS);
+  assert(rotate_fn);
+  assert(set_threads_fn);
+  assert(start_n % 64 == 0);
+  assert(max_threads > 0);
+
+  // Best of a few repetitions, to filter out page faults and noise
+  const uint32_t REPETITIONS = 3;
+
+  bits_t tier_sizes[MAX_ALLOWED_TIERS + 1];
+  compute_tier_sizes(start_n, increasing_ratio_of_n, tier_sizes, highest_tier + 1);
+
+  uint32_t thread_counts[32];
+  uint32_t nconfigs = 0;
+  uint32_t t;
+  for (t = 1; t < max_threads; t *= 2) {
+    thread_counts[nconfigs++] = t;
+  }
+  thread_counts[nconfigs++] = max_threads;
+
+  printf("N,threads,bytes,rotate_ms,rotate_gbps,memcpy_ms,memcpy_gbps,"
+         "roof_gbps,efficiency,speedup\n");
+
+  uint32_t tier;
+  for (tier = 0; tier <= highest_tier; tier++) {
+    bits_t N = tier_sizes[tier];
+    const bytes_t size = N * bits_to_bytes(N);
+
+    uint8_t *bit_matrix = generate_bit_matrix(N, true);
+    uint8_t *copy_dst = malloc(size);
+    if (!bit_matrix || !copy_dst) {
+      printf("Error: Run out of heap space! Please choose smaller tier\n");
+      free(bit_matrix);
+      free(copy_dst);
+      return false;
+    }
+    // Fault in the copy destination so the first copy is not penalized
+    memset(copy_dst, 0, size);
+
+    double memcpy_ms[32];
+    double rotate_ms[32];
+    double roof_gbps = 0;
+    uint32_t c, r;
+
+    // Measure the copy roof at every thread count first, so each row can
+    // be compared against the best of them
+    for (c = 0; c < nconfigs; c++) {
+      struct parallel_memcpy_s copy = {.dst = copy_dst, .src = bit_matrix, .size = size};
+      memcpy_ms[c] = INFINITY;
+      for (r = 0; r < REPETITIONS; r++) {
+        double start = wall_msec();
+        run_parallel(thread_counts[c], parallel_memcpy_worker, &copy);
+        double elapsed = wall_msec() - start;
+        memcpy_ms[c] = elapsed < memcpy_ms[c] ? elapsed : memcpy_ms[c];
+      }
+      double gbps = 2.0 * size / (memcpy_ms[c] * 1e6);
+      roof_gbps = gbps > roof_gbps ? gbps : roof_gbps;
+    }
+
+    for (c = 0; c < nconfigs; c++) {
+      set_threads_fn(thread_counts[c]);
+      rotate_ms[c] = INFINITY;
+      for (r = 0; r < REPETITIONS; r++) {
+        double start = wall_msec();
+        rotate_fn(bit_matrix, N);
+        double elapsed = wall_msec() - start;
+        rotate_ms[c] = elapsed < rotate_ms[c] ? elapsed : rotate_ms[c];
+      }
+
+      double rotate_gbps = 2.0 * size / (rotate_ms[c] * 1e6);
+      double memcpy_gbps = 2.0 * size / (memcpy_ms[c] * 1e6);
+      printf("%zu,%u,%zu,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+             N, thread_counts[c], size, rotate_ms[c], rotate_gbps,
+             memcpy_ms[c], memcpy_gbps, roof_gbps, rotate_gbps / roof_gbps,
+             rotate_ms[0] / rotate_ms[c]);
+      fflush(stdout);
+    }
+
+    // Clean up after ourselves!
+    free(bit_matrix);
+    free(copy_dst);
+  }
+
+  return true;
+}
+
+// Tests the user-supplied region-of-interest rotation `roi_fn` against
+// cutting the region out, rotating it with the stock rotation function
+// and pasting it back. Regions of several sizes are placed at aligned and
+// unaligned bit offsets inside parents with odd row sizes
+bool run_roi_tester(void (*roi_fn)(uint8_t*, const bytes_t, bits_t, bits_t,
+                                   const bits_t)) {
+  // Sanity check the input
+  assert(roi_fn);
+
+  const bits_t sides[] = {64, 128, 192, 320, 576};
+  const bits_t offsets[] = {0, 1, 7, 8, 13, 64, 100};
+  const uint32_t nsides = sizeof(sides) / sizeof(sides[0]);
+  const uint32_t noffsets = sizeof(offsets) / sizeof(offsets[0]);
+
+  uint32_t test = 0;
+  for (uint32_t s = 0; s < nsides; s++) {
+    for (uint32_t o = 0; o < noffsets; o++, test++) {
+      const bits_t side = sides[s];
+      const bits_t x = offsets[o];
+      const bits_t y = offsets[(o + s) % noffsets];
+
+      // Leave a margin of a few unaligned bytes right and below the region
+      const bytes_t row_size = (x + side + 7) / 8 + 1 + rand() % 5;
+      const bits_t nrows = y + side + rand() % 9;
+      const bytes_t parent_size = row_size * nrows;
+
+      uint8_t *parent = malloc(parent_size);
+      uint8_t *expected = malloc(parent_size);
+      uint8_t *roi = malloc(side * bits_to_bytes(side));
+      if (!parent || !expected || !roi) {
+        printf("Error: Run out of heap space!\n");
+        return false;
+      }
+      for (bytes_t b = 0; b < parent_size; b++) {
+        parent[b] = rand();
+      }
+      memcpy(expected, parent, parent_size);
+
+      // Cut the region out, rotate it and paste it back
+      uint32_t i, j;
+      for (j = 0; j < side; j++) {
+        for (i = 0; i < side; i++) {
+          set_bit(roi, bits_to_bytes(side), i, j,
+                  get_bit(expected, row_size, x + i, y + j));
+        }
+      }
+      _rotate_bit_matrix(roi, side);
+      for (j = 0; j < side; j++) {
+        for (i = 0; i < side; i++) {
+          set_bit(expected, row_size, x + i, y + j,
+                  get_bit(roi, bits_to_bytes(side), i, j));
+        }
+      }
+
+      roi_fn(parent, row_size, x, y, side);
+
+      bool correctness = memcmp(parent, expected, parent_size) == 0;
+      free(parent);
+      free(expected);
+      free(roi);
+
+      if (!correctness) {
+        printf("FAIL : Test %d : Incorrectly rotated %zux%zu region at (%zu, %zu) "
+               "in a %zu-byte wide image\n", test, side, side, x, y, row_size);
+        return false;
+      }
+      printf("PASS : Test %d : Rotated %zux%zu region at (%zu, %zu) "
+             "in a %zu-byte wide image\n", test, side, side, x, y, row_size);
+    }
+  }
+  return true;
+}
+
+// Tests the user-supplied fused rotate-and-downsample `downsample_fn` on
+// the image in `fname`, or on a generated `N`x`N` matrix without one,
+// against a full rotation with `rotate_fn` followed by a separate
+// reduction. The preview is written to `output_fname` if given
+bool run_downsample_tester(void (*downsample_fn)(const uint8_t*, const bits_t,
+                                                 uint32_t, bool, uint8_t*),
+                           void (*rotate_fn)(uint8_t*, const bits_t),
+                           const char *fname, const char *output_fname,
+                           bits_t N, uint32_t factor, bool majority) {
+  // Sanity check the input
+  assert(downsample_fn);
+  assert(rotate_fn);
+  assert(factor == 2 || factor == 4 || factor == 8);
+
+  // Black and white, for generated matrices
+  struct color_table_s color_tables[2] = {{0, 0, 0, 0}, {255, 255, 255, 0}};
+  uint8_t *img;
+  if (fname != NULL) {
+    int width, height, row_size;
+    img = read_binary_bmp(fname, &width, &height, &row_size, color_tables);
+    if (!img) {
+      return false;
+    }
+    if (width != height || width % 64 != 0 || width != 8 * row_size) {
+      printf("Error: %s must be square with a side that is a multiple of 64\n", fname);
+      free(img);
+      return false;
+    }
+    N = width;
+  } else {
+    img = generate_bit_matrix(N, false);
+    if (!img) {
+      return false;
+    }
+  }
+  assert(N % 64 == 0);
+
+  const bits_t out_N = N / factor;
+  const bytes_t out_row_size = bits_to_bytes(out_N);
+  uint8_t *preview = malloc(out_N * out_row_size);
+  uint8_t *expected = calloc(out_N * out_row_size, 1);
+  uint8_t *rotated = copy_bit_matrix(img, N);
+  if (!preview || !expected || !rotated) {
+    printf("Error: Run out of heap space! Please try smaller matrix size.\n");
+    return false;
+  }
+
+  // Call the user-defined `downsample_fn` and time it
+  double fused_start = wall_msec();
+  downsample_fn(img, N, factor, majority, preview);
+  double fused_diff = wall_msec() - fused_start;
+
+  // The unfused reference: rotate everything, then reduce
+  double rotate_start = wall_msec();
+  rotate_fn(rotated, N);
+  double rotate_diff = wall_msec() - rotate_start;
+
+  const bytes_t row_size = bits_to_bytes(N);
+  double reduce_start = wall_msec();
+  uint32_t i, j, di, dj;
+  for (j = 0; j < out_N; j++) {
+    for (i = 0; i < out_N; i++) {
+      uint32_t count = 0;
+      for (dj = 0; dj < factor; dj++) {
+        for (di = 0; di < factor; di++) {
+          count += get_bit(rotated, row_size, i * factor + di, j * factor + dj);
+        }
+      }
+      bool set = majority ? count > factor * factor / 2 : count > 0;
+      set_bit(expected, out_row_size, i, j, set);
+    }
+  }
+  double reduce_diff = wall_msec() - reduce_start;
+
+  bool result = memcmp(preview, expected, out_N * out_row_size) == 0;
+  if (result && output_fname != NULL) {
+    write_binary_bmp(output_fname, preview, color_tables, out_N);
+  }
+
+  printf("%zux%zu -> %zux%zu preview (%s of %ux%u cells)\n", N, N, out_N, out_N,
+         majority ? "majority" : "OR", factor, factor);
+  printf("Fused time taken: %d milliseconds\n", (uint32_t)fused_diff);
+  printf("Rotate then reduce time taken: %d + %d milliseconds\n",
+         (uint32_t)rotate_diff, (uint32_t)reduce_diff);
+
+  // Clean up after ourselves!
+  free(img);
+  free(rotated);
+  free(preview);
+  free(expected);
+
+  return result;
+}
+
+// Benchmarks the serial BMP reader and writer against their parallel
+// counterparts with `nthreads` threads, on the tier sizes from `start_n`
+// up to `highest_tier`. `scratch_fname` is overwritten and removed at the
+// end. Every image read back is checked against what was written
+bool run_bmp_io_benchmark(const char *scratch_fname, bits_t start_n,
+                          double increasing_ratio_of_n, uint32_t highest_tier,
+                          uint32_t nthreads) {
+  // Sanity check the input
+  uint32_t MAX_ALLOWED_TIERS = 40;
+  assert(highest_tier <= MAX_ALLOWED_TIERS);
+  assert(scratch_fname);
+  assert(start_n % 64 == 0);
+
+  bits_t tier_sizes[MAX_ALLOWED_TIERS + 1];
+  compute_tier_sizes(start_n, increasing_ratio_of_n, tier_sizes, highest_tier + 1);
+
+  struct color_table_s color_tables[2] = {{0, 0, 0, 0}, {255, 255, 255, 0}};
+  bool result = true;
+
+  printf("N,bytes,threads,serial_write_ms,parallel_write_ms,"
+         "serial_read_ms,parallel_read_ms,write_speedup,read_speedup\n");
+
+  uint32_t tier;
+  for (tier = 0; tier <= highest_tier && result; tier++) {
+    const bits_t N = tier_sizes[tier];
+    const bytes_t img_size = N * bits_to_bytes(N);
+    uint8_t *img = generate_bit_matrix(N, false);
+    if (!img) {
+      return false;
+    }
+
+    int width, height, row_size;
+    uint8_t *serial_img, *parallel_img, *cross_img;
+
+    double start = wall_msec();
+    write_binary_bmp(scratch_fname, img, color_tables, N);
+    double serial_write = wall_msec() - start;
+
+    start = wall_msec();
+    serial_img = read_binary_bmp(scratch_fname, &width, &height, &row_size, color_tables);
+    double serial_read = wall_msec() - start;
+
+    // The parallel reader must also understand the serial writer's files
+    cross_img = read_binary_bmp_parallel(scratch_fname, &width, &height,
+                                         &row_size, color_tables, nthreads);
+
+    start = wall_msec();
+    result = write_binary_bmp_parallel(scratch_fname, img, color_tables, N, nthreads);
+    double parallel_write = wall_msec() - start;
+
+    start = wall_msec();
+    parallel_img = read_binary_bmp_parallel(scratch_fname, &width, &height,
+                                            &row_size, color_tables, nthreads);
+    double parallel_read = wall_msec() - start;
+
+    result = result && serial_img && parallel_img && cross_img &&
+             memcmp(img, serial_img, img_size) == 0 &&
+             memcmp(img, parallel_img, img_size) == 0 &&
+             memcmp(img, cross_img, img_size) == 0;
+    if (!result) {
+      printf("FAIL : %zux%zu image did not survive a write and read\n", N, N);
+    } else {
+      printf("%zu,%zu,%u,%.1f,%.1f,%.1f,%.1f,%.2f,%.2f\n", N, img_size, nthreads,
+             serial_write, parallel_write, serial_read, parallel_read,
+             serial_write / parallel_write, serial_read / parallel_read);
+    }
+
+    // Clean up after ourselves!
+    free(img);
+    free(serial_img);
+    free(parallel_img);
+    free(cross_img);
+  }
+  unlink(scratch_fname);
+
+  return result;
+}
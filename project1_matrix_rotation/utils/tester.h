@@ -46,4 +46,24 @@ uint32_t run_tester_tiers(void (*rotate_fn)(uint8_t*, const bits_t),
 bool run_correctness_tester(void (*rotate_fn)(uint8_t*, const bits_t),
                           bits_t start_n);
 
+bool run_scaling_study(void (*rotate_fn)(uint8_t*, const bits_t),
+                       void (*set_threads_fn)(uint32_t),
+                       bits_t start_n,
+                       double increasing_ratio_of_n,
+                       uint32_t highest_tier,
+                       uint32_t max_threads);
+
+bool run_roi_tester(void (*roi_fn)(uint8_t*, const bytes_t, bits_t, bits_t,
+                                   const bits_t));
+
+bool run_downsample_tester(void (*downsample_fn)(const uint8_t*, const bits_t,
+                                                 uint32_t, bool, uint8_t*),
+                           void (*rotate_fn)(uint8_t*, const bits_t),
+                           const char *fname, const char *output_fname,
+                           bits_t N, uint32_t factor, bool majority);
+
+bool run_bmp_io_benchmark(const char *scratch_fname, bits_t start_n,
+                          double increasing_ratio_of_n, uint32_t highest_tier,
+                          uint32_t nthreads);
+
 #endif  // TESTER_H
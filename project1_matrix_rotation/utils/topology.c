@@ -0,0 +1,201 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#define _GNU_SOURCE  // For `sched_setaffinity` and `CPU_*`
+#include <dirent.h>
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "./utils.h"
+#include "./topology.h"
+
+static struct {
+  uint32_t nnodes;
+  bool emulated;
+  // Kernel node id of each node, for `mbind`
+  uint32_t node_id[MAX_NUMA_NODES];
+  cpu_set_t cpus[MAX_NUMA_NODES];
+  cpu_set_t allowed;
+} topology;
+
+static pthread_once_t topology_once = PTHREAD_ONCE_INIT;
+
+// Adds the CPUs in a sysfs cpulist such as "0-3,8,10-11" to `set`
+static void parse_cpulist(const char *list, cpu_set_t *set) {
+  while (*list != '\0' && *list != '\n') {
+    char *end;
+    long first = strtol(list, &end, 10);
+    long last = first;
+    if (end == list) {
+      return;
+    }
+    if (*end == '-') {
+      list = end + 1;
+      last = strtol(list, &end, 10);
+    }
+    for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+      CPU_SET(cpu, set);
+    }
+    list = *end == ',' ? end + 1 : end;
+  }
+}
+
+// Splits the allowed CPUs into `nnodes` contiguous groups. With fewer CPUs
+// than nodes, nodes share CPUs round-robin
+static void emulate_topology(uint32_t nnodes) {
+  int cpu_list[CPU_SETSIZE];
+  int ncpus = 0;
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &topology.allowed)) {
+      cpu_list[ncpus++] = cpu;
+    }
+  }
+
+  topology.emulated = true;
+  topology.nnodes = nnodes;
+  for (uint32_t n = 0; n < nnodes; n++) {
+    topology.node_id[n] = n;
+    CPU_ZERO(&topology.cpus[n]);
+  }
+  if (ncpus < (int)nnodes) {
+    for (uint32_t n = 0; n < nnodes; n++) {
+      CPU_SET(cpu_list[n % ncpus], &topology.cpus[n]);
+    }
+    return;
+  }
+  for (int c = 0; c < ncpus; c++) {
+    CPU_SET(cpu_list[c], &topology.cpus[(uint64_t)c * nnodes / ncpus]);
+  }
+}
+
+static void read_sysfs_topology(void) {
+  DIR *dir = opendir("/sys/devices/system/node");
+  struct dirent *entry;
+  unsigned int id;
+
+  while (dir != NULL && (entry = readdir(dir)) != NULL &&
+         topology.nnodes < MAX_NUMA_NODES) {
+    if (sscanf(entry->d_name, "node%u", &id) != 1) {
+      continue;
+    }
+
+    char path[128];
+    char list[4096];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", id);
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+      continue;
+    }
+    bool have_list = fgets(list, sizeof(list), f) != NULL;
+    fclose(f);
+    if (!have_list) {
+      continue;
+    }
+
+    // Skip memory-only nodes and nodes we may not run on
+    cpu_set_t *cpus = &topology.cpus[topology.nnodes];
+    CPU_ZERO(cpus);
+    parse_cpulist(list, cpus);
+    CPU_AND(cpus, cpus, &topology.allowed);
+    if (CPU_COUNT(cpus) == 0) {
+      continue;
+    }
+    topology.node_id[topology.nnodes++] = id;
+  }
+  if (dir != NULL) {
+    closedir(dir);
+  }
+}
+
+static void init_topology(void) {
+  if (sched_getaffinity(0, sizeof(topology.allowed), &topology.allowed) != 0) {
+    CPU_ZERO(&topology.allowed);
+    CPU_SET(0, &topology.allowed);
+  }
+
+  const char *emulated = getenv("ROTATE_NUMA_NODES");
+  if (emulated != NULL && atoi(emulated) > 0) {
+    int nnodes = atoi(emulated);
+    emulate_topology(nnodes < MAX_NUMA_NODES ? nnodes : MAX_NUMA_NODES);
+    return;
+  }
+
+  read_sysfs_topology();
+
+  // Without NUMA support in the kernel everything is one node
+  if (topology.nnodes == 0) {
+    topology.nnodes = 1;
+    topology.node_id[0] = 0;
+    topology.cpus[0] = topology.allowed;
+  }
+}
+
+uint32_t numa_nodes(void) {
+  pthread_once(&topology_once, init_topology);
+  return topology.nnodes;
+}
+
+bool numa_emulated(void) {
+  pthread_once(&topology_once, init_topology);
+  return topology.emulated;
+}
+
+bool pin_thread_to_node(uint32_t node) {
+  pthread_once(&topology_once, init_topology);
+  assert(node < topology.nnodes);
+
+  return sched_setaffinity(0, sizeof(cpu_set_t), &topology.cpus[node]) == 0;
+}
+
+void unpin_thread(void) {
+  pthread_once(&topology_once, init_topology);
+  sched_setaffinity(0, sizeof(cpu_set_t), &topology.allowed);
+}
+
+bool place_on_node(void *addr, size_t len, uint32_t node) {
+  pthread_once(&topology_once, init_topology);
+  assert(node < topology.nnodes);
+
+  if (topology.emulated || topology.nnodes == 1 || len == 0) {
+    return false;
+  }
+
+  // `mbind` works on whole pages
+  uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+  uintptr_t start = (uintptr_t)addr & ~(page - 1);
+  uintptr_t end = ((uintptr_t)addr + len + page - 1) & ~(page - 1);
+
+  unsigned long nodemask[MAX_NUMA_NODES / 64 + 1] = {0};
+  uint32_t id = topology.node_id[node];
+  if (id >= sizeof(nodemask) * 8) {
+    return false;
+  }
+  nodemask[id / 64] |= 1ul << (id % 64);
+
+  return syscall(SYS_mbind, start, end - start, MPOL_PREFERRED, nodemask,
+                 (unsigned long)(sizeof(nodemask) * 8), MPOL_MF_MOVE) == 0;
+}
@@ -0,0 +1,55 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include "./utils.h"
+
+#define MAX_NUMA_NODES 64
+
+// Returns the number of NUMA nodes that have CPUs this process may run on,
+// read from /sys/devices/system/node.
+//
+// Setting the ROTATE_NUMA_NODES environment variable to k emulates k nodes
+// instead, by splitting the allowed CPUs into k groups. Emulated nodes get
+// thread pinning but no page placement, which makes the NUMA code paths
+// testable on single-node machines
+uint32_t numa_nodes(void);
+
+// Returns whether the topology comes from ROTATE_NUMA_NODES
+bool numa_emulated(void);
+
+// Pins the calling thread to the CPUs of `node`
+bool pin_thread_to_node(uint32_t node);
+
+// Lets the calling thread run on all CPUs allowed at start-up again
+void unpin_thread(void);
+
+// Moves the pages overlapping [addr, addr + len) to `node` and makes it
+// the preferred node for the range. Best effort: returns false if the
+// kernel refused or the topology is emulated
+bool place_on_node(void *addr, size_t len, uint32_t node);
+
+#endif  // TOPOLOGY_H
@@ -0,0 +1,163 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#define _GNU_SOURCE  // For `syscall`
+#include <pthread.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "./utils.h"
+#include "./trace.h"
+
+#define TRACE_ARGS_SIZE 128
+
+struct trace_event_s {
+  const char *name;
+  uint64_t start_ns;
+  uint64_t end_ns;
+  char args[TRACE_ARGS_SIZE];
+};
+
+// The events of one thread. Only that thread appends to it; the buffers
+// are read at exit, after the workers have been joined
+struct trace_buffer_s {
+  pid_t tid;
+  uint32_t count;
+  uint32_t capacity;
+  uint64_t dropped;
+  struct trace_event_s *events;
+  struct trace_buffer_s *next;
+};
+
+// Caps the memory one thread may use for events
+#define TRACE_MAX_EVENTS (1u << 20)
+
+static pthread_mutex_t buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_buffer_s *buffers = NULL;
+static __thread struct trace_buffer_s *thread_buffer = NULL;
+
+static void write_trace(void) {
+  const char *fname = getenv("ROTATE_TRACE");
+  if (fname == NULL) {
+    fname = "rotate_trace.json";
+  }
+  FILE *f = fopen(fname, "w");
+  if (!f) {
+    perror("Error writing trace");
+    return;
+  }
+
+  // Timestamps are relative to the earliest event
+  uint64_t origin = UINT64_MAX;
+  struct trace_buffer_s *b;
+  for (b = buffers; b != NULL; b = b->next) {
+    if (b->count > 0 && b->events[0].start_ns < origin) {
+      origin = b->events[0].start_ns;
+    }
+  }
+
+  fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  bool first = true;
+  for (b = buffers; b != NULL; b = b->next) {
+    uint32_t i;
+    for (i = 0; i < b->count; i++) {
+      const struct trace_event_s *e = &b->events[i];
+      fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+              "\"ts\":%.3f,\"dur\":%.3f,\"args\":%s}",
+              first ? "" : ",\n", e->name, (int)getpid(), (int)b->tid,
+              (e->start_ns - origin) / 1000.0, (e->end_ns - e->start_ns) / 1000.0,
+              e->args[0] ? e->args : "{}");
+      first = false;
+    }
+    if (b->dropped > 0) {
+      fprintf(stderr, "Trace: thread %d dropped %lu events\n", (int)b->tid,
+              (unsigned long)b->dropped);
+    }
+  }
+  fprintf(f, "\n]}\n");
+  fclose(f);
+}
+
+static struct trace_buffer_s *get_thread_buffer(void) {
+  if (thread_buffer != NULL) {
+    return thread_buffer;
+  }
+
+  struct trace_buffer_s *b = calloc(1, sizeof(*b));
+  if (!b) {
+    return NULL;
+  }
+  b->tid = syscall(SYS_gettid);
+
+  pthread_mutex_lock(&buffers_lock);
+  if (buffers == NULL) {
+    atexit(write_trace);
+  }
+  b->next = buffers;
+  buffers = b;
+  pthread_mutex_unlock(&buffers_lock);
+
+  return thread_buffer = b;
+}
+
+void trace_record(const char *name, uint64_t start_ns, uint64_t end_ns,
+                  const char *args) {
+  struct trace_buffer_s *b = get_thread_buffer();
+  if (!b) {
+    return;
+  }
+
+  if (b->count == b->capacity) {
+    uint32_t capacity = b->capacity ? 2 * b->capacity : 1024;
+    struct trace_event_s *grown = capacity <= TRACE_MAX_EVENTS ?
+        realloc(b->events, capacity * sizeof(*grown)) : NULL;
+    if (!grown) {
+      b->dropped++;
+      return;
+    }
+    b->events = grown;
+    b->capacity = capacity;
+  }
+
+  struct trace_event_s *e = &b->events[b->count++];
+  e->name = name;
+  e->start_ns = start_ns;
+  e->end_ns = end_ns;
+  e->args[0] = '\0';
+  if (args != NULL) {
+    snprintf(e->args, sizeof(e->args), "%s", args);
+  }
+}
+
+void trace_phases_record(const char *name, const struct trace_phases_s *phases,
+                         uint64_t first, uint64_t end) {
+  char args[TRACE_ARGS_SIZE];
+  snprintf(args, sizeof(args),
+           "{\"first_cycle\":%lu,\"end_cycle\":%lu,\"gather_us\":%.1f,\"kernel_us\":%.1f,"
+           "\"scatter_us\":%.1f}",
+           (unsigned long)first, (unsigned long)end,
+           phases->ns[TRACE_GATHER] / 1000.0, phases->ns[TRACE_KERNEL] / 1000.0,
+           phases->ns[TRACE_SCATTER] / 1000.0);
+  trace_record(name, phases->start, trace_now(), args);
+}
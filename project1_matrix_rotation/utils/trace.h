@@ -0,0 +1,94 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "./utils.h"
+
+// Phase-level tracing of the rotation pipeline, compiled in with
+// `make TRACE=1`. Spans are kept in per-thread buffers and written at exit
+// as Chrome trace JSON (load it in chrome://tracing or ui.perfetto.dev) to
+// the file named by the ROTATE_TRACE environment variable, or to
+// rotate_trace.json. In normal builds every call below compiles to nothing
+#ifdef TRACE
+#define TRACE_ENABLED 1
+#else
+#define TRACE_ENABLED 0
+#endif
+
+// Appends a span that ran from `start_ns` to `end_ns` on the calling
+// thread. `args` is a JSON object with extra details, or NULL
+void trace_record(const char *name, uint64_t start_ns, uint64_t end_ns,
+                  const char *args);
+
+static inline uint64_t trace_now(void) {
+  if (!TRACE_ENABLED) {
+    return 0;
+  }
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Records a span named `name` from `start_ns` until now
+static inline void trace_span(const char *name, uint64_t start_ns) {
+  if (TRACE_ENABLED) {
+    trace_record(name, start_ns, trace_now(), NULL);
+  }
+}
+
+// Time spent in each phase of a batch of block cycles. Individual cycles
+// are too short to trace one by one, so the phases are summed per batch
+enum trace_phase_e {TRACE_GATHER, TRACE_KERNEL, TRACE_SCATTER, TRACE_NPHASES};
+
+struct trace_phases_s {
+  uint64_t start;
+  uint64_t mark;
+  uint64_t ns[TRACE_NPHASES];
+};
+
+static inline void trace_phases_start(struct trace_phases_s *phases) {
+  if (TRACE_ENABLED) {
+    *phases = (struct trace_phases_s){.start = trace_now()};
+    phases->mark = phases->start;
+  }
+}
+
+// Charges the time since the end of the previous phase to `phase`
+static inline void trace_phase_end(struct trace_phases_s *phases,
+                                   enum trace_phase_e phase) {
+  if (TRACE_ENABLED) {
+    uint64_t now = trace_now();
+    phases->ns[phase] += now - phases->mark;
+    phases->mark = now;
+  }
+}
+
+// Records the batch of block cycles [first, end) as one span, with the
+// per-phase totals as arguments
+void trace_phases_record(const char *name, const struct trace_phases_s *phases,
+                         uint64_t first, uint64_t end);
+
+#endif  // TRACE_H
@@ -21,6 +21,7 @@
  **/
 
 #include "./utils.h"
+#include "./parallel.h"
 #include <string.h>
 
 // Calculates the number of bytes required to hold `nbits` bits
@@ -83,6 +84,54 @@ void print_bit_matrix(uint8_t *bit_matrix, const bits_t N, int32_t ncolumns) {
   return;
 }
 
+// The seed for `generate_bit_matrix`, once `seed_bit_matrix_generator` is called
+static bool generator_seeded = false;
+static uint64_t generator_seed;
+
+void seed_bit_matrix_generator(uint64_t seed) {
+  generator_seeded = true;
+  generator_seed = seed;
+}
+
+// The SplitMix64 output function. Word `i` of a matrix is the mix of
+// `seed + (i + 1) * gamma`, so any chunk can be filled without the
+// words before it
+static inline uint64_t splitmix64(uint64_t seed, uint64_t i) {
+  uint64_t z = seed + (i + 1) * 0x9E3779B97F4A7C15ull;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+struct fill_s {
+  uint64_t *words;
+  uint64_t nwords;
+  uint64_t seed;
+};
+
+static void fill_worker(void *arg, uint32_t tid, uint32_t nthreads) {
+  struct fill_s *fill = arg;
+  uint64_t first = fill->nwords * tid / nthreads;
+  uint64_t last = fill->nwords * (tid + 1) / nthreads;
+
+  uint64_t i;
+  for (i = first; i < last; i++) {
+    fill->words[i] = splitmix64(fill->seed, i);
+  }
+}
+
+// Fills an `N` by `N` bit matrix from `seed` with `nthreads` threads. The
+// result depends only on `seed` and `N`, never on the number of threads
+void fill_bit_matrix(uint8_t *bit_matrix, const bits_t N, uint64_t seed,
+                     uint32_t nthreads) {
+  struct fill_s fill = {
+    .words = (uint64_t *)bit_matrix,
+    .nwords = bits_to_bytes(N) * N / 8,
+    .seed = seed,
+  };
+  run_parallel(nthreads, fill_worker, &fill);
+}
+
 uint8_t *generate_bit_matrix(const bits_t N, bool suppress_error) {
   // Sanity check the input
   assert(N > 0);
@@ -98,18 +147,20 @@ uint8_t *generate_bit_matrix(const bits_t N, bool suppress_error) {
     return NULL;
   }
 
-  uint64_t i;
-  uint64_t* pt = (uint64_t *)ret;
-  
-  // seed the rand function with a random seed
-  srand(time(0));
-  uint64_t scrambled = (((uint64_t) rand()) << 32) | rand();
-  for (i = 0; i < (nbytes * N / 8); i++) {
-     *(pt + i) = scrambled;
-     scrambled = scrambled*(2*scrambled + 1);
-     scrambled = scrambled*(2*scrambled + 1);
-     scrambled = (scrambled << 32) | (scrambled >> 32);
+  // Without an explicit seed, seed from the clock
+  uint64_t seed = generator_seed;
+  if (!generator_seeded) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    seed = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+  }
+  // At least one block-row of 64 rows per thread, so small test matrices
+  // are filled without starting a thread per CPU
+  uint32_t nthreads = available_cpus();
+  if (nthreads > N / 64) {
+    nthreads = N / 64;
   }
+  fill_bit_matrix(ret, N, seed, nthreads);
 
   return ret;
 }
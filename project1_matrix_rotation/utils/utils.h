@@ -42,6 +42,11 @@ void set_bit(uint8_t *img, const bytes_t row_size, uint32_t i, uint32_t j, uint8
 
 void print_bit_matrix(uint8_t *bit_matrix, const bits_t N, int32_t subportion);
 
+void seed_bit_matrix_generator(uint64_t seed);
+
+void fill_bit_matrix(uint8_t *bit_matrix, const bits_t N, uint64_t seed,
+                     uint32_t nthreads);
+
 uint8_t *generate_bit_matrix(const bits_t N, bool suppress_error);
 
 uint8_t *copy_bit_matrix(uint8_t *bit_matrix, const bits_t N);
@@ -0,0 +1,33 @@
+#!/bin/sh
+# Times each broad phase on every scene in input/ and checks that they all
+# report the same collisions as the first one.
+#
+# Usage: ./bench_broad_phases.sh [numFrames] [broadphase ...]
+# Set SCREENSAVER to benchmark a different binary (e.g. screensaver.prof).
+
+frames=${1:-500}
+[ $# -gt 0 ] && shift
+phases=${*:-"quadtree incremental grid sap bvh"}
+binary=${SCREENSAVER:-./screensaver}
+status=0
+
+printf "%-16s %-12s %10s %8s %10s\n" scene broadphase seconds walls lines
+for scene in input/*.in; do
+  reference=""
+  for phase in $phases; do
+    output=$("$binary" -b "$phase" "$frames" "$scene") || exit 1
+    seconds=$(echo "$output" | sed -n 's/^Elapsed execution time: \(.*\)s$/\1/p')
+    walls=$(echo "$output" | sed -n 's/^\([0-9]*\) Line-Wall Collisions$/\1/p')
+    lines=$(echo "$output" | sed -n 's/^\([0-9]*\) Line-Line Collisions$/\1/p')
+    note=""
+    if [ -z "$reference" ]; then
+      reference="$walls $lines"
+    elif [ "$reference" != "$walls $lines" ]; then
+      note="  MISMATCH"
+      status=1
+    fi
+    printf "%-16s %-12s %10s %8s %10s%s\n" "$(basename "$scene")" "$phase" \
+      "$seconds" "$walls" "$lines" "$note"
+  done
+done
+exit $status
@@ -0,0 +1,146 @@
+/**
+ * broad_phase.c -- pluggable broad phases for line-line detection
+ * Copyright (c) 2012-2019 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#include "./broad_phase.h"
+
+#include <assert.h>
+#include <cilk/cilk.h>
+#include <cilk/cilk_api.h>
+#include <string.h>
+
+#include "./bvh.h"
+#include "./collision_world.h"
+#include "./intersection_detection.h"
+#include "./incremental_quadtree.h"
+#include "./intersection_filter.h"
+#include "./quadtree.h"
+#include "./sweep_prune.h"
+#include "./uniform_grid.h"
+
+// number of candidates handed to the batched filter at a time
+#define FILTER_CHUNK 64
+
+static const BroadPhase* const broad_phases[] = {
+  &QuadTree_broadPhase,
+  &UniformGrid_broadPhase,
+  &SweepPrune_broadPhase,
+  &IncrementalQuadTree_broadPhase,
+  &Bvh_broadPhase,
+};
+
+// most Cilk workers that can record candidates
+#define MAX_WORKERS 256
+
+// candidates recorded by each worker since the last collection; a worker
+// only ever appends to its own list, so no locking or merging is needed
+// until the broad phase is done, and each list sits on its own cache line
+static struct {
+  IntersectionEventList list;
+} __attribute__((aligned(64))) worker_candidates[MAX_WORKERS];
+
+const BroadPhase* BroadPhase_default() {
+  return broad_phases[0];
+}
+
+const BroadPhase* BroadPhase_get(int index) {
+  if (index < 0 || index >= sizeof(broad_phases) / sizeof(broad_phases[0])) {
+    return NULL;
+  }
+  return broad_phases[index];
+}
+
+const BroadPhase* BroadPhase_find(const char* name) {
+  for (int i = 0; BroadPhase_get(i) != NULL; i++) {
+    if (strcmp(BroadPhase_get(i)->name, name) == 0) {
+      return BroadPhase_get(i);
+    }
+  }
+  return NULL;
+}
+
+#ifndef NDEBUG
+// assert that every candidate the filter dropped is really non-intersecting
+static void check_rejected(CollisionWorld* collisionWorld, unsigned int id,
+                           const unsigned int* candidates, int count,
+                           const unsigned int* survivors, int num_survivors) {
+  int s = 0;
+  for (int k = 0; k < count; k++) {
+    if (s < num_survivors && survivors[s] == candidates[k]) {
+      s++;
+      continue;
+    }
+    Line line1 = CollisionWorld_loadLine(collisionWorld, min(id, candidates[k]));
+    Line line2 = CollisionWorld_loadLine(collisionWorld, max(id, candidates[k]));
+    assert(collisionWorld->narrowPhase->intersect(&line1, &line2,
+                                                  collisionWorld->timeStep)
+           == NO_INTERSECTION);
+  }
+}
+#endif
+
+void BroadPhase_addCandidates(CollisionWorld* collisionWorld,
+                              unsigned int id,
+                              const unsigned int* candidates, int count) {
+  // nothing is spawned below, so the calling worker cannot change
+  int worker = __cilkrts_get_worker_number();
+  assert(worker >= 0 && worker < MAX_WORKERS);
+  IntersectionEventList* list = &worker_candidates[worker].list;
+
+  unsigned int survivors[FILTER_CHUNK];
+  for (int k = 0; k < count; k += FILTER_CHUNK) {
+    int num_candidates = min(FILTER_CHUNK, count - k);
+    int num_survivors = IntersectionFilter_batch(
+        collisionWorld, id, candidates + k, num_candidates, survivors);
+#ifndef NDEBUG
+    check_rejected(collisionWorld, id, candidates + k, num_candidates,
+                   survivors, num_survivors);
+#endif
+    for (int s = 0; s < num_survivors; s++) {
+      IntersectionEventList_append(list, min(id, survivors[s]),
+                                   max(id, survivors[s]), NO_INTERSECTION);
+    }
+  }
+}
+
+int BroadPhase_collectCandidates(IntersectionEventList* candidate_pairs) {
+  int num_workers = min(__cilkrts_get_nworkers(), MAX_WORKERS);
+  int offsets[MAX_WORKERS];
+  int num_candidates = 0;
+  for (int w = 0; w < num_workers; w++) {
+    offsets[w] = candidate_pairs->size + num_candidates;
+    num_candidates += worker_candidates[w].list.size;
+  }
+  IntersectionEventList_reserve(candidate_pairs,
+                                candidate_pairs->size + num_candidates);
+
+  cilk_for(int w = 0; w < num_workers; w++) {
+    IntersectionEventList* list = &worker_candidates[w].list;
+    if (list->size > 0) {
+      memcpy(candidate_pairs->events + offsets[w], list->events,
+             list->size * sizeof(IntersectionEvent));
+      IntersectionEventList_clear(list);
+    }
+  }
+  candidate_pairs->size += num_candidates;
+  return num_candidates;
+}
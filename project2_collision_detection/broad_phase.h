@@ -0,0 +1,67 @@
+/**
+ * broad_phase.h -- pluggable broad phases for line-line detection
+ * Copyright (c) 2012-2019 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef BROADPHASE_H_
+#define BROADPHASE_H_
+
+#include "./intersection_event_list.h"
+
+struct CollisionWorld;
+
+// A broad phase finds the pairs of lines whose swept rectangles may overlap
+// and passes them to BroadPhase_addCandidates, which keeps the pairs that
+// survive the intersection filter.  Each pair may be passed at most once a
+// frame.  The narrow phase runs later, over all of a frame's candidates at
+// once (see narrow_phase.h).
+struct BroadPhase {
+  // Name used to select the broad phase on the command line.
+  const char* name;
+
+  // Appends this frame's candidate pairs, with id1 < id2 and no intersection
+  // type yet, to candidate_pairs and returns how many were appended.  Called
+  // after the rectangles are updated.
+  int (*detect)(struct CollisionWorld* collisionWorld,
+                IntersectionEventList* candidate_pairs);
+};
+typedef struct BroadPhase BroadPhase;
+
+// Returns the broad phase used unless another is selected.
+const BroadPhase* BroadPhase_default();
+
+// Returns the index-th registered broad phase, or NULL past the end.
+const BroadPhase* BroadPhase_get(int index);
+
+// Returns the broad phase with the given name, or NULL if there is none.
+const BroadPhase* BroadPhase_find(const char* name);
+
+// Filters count candidate lines against line id and records the pairs that
+// survive as candidates.  May be called in parallel.
+void BroadPhase_addCandidates(struct CollisionWorld* collisionWorld,
+                              unsigned int id,
+                              const unsigned int* candidates, int count);
+
+// Moves the candidates recorded since the last call into candidate_pairs and
+// returns how many there were.
+int BroadPhase_collectCandidates(IntersectionEventList* candidate_pairs);
+
+#endif  // BROADPHASE_H_
@@ -0,0 +1,328 @@
+/**
+ * bvh.c -- bounding volume hierarchy broad phase refit from frame to frame
+ * Copyright (c) 2012-2019 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#include "./bvh.h"
+
+#include <assert.h>
+#include <cilk/cilk.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "./grow.h"
+#include "./line.h"
+
+// subtrees over more lines than this are refit and traversed in parallel
+#define BVH_SPAWN_LINES 256
+
+// a node covers the lines bvh.ids[first .. first + count); internal nodes
+// have two children, leaves have left == 0 (the root is never a child)
+typedef struct {
+  vec_dimension xmin;
+  vec_dimension xmax;
+  vec_dimension ymin;
+  vec_dimension ymax;
+  unsigned int first;
+  unsigned int count;
+  unsigned int left;
+  unsigned int right;
+} BvhNode;
+
+// state kept from frame to frame
+static struct {
+  const CollisionWorld* world;
+  unsigned int num_lines;
+  unsigned int capacity;
+  // line ids in Morton order
+  unsigned int* ids;
+  // Morton code of each line, by id, and of each entry of ids
+  uint32_t* codes;
+  uint32_t* sorted_codes;
+  BvhNode* nodes;
+  unsigned int num_nodes;
+  // total internal perimeter right after the last build
+  double built_cost;
+} bvh;
+
+// spreads the low 16 bits of v out to the even bits
+static inline uint32_t spread_bits(uint32_t v) {
+  v &= 0x0000ffff;
+  v = (v | (v << 8)) & 0x00ff00ff;
+  v = (v | (v << 4)) & 0x0f0f0f0f;
+  v = (v | (v << 2)) & 0x33333333;
+  v = (v | (v << 1)) & 0x55555555;
+  return v;
+}
+
+// quantizes a coordinate to 16 bits across the box, clamping lines that
+// stray outside it
+static inline uint32_t quantize(vec_dimension v, vec_dimension lo,
+                                vec_dimension hi) {
+  vec_dimension f = (v - lo) / (hi - lo) * 65536;
+  if (f < 0) {
+    return 0;
+  }
+  if (f >= 65535) {
+    return 65535;
+  }
+  return (uint32_t) f;
+}
+
+// a degenerate line sorts to the end of the order
+static inline uint32_t morton_code(const CollisionWorld* collisionWorld,
+                                   unsigned int id) {
+  if (CollisionWorld_isDegenerate(collisionWorld, id)) {
+    return UINT32_MAX;
+  }
+  vec_dimension cx = (collisionWorld->rectXmin[id]
+                      + collisionWorld->rectXmax[id]) / 2;
+  vec_dimension cy = (collisionWorld->rectYmin[id]
+                      + collisionWorld->rectYmax[id]) / 2;
+  return spread_bits(quantize(cx, BOX_XMIN, BOX_XMAX))
+         | (spread_bits(quantize(cy, BOX_YMIN, BOX_YMAX)) << 1);
+}
+
+static int compare_codes(const void* a, const void* b) {
+  unsigned int id1 = *(const unsigned int*) a;
+  unsigned int id2 = *(const unsigned int*) b;
+  if (bvh.codes[id1] != bvh.codes[id2]) {
+    return bvh.codes[id1] < bvh.codes[id2] ? -1 : 1;
+  }
+  return (id1 > id2) - (id1 < id2);
+}
+
+// finds where to split a range: at the first line whose code differs from
+// the first line's in the highest bit that varies over the range, or in the
+// middle if every code is the same
+static unsigned int find_split(unsigned int first, unsigned int count) {
+  unsigned int last = first + count - 1;
+  uint32_t diff = bvh.sorted_codes[first] ^ bvh.sorted_codes[last];
+  if (diff == 0) {
+    return first + count / 2;
+  }
+  uint32_t mask = (uint32_t) 1 << (31 - __builtin_clz(diff));
+  unsigned int lo = first;
+  unsigned int hi = last;
+  while (lo < hi) {
+    unsigned int mid = lo + (hi - lo) / 2;
+    if (bvh.sorted_codes[mid] & mask) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return lo;
+}
+
+// builds the subtree over a range of bvh.ids and returns its root
+static unsigned int build_node(unsigned int first, unsigned int count) {
+  unsigned int index = bvh.num_nodes++;
+  bvh.nodes[index].first = first;
+  bvh.nodes[index].count = count;
+  bvh.nodes[index].left = 0;
+  bvh.nodes[index].right = 0;
+  if (count <= BVH_LEAF_SIZE) {
+    return index;
+  }
+  unsigned int split = find_split(first, count);
+  unsigned int left = build_node(first, split - first);
+  unsigned int right = build_node(split, first + count - split);
+  bvh.nodes[index].left = left;
+  bvh.nodes[index].right = right;
+  return index;
+}
+
+// recomputes the boxes of a subtree from this frame's rectangles and returns
+// the total perimeter of its internal nodes
+static double refit(const CollisionWorld* collisionWorld, unsigned int index) {
+  BvhNode* node = &bvh.nodes[index];
+  if (node->left == 0) {
+    // fmin and fmax skip NaN lines, and an empty box overlaps nothing
+    vec_dimension xmin = INFINITY;
+    vec_dimension xmax = -INFINITY;
+    vec_dimension ymin = INFINITY;
+    vec_dimension ymax = -INFINITY;
+    for (unsigned int k = node->first; k < node->first + node->count; k++) {
+      unsigned int id = bvh.ids[k];
+      xmin = fmin(xmin, collisionWorld->rectXmin[id]);
+      xmax = fmax(xmax, collisionWorld->rectXmax[id]);
+      ymin = fmin(ymin, collisionWorld->rectYmin[id]);
+      ymax = fmax(ymax, collisionWorld->rectYmax[id]);
+    }
+    node->xmin = xmin;
+    node->xmax = xmax;
+    node->ymin = ymin;
+    node->ymax = ymax;
+    return 0;
+  }
+
+  double left_cost;
+  double right_cost;
+  if (node->count > BVH_SPAWN_LINES) {
+    left_cost = cilk_spawn refit(collisionWorld, node->left);
+    right_cost = refit(collisionWorld, node->right);
+    cilk_sync;
+  } else {
+    left_cost = refit(collisionWorld, node->left);
+    right_cost = refit(collisionWorld, node->right);
+  }
+
+  const BvhNode* left = &bvh.nodes[node->left];
+  const BvhNode* right = &bvh.nodes[node->right];
+  node->xmin = fmin(left->xmin, right->xmin);
+  node->xmax = fmax(left->xmax, right->xmax);
+  node->ymin = fmin(left->ymin, right->ymin);
+  node->ymax = fmax(left->ymax, right->ymax);
+
+  double perimeter = (node->xmax - node->xmin) + (node->ymax - node->ymin);
+  return left_cost + right_cost + (isfinite(perimeter) ? perimeter : 0);
+}
+
+// sorts the lines by Morton code and builds a fresh tree over them
+static void rebuild(const CollisionWorld* collisionWorld) {
+  unsigned int n = collisionWorld->numOfLines;
+  if (bvh.capacity < n) {
+    bvh.capacity = n;
+    bvh.ids = grow(bvh.ids, n, sizeof(unsigned int));
+    bvh.codes = grow(bvh.codes, n, sizeof(uint32_t));
+    bvh.sorted_codes = grow(bvh.sorted_codes, n, sizeof(uint32_t));
+    // a binary tree with at most n leaves
+    bvh.nodes = grow(bvh.nodes, 2 * n, sizeof(BvhNode));
+  }
+  bvh.world = collisionWorld;
+  bvh.num_lines = n;
+
+  cilk_for(unsigned int id = 0; id < n; id++) {
+    bvh.codes[id] = morton_code(collisionWorld, id);
+    bvh.ids[id] = id;
+  }
+  qsort(bvh.ids, n, sizeof(unsigned int), compare_codes);
+  cilk_for(unsigned int k = 0; k < n; k++) {
+    bvh.sorted_codes[k] = bvh.codes[bvh.ids[k]];
+  }
+
+  bvh.num_nodes = 0;
+  build_node(0, n);
+  bvh.built_cost = refit(collisionWorld, 0);
+}
+
+// brings the tree up to date with this frame's rectangles
+static void update_tree(const CollisionWorld* collisionWorld) {
+  if (bvh.world != collisionWorld
+      || bvh.num_lines != collisionWorld->numOfLines) {
+    rebuild(collisionWorld);
+    return;
+  }
+  double cost = refit(collisionWorld, 0);
+  if (cost > BVH_REBUILD_RATIO * bvh.built_cost) {
+    rebuild(collisionWorld);
+  }
+}
+
+static inline bool boxes_overlap(const BvhNode* a, const BvhNode* b) {
+  return a->xmin <= b->xmax && b->xmin <= a->xmax
+         && a->ymin <= b->ymax && b->ymin <= a->ymax;
+}
+
+// checks every pair of lines within a leaf
+static void check_leaf(CollisionWorld* collisionWorld, const BvhNode* leaf) {
+  unsigned int end = leaf->first + leaf->count;
+  for (unsigned int k = leaf->first; k < end; k++) {
+    BroadPhase_addCandidates(collisionWorld, bvh.ids[k], bvh.ids + k + 1,
+                             end - k - 1);
+  }
+}
+
+// checks every line of one leaf against every line of another
+static void check_leaves(CollisionWorld* collisionWorld, const BvhNode* a,
+                         const BvhNode* b) {
+  for (unsigned int k = a->first; k < a->first + a->count; k++) {
+    BroadPhase_addCandidates(collisionWorld, bvh.ids[k], bvh.ids + b->first,
+                             b->count);
+  }
+}
+
+// finds the pairs with one line under node a and the other under node b
+static void check_pair(CollisionWorld* collisionWorld, unsigned int a,
+                       unsigned int b) {
+  const BvhNode* node_a = &bvh.nodes[a];
+  const BvhNode* node_b = &bvh.nodes[b];
+  if (!boxes_overlap(node_a, node_b)) {
+    return;
+  }
+  if (node_a->left == 0 && node_b->left == 0) {
+    check_leaves(collisionWorld, node_a, node_b);
+    return;
+  }
+
+  // descend into the larger of the two
+  if (node_b->left == 0
+      || (node_a->left != 0 && node_a->count >= node_b->count)) {
+    unsigned int temp = a;
+    a = b;
+    b = temp;
+    node_b = &bvh.nodes[b];
+  }
+  if (bvh.nodes[a].count + node_b->count > BVH_SPAWN_LINES) {
+    cilk_spawn check_pair(collisionWorld, a, node_b->left);
+    check_pair(collisionWorld, a, node_b->right);
+    cilk_sync;
+  } else {
+    check_pair(collisionWorld, a, node_b->left);
+    check_pair(collisionWorld, a, node_b->right);
+  }
+}
+
+// finds the pairs with both lines under the given node
+static void check_self(CollisionWorld* collisionWorld, unsigned int index) {
+  const BvhNode* node = &bvh.nodes[index];
+  if (node->left == 0) {
+    check_leaf(collisionWorld, node);
+    return;
+  }
+  if (node->count > BVH_SPAWN_LINES) {
+    cilk_spawn check_self(collisionWorld, node->left);
+    cilk_spawn check_self(collisionWorld, node->right);
+    check_pair(collisionWorld, node->left, node->right);
+    cilk_sync;
+  } else {
+    check_self(collisionWorld, node->left);
+    check_self(collisionWorld, node->right);
+    check_pair(collisionWorld, node->left, node->right);
+  }
+}
+
+int Bvh_detect(CollisionWorld* collisionWorld,
+               IntersectionEventList* candidate_pairs) {
+  if (collisionWorld->numOfLines > 0) {
+    update_tree(collisionWorld);
+    check_self(collisionWorld, 0);
+  }
+  return BroadPhase_collectCandidates(candidate_pairs);
+}
+
+const BroadPhase Bvh_broadPhase = {
+  .name = "bvh",
+  .detect = Bvh_detect,
+};
@@ -0,0 +1,49 @@
+/**
+ * bvh.h -- bounding volume hierarchy broad phase refit from frame to frame
+ * Copyright (c) 2012-2019 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef BVH_H_
+#define BVH_H_
+
+#include "./broad_phase.h"
+#include "./collision_world.h"
+#include "./intersection_event_list.h"
+
+// most lines held by a leaf
+#define BVH_LEAF_SIZE 8
+// the tree is rebuilt once the total perimeter of its internal nodes has
+// grown by this factor since the last build
+#define BVH_REBUILD_RATIO 1.5
+
+// Keeps a binary tree of bounding boxes over the swept rectangles.  The tree
+// is built over the lines sorted by the Morton code of their rectangle
+// centers, splitting each range where the codes first differ.  On later
+// frames only the boxes are refit bottom-up.  The tree is rebuilt when the
+// refit boxes have grown too loose, as measured by their total perimeter.
+// The pairs are found by traversing the tree against itself in parallel.
+int Bvh_detect(CollisionWorld* collisionWorld,
+               IntersectionEventList* candidate_pairs);
+
+// The BVH as a selectable broad phase.
+extern const BroadPhase Bvh_broadPhase;
+
+#endif  // BVH_H_
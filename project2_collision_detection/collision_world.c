@@ -28,11 +28,41 @@
 #include <assert.h>
 #include <stdio.h>
 #include <cilk/cilk.h>
+#include <cilk/reducer_opadd.h>
 
+#include "./broad_phase.h"
+#include "./fasttime.h"
+#include "./grow.h"
 #include "./intersection_detection.h"
 #include "./intersection_event_list.h"
+#include "./narrow_phase.h"
 #include "./rect.h"
-#include "./quadtree.h"
+
+// Lines advanced by one strand of CollisionWorld_advanceLines.
+#define ADVANCE_CHUNK 1024
+// Frames with fewer events than this are solved serially.
+#define SOLVER_PARALLEL_EVENTS 512
+
+// Scratch space for solving events in conflict-free batches, reused from
+// frame to frame.
+static struct {
+  // The batch after the last one that touched each line; all zero between
+  // frames.
+  unsigned int* line_batch;
+  unsigned int line_capacity;
+  // The batch of each event, and the events grouped by batch.
+  unsigned int* event_batch;
+  IntersectionEvent* batched;
+  // Batch b is batched[batch_starts[b] .. batch_starts[b + 1]).
+  unsigned int* batch_starts;
+  int event_capacity;
+} solver;
+
+// Allocates a 64-byte aligned array of capacity elements of the given size.
+static void* alloc_line_array(const unsigned int capacity, size_t size) {
+  size_t bytes = ((capacity * size + 63) / 64) * 64;
+  return aligned_alloc(64, bytes);
+}
 
 CollisionWorld* CollisionWorld_new(const unsigned int capacity) {
   assert(capacity > 0);
@@ -45,16 +75,44 @@ CollisionWorld* CollisionWorld_new(const unsigned int capacity) {
   collisionWorld->numLineWallCollisions = 0;
   collisionWorld->numLineLineCollisions = 0;
   collisionWorld->timeStep = 0.5;
-  collisionWorld->lines = malloc(capacity * sizeof(Line*));
+  collisionWorld->p1x = alloc_line_array(capacity, sizeof(vec_dimension));
+  collisionWorld->p1y = alloc_line_array(capacity, sizeof(vec_dimension));
+  collisionWorld->p2x = alloc_line_array(capacity, sizeof(vec_dimension));
+  collisionWorld->p2y = alloc_line_array(capacity, sizeof(vec_dimension));
+  collisionWorld->vx = alloc_line_array(capacity, sizeof(vec_dimension));
+  collisionWorld->vy = alloc_line_array(capacity, sizeof(vec_dimension));
+  collisionWorld->rectXmin = alloc_line_array(capacity, sizeof(vec_dimension));
+  collisionWorld->rectXmax = alloc_line_array(capacity, sizeof(vec_dimension));
+  collisionWorld->rectYmin = alloc_line_array(capacity, sizeof(vec_dimension));
+  collisionWorld->rectYmax = alloc_line_array(capacity, sizeof(vec_dimension));
+  collisionWorld->colors = alloc_line_array(capacity, sizeof(Color));
+  collisionWorld->lineIds = alloc_line_array(capacity, sizeof(unsigned int));
   collisionWorld->numOfLines = 0;
+  collisionWorld->capacity = capacity;
+  collisionWorld->broadPhase = BroadPhase_default();
+  collisionWorld->narrowPhase = NarrowPhase_default();
+  collisionWorld->candidates = IntersectionEventList_make();
+  collisionWorld->events = IntersectionEventList_make();
+  collisionWorld->stats = (DetectionStats) {0};
+  collisionWorld->rectanglesCurrent = false;
   return collisionWorld;
 }
 
 void CollisionWorld_delete(CollisionWorld* collisionWorld) {
-  for (int i = 0; i < collisionWorld->numOfLines; i++) {
-    free(collisionWorld->lines[i]);
-  }
-  free(collisionWorld->lines);
+  free(collisionWorld->p1x);
+  free(collisionWorld->p1y);
+  free(collisionWorld->p2x);
+  free(collisionWorld->p2y);
+  free(collisionWorld->vx);
+  free(collisionWorld->vy);
+  free(collisionWorld->rectXmin);
+  free(collisionWorld->rectXmax);
+  free(collisionWorld->rectYmin);
+  free(collisionWorld->rectYmax);
+  free(collisionWorld->colors);
+  free(collisionWorld->lineIds);
+  IntersectionEventList_destroy(&collisionWorld->candidates);
+  IntersectionEventList_destroy(&collisionWorld->events);
   free(collisionWorld);
 }
 
@@ -62,62 +120,175 @@ unsigned int CollisionWorld_getNumOfLines(CollisionWorld* collisionWorld) {
   return collisionWorld->numOfLines;
 }
 
-void CollisionWorld_addLine(CollisionWorld* collisionWorld, Line *line) {
-  collisionWorld->lines[collisionWorld->numOfLines] = line;
+void CollisionWorld_addLine(CollisionWorld* collisionWorld, const Line *line) {
+  unsigned int id = collisionWorld->numOfLines;
+  assert(id < collisionWorld->capacity);
+  assert(line->id == id);
+
+  collisionWorld->p1x[id] = line->p1.x;
+  collisionWorld->p1y[id] = line->p1.y;
+  collisionWorld->p2x[id] = line->p2.x;
+  collisionWorld->p2y[id] = line->p2.y;
+  collisionWorld->vx[id] = line->velocity.x;
+  collisionWorld->vy[id] = line->velocity.y;
+  collisionWorld->colors[id] = line->color;
+  collisionWorld->lineIds[id] = id;
   collisionWorld->numOfLines++;
+  collisionWorld->rectanglesCurrent = false;
 }
 
-Line* CollisionWorld_getLine(CollisionWorld* collisionWorld,
-                             const unsigned int index) {
-  if (index >= collisionWorld->numOfLines) {
-    return NULL;
-  }
-  return collisionWorld->lines[index];
+void CollisionWorld_setBroadPhase(CollisionWorld* collisionWorld,
+                                  const BroadPhase* broadPhase) {
+  collisionWorld->broadPhase = broadPhase;
+}
+
+void CollisionWorld_setNarrowPhase(CollisionWorld* collisionWorld,
+                                   const NarrowPhase* narrowPhase) {
+  collisionWorld->narrowPhase = narrowPhase;
+}
+
+Line CollisionWorld_getLine(CollisionWorld* collisionWorld,
+                            const unsigned int index) {
+  assert(index < collisionWorld->numOfLines);
+  return CollisionWorld_loadLine(collisionWorld, index);
+}
+
+// Computes the bounding rectangle of a line's sweep over one time step.
+static inline void sweep_rectangle(
+    vec_dimension p1x, vec_dimension p1y, vec_dimension p2x,
+    vec_dimension p2y, vec_dimension vx, vec_dimension vy, double t,
+    vec_dimension* xmin, vec_dimension* xmax, vec_dimension* ymin,
+    vec_dimension* ymax) {
+  // endpoints at the end of the time step
+  vec_dimension p3x = p1x + vx * t;
+  vec_dimension p3y = p1y + vy * t;
+  vec_dimension p4x = p2x + vx * t;
+  vec_dimension p4y = p2y + vy * t;
+
+  *xmax = max(max(p1x, p2x), max(p3x, p4x));
+  *xmin = min(min(p1x, p2x), min(p3x, p4x));
+  *ymax = max(max(p1y, p2y), max(p3y, p4y));
+  *ymin = min(min(p1y, p2y), min(p3y, p4y));
 }
 
 void CollisionWorld_updateLines(CollisionWorld* collisionWorld) {
-  CollisionWorld_updateRectangles(collisionWorld);
+  if (!collisionWorld->rectanglesCurrent) {
+    CollisionWorld_updateRectangles(collisionWorld);
+  }
   CollisionWorld_detectIntersection(collisionWorld);
-  CollisionWorld_updatePosition(collisionWorld);
-  CollisionWorld_lineWallCollision(collisionWorld);
+  CollisionWorld_advanceLines(collisionWorld);
+}
+
+// Advances lines [start, end) as described for CollisionWorld_advanceLines
+// and returns how many of them hit a wall.  The arrays are passed as
+// restrict parameters, and the function is kept out of line so they stay
+// restrict, which is what lets the compiler vectorize the loop.
+static __attribute__((noinline)) unsigned int advance_range(
+    vec_dimension* restrict p1x, vec_dimension* restrict p1y,
+    vec_dimension* restrict p2x, vec_dimension* restrict p2y,
+    vec_dimension* restrict vx, vec_dimension* restrict vy,
+    vec_dimension* restrict rectXmin, vec_dimension* restrict rectXmax,
+    vec_dimension* restrict rectYmin, vec_dimension* restrict rectYmax,
+    double t, unsigned int start, unsigned int end) {
+  unsigned int wall_collisions = 0;
+
+  // the same steps as CollisionWorld_updatePosition,
+  // CollisionWorld_lineWallCollision and CollisionWorld_updateRectangles,
+  // written without branches so the loop vectorizes; multiplying by -1 is an
+  // exact negation
+  for (unsigned int i = start; i < end; i++) {
+    vec_dimension x1 = p1x[i] + vx[i] * t;
+    vec_dimension y1 = p1y[i] + vy[i] * t;
+    vec_dimension x2 = p2x[i] + vx[i] * t;
+    vec_dimension y2 = p2y[i] + vy[i] * t;
+    vec_dimension v_x = vx[i];
+    vec_dimension v_y = vy[i];
+
+    bool right = ((x1 > BOX_XMAX) | (x2 > BOX_XMAX)) & (v_x > 0);
+    v_x *= right ? -1.0 : 1.0;
+    bool left = ((x1 < BOX_XMIN) | (x2 < BOX_XMIN)) & (v_x < 0);
+    v_x *= left ? -1.0 : 1.0;
+    bool top = ((y1 > BOX_YMAX) | (y2 > BOX_YMAX)) & (v_y > 0);
+    v_y *= top ? -1.0 : 1.0;
+    bool bottom = ((y1 < BOX_YMIN) | (y2 < BOX_YMIN)) & (v_y < 0);
+    v_y *= bottom ? -1.0 : 1.0;
+    wall_collisions += right | left | top | bottom;
+
+    p1x[i] = x1;
+    p1y[i] = y1;
+    p2x[i] = x2;
+    p2y[i] = y2;
+    vx[i] = v_x;
+    vy[i] = v_y;
+    sweep_rectangle(x1, y1, x2, y2, v_x, v_y, t, &rectXmin[i], &rectXmax[i],
+                    &rectYmin[i], &rectYmax[i]);
+  }
+  return wall_collisions;
+}
+
+void CollisionWorld_advanceLines(CollisionWorld* collisionWorld) {
+  unsigned int n = collisionWorld->numOfLines;
+  CILK_C_REDUCER_OPADD(wall_collisions, uint, 0);
+  CILK_C_REGISTER_REDUCER(wall_collisions);
+  cilk_for(unsigned int start = 0; start < n; start += ADVANCE_CHUNK) {
+    REDUCER_VIEW(wall_collisions) += advance_range(
+        collisionWorld->p1x, collisionWorld->p1y, collisionWorld->p2x,
+        collisionWorld->p2y, collisionWorld->vx, collisionWorld->vy,
+        collisionWorld->rectXmin, collisionWorld->rectXmax,
+        collisionWorld->rectYmin, collisionWorld->rectYmax,
+        collisionWorld->timeStep, start, min(start + ADVANCE_CHUNK, n));
+  }
+  CILK_C_UNREGISTER_REDUCER(wall_collisions);
+
+  collisionWorld->numLineWallCollisions += wall_collisions.value;
+  collisionWorld->rectanglesCurrent = true;
 }
 
 void CollisionWorld_updatePosition(CollisionWorld* collisionWorld) {
   double t = collisionWorld->timeStep;
+  vec_dimension* restrict p1x = collisionWorld->p1x;
+  vec_dimension* restrict p1y = collisionWorld->p1y;
+  vec_dimension* restrict p2x = collisionWorld->p2x;
+  vec_dimension* restrict p2y = collisionWorld->p2y;
+  const vec_dimension* restrict vx = collisionWorld->vx;
+  const vec_dimension* restrict vy = collisionWorld->vy;
   for (int i = 0; i < collisionWorld->numOfLines; i++) {
-    Line *line = collisionWorld->lines[i];
-    line->p1 = Vec_add(line->p1, Vec_multiply(line->velocity, t));
-    line->p2 = Vec_add(line->p2, Vec_multiply(line->velocity, t));
+    p1x[i] = p1x[i] + vx[i] * t;
+    p1y[i] = p1y[i] + vy[i] * t;
+    p2x[i] = p2x[i] + vx[i] * t;
+    p2y[i] = p2y[i] + vy[i] * t;
   }
+  collisionWorld->rectanglesCurrent = false;
 }
 
 void CollisionWorld_lineWallCollision(CollisionWorld* collisionWorld) {
+  const vec_dimension* p1x = collisionWorld->p1x;
+  const vec_dimension* p1y = collisionWorld->p1y;
+  const vec_dimension* p2x = collisionWorld->p2x;
+  const vec_dimension* p2y = collisionWorld->p2y;
+  vec_dimension* vx = collisionWorld->vx;
+  vec_dimension* vy = collisionWorld->vy;
   for (int i = 0; i < collisionWorld->numOfLines; i++) {
-    Line *line = collisionWorld->lines[i];
     bool collide = false;
 
     // Right side
-    if ((line->p1.x > BOX_XMAX || line->p2.x > BOX_XMAX)
-        && (line->velocity.x > 0)) {
-      line->velocity.x = -line->velocity.x;
+    if ((p1x[i] > BOX_XMAX || p2x[i] > BOX_XMAX) && (vx[i] > 0)) {
+      vx[i] = -vx[i];
       collide = true;
     }
     // Left side
-    if ((line->p1.x < BOX_XMIN || line->p2.x < BOX_XMIN)
-        && (line->velocity.x < 0)) {
-      line->velocity.x = -line->velocity.x;
+    if ((p1x[i] < BOX_XMIN || p2x[i] < BOX_XMIN) && (vx[i] < 0)) {
+      vx[i] = -vx[i];
       collide = true;
     }
     // Top side
-    if ((line->p1.y > BOX_YMAX || line->p2.y > BOX_YMAX)
-        && (line->velocity.y > 0)) {
-      line->velocity.y = -line->velocity.y;
+    if ((p1y[i] > BOX_YMAX || p2y[i] > BOX_YMAX) && (vy[i] > 0)) {
+      vy[i] = -vy[i];
       collide = true;
     }
     // Bottom side
-    if ((line->p1.y < BOX_YMIN || line->p2.y < BOX_YMIN)
-        && (line->velocity.y < 0)) {
-      line->velocity.y = -line->velocity.y;
+    if ((p1y[i] < BOX_YMIN || p2y[i] < BOX_YMIN) && (vy[i] < 0)) {
+      vy[i] = -vy[i];
       collide = true;
     }
     // Update total number of collisions.
@@ -125,53 +296,138 @@ void CollisionWorld_lineWallCollision(CollisionWorld* collisionWorld) {
       collisionWorld->numLineWallCollisions++;
     }
   }
+  collisionWorld->rectanglesCurrent = false;
 }
 
 void CollisionWorld_updateRectangles(CollisionWorld* collisionWorld) {
   double t = collisionWorld->timeStep;
+  const vec_dimension* restrict p1x = collisionWorld->p1x;
+  const vec_dimension* restrict p1y = collisionWorld->p1y;
+  const vec_dimension* restrict p2x = collisionWorld->p2x;
+  const vec_dimension* restrict p2y = collisionWorld->p2y;
+  const vec_dimension* restrict vx = collisionWorld->vx;
+  const vec_dimension* restrict vy = collisionWorld->vy;
+  vec_dimension* restrict rectXmin = collisionWorld->rectXmin;
+  vec_dimension* restrict rectXmax = collisionWorld->rectXmax;
+  vec_dimension* restrict rectYmin = collisionWorld->rectYmin;
+  vec_dimension* restrict rectYmax = collisionWorld->rectYmax;
   for (int i = 0; i < collisionWorld->numOfLines; i++) {
-    Line *line = collisionWorld->lines[i];
-    line->rectangle = Rect_makeFromLine(line, t);
-  }
-}
-
-// Original sorting method on IntersectionEventList
-void sort_IntersectionEventList(IntersectionEventNode* startNode){
-  while (startNode != NULL) {
-    IntersectionEventNode* minNode = startNode;
-    IntersectionEventNode* curNode = startNode->next;
-    while (curNode != NULL) {
-      if (IntersectionEventNode_compareData(curNode, minNode) < 0) {
-        minNode = curNode;
-      }
-      curNode = curNode->next;
-    }
-    if (minNode != startNode) {
-      IntersectionEventNode_swapData(minNode, startNode);
-    }
-    startNode = startNode->next;
+    sweep_rectangle(p1x[i], p1y[i], p2x[i], p2y[i], vx[i], vy[i], t,
+                    &rectXmin[i], &rectXmax[i], &rectYmin[i], &rectYmax[i]);
   }
+  collisionWorld->rectanglesCurrent = true;
 }
 
 void CollisionWorld_detectIntersection(CollisionWorld* collisionWorld) {
-  IntersectionEventList intersectionEventList = IntersectionEventList_make();
-  int new_collisions = detect_intersections_with_quadtree(collisionWorld, &intersectionEventList);
+  IntersectionEventList* candidates = &collisionWorld->candidates;
+  IntersectionEventList* events = &collisionWorld->events;
+  DetectionStats* stats = &collisionWorld->stats;
+  IntersectionEventList_clear(candidates);
+  IntersectionEventList_clear(events);
+
+  fasttime_t start = gettime();
+  stats->candidates += collisionWorld->broadPhase->detect(collisionWorld,
+                                                          candidates);
+  fasttime_t broad_phase_done = gettime();
+
+  // The candidates stay in the order the broad phase found them, which keeps
+  // each line's candidates together.  Sorting them cost more than it saved,
+  // so only the much shorter list of events is sorted.
+  int new_collisions = NarrowPhase_run(collisionWorld, candidates, events);
   collisionWorld->numLineLineCollisions += new_collisions;
 
-  // Sort the intersection event list.
-  IntersectionEventNode* startNode = intersectionEventList.head;
-  sort_IntersectionEventList(startNode);
+  // Sort the intersection events by (id1, id2).
+  IntersectionEventList_sort(events);
+  fasttime_t narrow_phase_done = gettime();
 
   // Call the collision solver for each intersection event.
-  IntersectionEventNode* curNode = intersectionEventList.head;
+  if (events->size < SOLVER_PARALLEL_EVENTS) {
+    for (int i = 0; i < events->size; i++) {
+      CollisionWorld_collisionSolver(collisionWorld, events->events[i].id1,
+                                     events->events[i].id2,
+                                     events->events[i].intersectionType);
+    }
+  } else {
+    CollisionWorld_solveInBatches(collisionWorld, events);
+  }
+  fasttime_t solver_done = gettime();
 
-  while (curNode != NULL) {
-    CollisionWorld_collisionSolver(collisionWorld, curNode->l1, curNode->l2,
-                                   curNode->intersectionType);
-    curNode = curNode->next;
+  stats->broadPhaseSeconds += tdiff(start, broad_phase_done);
+  stats->narrowPhaseSeconds += tdiff(broad_phase_done, narrow_phase_done);
+  stats->solverSeconds += tdiff(narrow_phase_done, solver_done);
+}
+
+void CollisionWorld_solveInBatches(CollisionWorld* collisionWorld,
+                                   const IntersectionEventList* events) {
+  int num_events = events->size;
+  if (solver.line_capacity < collisionWorld->numOfLines) {
+    unsigned int old_capacity = solver.line_capacity;
+    solver.line_capacity = collisionWorld->numOfLines;
+    solver.line_batch = grow(solver.line_batch, solver.line_capacity,
+                             sizeof(unsigned int));
+    for (unsigned int id = old_capacity; id < solver.line_capacity; id++) {
+      solver.line_batch[id] = 0;
+    }
+  }
+  if (solver.event_capacity < num_events) {
+    solver.event_capacity = num_events;
+    solver.event_batch = grow(solver.event_batch, num_events,
+                              sizeof(unsigned int));
+    solver.batched = grow(solver.batched, num_events,
+                          sizeof(IntersectionEvent));
+    solver.batch_starts = grow(solver.batch_starts, num_events + 1,
+                               sizeof(unsigned int));
+  }
+
+  // Greedily put each event in the batch after the last one that touched
+  // either of its lines.  No line then appears twice in a batch, and the
+  // events of each line keep their sorted order.
+  unsigned int num_batches = 0;
+  for (int i = 0; i < num_events; i++) {
+    unsigned int id1 = events->events[i].id1;
+    unsigned int id2 = events->events[i].id2;
+    unsigned int batch = max(solver.line_batch[id1], solver.line_batch[id2]);
+    solver.event_batch[i] = batch;
+    solver.line_batch[id1] = batch + 1;
+    solver.line_batch[id2] = batch + 1;
+    num_batches = max(num_batches, batch + 1);
+  }
+  for (int i = 0; i < num_events; i++) {
+    solver.line_batch[events->events[i].id1] = 0;
+    solver.line_batch[events->events[i].id2] = 0;
   }
 
-  IntersectionEventList_deleteNodes(&intersectionEventList);
+  // Group the events by batch with a stable counting sort.
+  for (unsigned int b = 0; b <= num_batches; b++) {
+    solver.batch_starts[b] = 0;
+  }
+  for (int i = 0; i < num_events; i++) {
+    solver.batch_starts[solver.event_batch[i] + 1]++;
+  }
+  for (unsigned int b = 0; b < num_batches; b++) {
+    solver.batch_starts[b + 1] += solver.batch_starts[b];
+  }
+  for (int i = 0; i < num_events; i++) {
+    solver.batched[solver.batch_starts[solver.event_batch[i]]++] =
+        events->events[i];
+  }
+  // The scatter advanced each start to the start of the next batch.
+  for (unsigned int b = num_batches; b > 0; b--) {
+    solver.batch_starts[b] = solver.batch_starts[b - 1];
+  }
+  solver.batch_starts[0] = 0;
+
+  // The events of a batch touch disjoint lines, so they can be solved in
+  // any order.  Every line still sees its events in sorted order, so the
+  // velocities are bit-identical to solving the events one by one.
+  for (unsigned int b = 0; b < num_batches; b++) {
+    cilk_for(unsigned int k = solver.batch_starts[b];
+             k < solver.batch_starts[b + 1]; k++) {
+      CollisionWorld_collisionSolver(collisionWorld, solver.batched[k].id1,
+                                     solver.batched[k].id2,
+                                     solver.batched[k].intersectionType);
+    }
+  }
 }
 
 unsigned int CollisionWorld_getNumLineWallCollisions(
@@ -184,14 +440,33 @@ unsigned int CollisionWorld_getNumLineLineCollisions(
   return collisionWorld->numLineLineCollisions;
 }
 
+const DetectionStats* CollisionWorld_getDetectionStats(
+    CollisionWorld* collisionWorld) {
+  return &collisionWorld->stats;
+}
+
+// Scatter the solved velocities of l1 and l2 back into the world.
+static inline void CollisionWorld_storeVelocities(
+    CollisionWorld* collisionWorld, const Line *l1, const Line *l2) {
+  collisionWorld->vx[l1->id] = l1->velocity.x;
+  collisionWorld->vy[l1->id] = l1->velocity.y;
+  collisionWorld->vx[l2->id] = l2->velocity.x;
+  collisionWorld->vy[l2->id] = l2->velocity.y;
+}
+
 void CollisionWorld_collisionSolver(CollisionWorld* collisionWorld,
-                                    Line *l1, Line *l2,
+                                    unsigned int id1, unsigned int id2,
                                     IntersectionType intersectionType) {
-  assert(compareLines(l1, l2) < 0);
+  assert(id1 < id2);
   assert(intersectionType == L1_WITH_L2
          || intersectionType == L2_WITH_L1
          || intersectionType == ALREADY_INTERSECTED);
 
+  Line line1 = CollisionWorld_loadLine(collisionWorld, id1);
+  Line line2 = CollisionWorld_loadLine(collisionWorld, id2);
+  Line *l1 = &line1;
+  Line *l2 = &line2;
+
   // Despite our efforts to determine whether lines will intersect ahead
   // of time (and to modify their velocities appropriately), our
   // simplified model can sometimes cause lines to intersect.  In such a
@@ -217,6 +492,7 @@ void CollisionWorld_collisionSolver(CollisionWorld* collisionWorld,
       l2->velocity = Vec_multiply(Vec_normalize(Vec_subtract(l2->p1, p)),
                                   Vec_length(l2->velocity));
     }
+    CollisionWorld_storeVelocities(collisionWorld, l1, l2);
     return;
   }
 
@@ -257,5 +533,6 @@ void CollisionWorld_collisionSolver(CollisionWorld* collisionWorld,
   l2->velocity = Vec_add(Vec_multiply(normal, newV2Normal),
                          Vec_multiply(face, v2Face));
 
+  CollisionWorld_storeVelocities(collisionWorld, l1, l2);
   return;
 }
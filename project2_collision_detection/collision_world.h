@@ -26,15 +26,64 @@
 
 #include "./line.h"
 #include "./intersection_detection.h"
+#include "./broad_phase.h"
+#include "./intersection_event_list.h"
+#include "./narrow_phase.h"
+
+// Time spent in each stage of line-line detection and the pairs that went
+// through it, summed over all frames.
+struct DetectionStats {
+  double broadPhaseSeconds;
+  double narrowPhaseSeconds;
+  double solverSeconds;
+  // Pairs the broad phase passed on after filtering.
+  unsigned long long candidates;
+};
+typedef struct DetectionStats DetectionStats;
 
 struct CollisionWorld {
   // Time step used for simulation
   double timeStep;
 
-  // Container that holds all the lines as an array of Line* lines.
-  // This CollisionWorld owns the Line* lines.
-  Line** lines;
+  // Per-line state, stored as structure-of-arrays indexed by line id so the
+  // per-frame passes stream through contiguous memory.  Every array is
+  // 64-byte aligned and holds capacity entries.
+  vec_dimension* p1x;
+  vec_dimension* p1y;
+  vec_dimension* p2x;
+  vec_dimension* p2y;
+  vec_dimension* vx;
+  vec_dimension* vy;
+
+  // Bounding rectangle of each line's sweep over the current time step.
+  vec_dimension* rectXmin;
+  vec_dimension* rectXmax;
+  vec_dimension* rectYmin;
+  vec_dimension* rectYmax;
+
+  // Whether the rectangles match the current positions and velocities.
+  bool rectanglesCurrent;
+
+  Color* colors;
+
+  // Line ids, reordered in place by the broad phase.
+  unsigned int* lineIds;
+
   unsigned int numOfLines;
+  unsigned int capacity;
+
+  // Broad phase used to find candidate pairs for line-line detection.
+  const BroadPhase* broadPhase;
+
+  // Line-line test run on the candidate pairs.
+  const NarrowPhase* narrowPhase;
+
+  // Candidate pairs and line-line events of the current frame; the buffers
+  // are reused.
+  IntersectionEventList candidates;
+  IntersectionEventList events;
+
+  DetectionStats stats;
 
   // Record the total number of line-wall collisions.
   unsigned int numLineWallCollisions;
@@ -51,13 +100,43 @@ void CollisionWorld_delete(CollisionWorld* collisionWorld);
 // Return the total number of lines in the box.
 unsigned int CollisionWorld_getNumOfLines(CollisionWorld* collisionWorld);
 
-// Add a line into the box.  Must be under capacity.
-// This CollisionWorld becomes owner of the Line* line.
-void CollisionWorld_addLine(CollisionWorld* collisionWorld, Line *line);
-
-// Get a line from box.
-Line* CollisionWorld_getLine(CollisionWorld* collisionWorld,
-                             const unsigned int index);
+// Add a line into the box.  Must be under capacity, and line->id must equal
+// the number of lines already added.  The line is copied into the world.
+void CollisionWorld_addLine(CollisionWorld* collisionWorld, const Line *line);
+
+// Select the broad phase used by CollisionWorld_detectIntersection.
+void CollisionWorld_setBroadPhase(CollisionWorld* collisionWorld,
+                                  const BroadPhase* broadPhase);
+
+// Select the line-line test run on the broad phase's candidate pairs.
+void CollisionWorld_setNarrowPhase(CollisionWorld* collisionWorld,
+                                   const NarrowPhase* narrowPhase);
+
+// Get a copy of a line from box.
+Line CollisionWorld_getLine(CollisionWorld* collisionWorld,
+                            const unsigned int index);
+
+// Gather line id from the structure-of-arrays storage.
+static inline Line CollisionWorld_loadLine(const CollisionWorld* collisionWorld,
+                                           const unsigned int id) {
+  Line line;
+  line.p1 = Vec_make(collisionWorld->p1x[id], collisionWorld->p1y[id]);
+  line.p2 = Vec_make(collisionWorld->p2x[id], collisionWorld->p2y[id]);
+  line.velocity = Vec_make(collisionWorld->vx[id], collisionWorld->vy[id]);
+  line.color = collisionWorld->colors[id];
+  line.id = id;
+  return line;
+}
+
+// Whether line id has degenerated: its coordinates have become NaN, so some
+// bound of its swept rectangle is NaN.  Every comparison intersect() makes
+// with a NaN is false, so such a line is never reported, and the broad
+// phases may leave it out entirely.  Valid once the rectangles are updated.
+static inline bool CollisionWorld_isDegenerate(
+    const CollisionWorld* collisionWorld, const unsigned int id) {
+  return !(collisionWorld->rectXmin[id] <= collisionWorld->rectXmax[id]
+           && collisionWorld->rectYmin[id] <= collisionWorld->rectYmax[id]);
+}
 
 // Update lines' situation in the box.
 void CollisionWorld_updateLines(CollisionWorld* collisionWorld);
@@ -68,12 +147,24 @@ void CollisionWorld_updatePosition(CollisionWorld* collisionWorld);
 // Handle line-wall collision.
 void CollisionWorld_lineWallCollision(CollisionWorld* collisionWorld);
 
+// Update positions, handle line-wall collisions and compute the rectangles
+// for the next time step, all in one parallel pass over the lines.
+void CollisionWorld_advanceLines(CollisionWorld* collisionWorld);
+
 // Update rectangles for lines before other updates.
 void CollisionWorld_updateRectangles(CollisionWorld* collisionWorld);
 
-// Detect line-line intersection.
+// Detect line-line intersection in stages: the broad phase collects
+// candidate pairs into a buffer, the narrow phase classifies them in
+// parallel, and the solver handles the resulting events in (id1, id2) order.
 void CollisionWorld_detectIntersection(CollisionWorld* collisionWorld);
 
+// Solve the events, which must be sorted by (id1, id2), in parallel batches
+// of events that share no line, with the same result as solving them in
+// order.
+void CollisionWorld_solveInBatches(CollisionWorld* collisionWorld,
+                                   const IntersectionEventList* events);
+
 // Get total number of line-wall collisions.
 unsigned int CollisionWorld_getNumLineWallCollisions(
     CollisionWorld* collisionWorld);
@@ -82,10 +173,14 @@ unsigned int CollisionWorld_getNumLineWallCollisions(
 unsigned int CollisionWorld_getNumLineLineCollisions(
     CollisionWorld* collisionWorld);
 
+// Get the per-stage time and pair counts of line-line detection.
+const DetectionStats* CollisionWorld_getDetectionStats(
+    CollisionWorld* collisionWorld);
+
 // Update the two lines based on their intersection event.
-// Precondition: compareLines(l1, l2) < 0 must be true.
-void CollisionWorld_collisionSolver(CollisionWorld* collisionWorld, Line *l1,
-                                    Line *l2,
+// Precondition: id1 < id2 must be true.
+void CollisionWorld_collisionSolver(CollisionWorld* collisionWorld,
+                                    unsigned int id1, unsigned int id2,
                                     IntersectionType intersectionType);
 
 #endif  // COLLISIONWORLD_H_
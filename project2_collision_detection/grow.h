@@ -0,0 +1,43 @@
+/**
+ * grow.h -- buffers that grow or end the program
+ * Copyright (c) 2012-2019 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef GROW_H_
+#define GROW_H_
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Resizes buffer to hold count elements of size bytes each, like realloc.
+// The simulation cannot continue without its buffers, so running out of
+// memory ends the program.
+static inline void* grow(void* buffer, size_t count, size_t size) {
+  void* grown = realloc(buffer, count * size);
+  if (grown == NULL) {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+  return grown;
+}
+
+#endif  // GROW_H_
@@ -0,0 +1,411 @@
+/**
+ * incremental_quadtree.c -- quadtree maintained across frames
+ * Copyright (c) 2012-2019 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#include "./incremental_quadtree.h"
+
+#include <assert.h>
+#include <cilk/cilk.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "./grow.h"
+#include "./line.h"
+
+typedef struct {
+  int parent;       // -1 for the root
+  int first_child;  // first of four consecutive children, or -1 for a leaf
+  int depth;
+  bool alive;
+  bool merge_pending;
+
+  // strict bounds of the quadrant; infinite on the sides of the box, so that
+  // lines straying outside the box still have a home
+  vec_dimension xlo;
+  vec_dimension xhi;
+  vec_dimension ylo;
+  vec_dimension yhi;
+
+  // the quadrant's extent within the box, which fixes its split point
+  vec_dimension box_xmin;
+  vec_dimension box_xmax;
+  vec_dimension box_ymin;
+  vec_dimension box_ymax;
+
+  // lines stored at this node, and the number stored in its whole subtree
+  unsigned int* lines;
+  int num_lines;
+  int capacity;
+  int subtree_lines;
+} IncrementalNode;
+
+// the tree and the buffers it reuses from frame to frame
+static struct {
+  const CollisionWorld* world;
+  unsigned int num_lines;
+
+  IncrementalNode* nodes;
+  int num_nodes;
+  int node_capacity;
+  int* free_blocks;
+  int num_free_blocks;
+
+  unsigned int line_capacity;
+  int* node_of;
+  int* slot_of;
+  bool* misplaced;
+
+  int* merge_candidates;
+  int num_merge_candidates;
+  int merge_capacity;
+} tree;
+
+// whether the line's rectangle lies strictly inside the node's quadrant
+static inline bool node_fits(const CollisionWorld* collisionWorld, int n,
+                             unsigned int id) {
+  const IncrementalNode* node = &tree.nodes[n];
+  return collisionWorld->rectXmin[id] > node->xlo
+      && collisionWorld->rectXmax[id] < node->xhi
+      && collisionWorld->rectYmin[id] > node->ylo
+      && collisionWorld->rectYmax[id] < node->yhi;
+}
+
+// the child quadrant (0, 1, 2, 3) of node n strictly containing the line's
+// rectangle, or -1 if it straddles the split point
+static inline int child_quadrant(const CollisionWorld* collisionWorld, int n,
+                                 unsigned int id) {
+  const IncrementalNode* node = &tree.nodes[n];
+  vec_dimension mid_x = (node->box_xmin + node->box_xmax) / 2;
+  vec_dimension mid_y = (node->box_ymin + node->box_ymax) / 2;
+  int column;
+  if (collisionWorld->rectXmax[id] < mid_x) {
+    column = 0;
+  } else if (collisionWorld->rectXmin[id] > mid_x) {
+    column = 1;
+  } else {
+    return -1;
+  }
+  if (collisionWorld->rectYmax[id] < mid_y) {
+    return column;
+  } else if (collisionWorld->rectYmin[id] > mid_y) {
+    return 2 + column;
+  }
+  return -1;
+}
+
+// allocates a block of n_new consecutive nodes, reusing freed blocks of four
+static int alloc_nodes(int n_new) {
+  if (n_new == 4 && tree.num_free_blocks > 0) {
+    return tree.free_blocks[--tree.num_free_blocks];
+  }
+  if (tree.num_nodes + n_new > tree.node_capacity) {
+    int capacity = max(64, 2 * tree.node_capacity);
+    tree.nodes = grow(tree.nodes, capacity, sizeof(IncrementalNode));
+    tree.free_blocks = grow(tree.free_blocks, capacity / 4 + 1, sizeof(int));
+    for (int n = tree.node_capacity; n < capacity; n++) {
+      tree.nodes[n].lines = NULL;
+      tree.nodes[n].capacity = 0;
+      tree.nodes[n].alive = false;
+    }
+    tree.node_capacity = capacity;
+  }
+  int first = tree.num_nodes;
+  tree.num_nodes += n_new;
+  return first;
+}
+
+static void init_node(int n, int parent, int depth, vec_dimension xlo,
+                      vec_dimension xhi, vec_dimension ylo, vec_dimension yhi,
+                      vec_dimension box_xmin, vec_dimension box_xmax,
+                      vec_dimension box_ymin, vec_dimension box_ymax) {
+  IncrementalNode* node = &tree.nodes[n];
+  node->parent = parent;
+  node->first_child = -1;
+  node->depth = depth;
+  node->alive = true;
+  node->merge_pending = false;
+  node->xlo = xlo;
+  node->xhi = xhi;
+  node->ylo = ylo;
+  node->yhi = yhi;
+  node->box_xmin = box_xmin;
+  node->box_xmax = box_xmax;
+  node->box_ymin = box_ymin;
+  node->box_ymax = box_ymax;
+  node->num_lines = 0;
+  node->subtree_lines = 0;
+}
+
+static void node_add_line(int n, unsigned int id) {
+  IncrementalNode* node = &tree.nodes[n];
+  if (node->num_lines == node->capacity) {
+    node->capacity = max(8, 2 * node->capacity);
+    node->lines = grow(node->lines, node->capacity, sizeof(unsigned int));
+  }
+  tree.node_of[id] = n;
+  tree.slot_of[id] = node->num_lines;
+  node->lines[node->num_lines++] = id;
+}
+
+static void node_remove_line(unsigned int id) {
+  IncrementalNode* node = &tree.nodes[tree.node_of[id]];
+  int slot = tree.slot_of[id];
+  unsigned int last = node->lines[--node->num_lines];
+  node->lines[slot] = last;
+  tree.slot_of[last] = slot;
+}
+
+// adds delta to the subtree counts from node n up to the root, noting any
+// internal node that becomes small enough to merge
+static void adjust_counts(int n, int delta) {
+  for (; n >= 0; n = tree.nodes[n].parent) {
+    IncrementalNode* node = &tree.nodes[n];
+    node->subtree_lines += delta;
+    if (delta < 0 && node->first_child >= 0 && !node->merge_pending
+        && node->subtree_lines <= INCREMENTAL_MERGE_BIN) {
+      node->merge_pending = true;
+      if (tree.num_merge_candidates == tree.merge_capacity) {
+        tree.merge_capacity = max(16, 2 * tree.merge_capacity);
+        tree.merge_candidates = grow(tree.merge_candidates,
+                                     tree.merge_capacity, sizeof(int));
+      }
+      tree.merge_candidates[tree.num_merge_candidates++] = n;
+    }
+  }
+}
+
+// pushes the lines of leaf n down into four new children, splitting those in
+// turn if they overflow
+static void split(const CollisionWorld* collisionWorld, int n) {
+  int first = alloc_nodes(4);
+  IncrementalNode* node = &tree.nodes[n];
+  vec_dimension mid_x = (node->box_xmin + node->box_xmax) / 2;
+  vec_dimension mid_y = (node->box_ymin + node->box_ymax) / 2;
+  init_node(first, n, node->depth + 1, node->xlo, mid_x, node->ylo, mid_y,
+            node->box_xmin, mid_x, node->box_ymin, mid_y);
+  init_node(first + 1, n, node->depth + 1, mid_x, node->xhi, node->ylo, mid_y,
+            mid_x, node->box_xmax, node->box_ymin, mid_y);
+  init_node(first + 2, n, node->depth + 1, node->xlo, mid_x, mid_y, node->yhi,
+            node->box_xmin, mid_x, mid_y, node->box_ymax);
+  init_node(first + 3, n, node->depth + 1, mid_x, node->xhi, mid_y, node->yhi,
+            mid_x, node->box_xmax, mid_y, node->box_ymax);
+  node->first_child = first;
+
+  for (int s = node->num_lines - 1; s >= 0; s--) {
+    unsigned int id = node->lines[s];
+    int q = child_quadrant(collisionWorld, n, id);
+    if (q >= 0) {
+      node_remove_line(id);
+      node_add_line(first + q, id);
+      tree.nodes[first + q].subtree_lines++;
+    }
+  }
+
+  for (int q = 0; q < 4; q++) {
+    IncrementalNode* child = &tree.nodes[first + q];
+    if (child->num_lines > INCREMENTAL_MAX_BIN
+        && child->depth < INCREMENTAL_MAX_DEPTH) {
+      split(collisionWorld, first + q);
+    }
+  }
+}
+
+// pulls every line in the subtree of n into n and frees its descendants
+static void collect_subtree(int n, int target) {
+  IncrementalNode* node = &tree.nodes[n];
+  if (n != target) {
+    for (int s = node->num_lines - 1; s >= 0; s--) {
+      unsigned int id = node->lines[s];
+      node_remove_line(id);
+      node_add_line(target, id);
+    }
+  }
+  int first = tree.nodes[n].first_child;
+  if (first >= 0) {
+    for (int q = 0; q < 4; q++) {
+      collect_subtree(first + q, target);
+      tree.nodes[first + q].alive = false;
+    }
+    tree.free_blocks[tree.num_free_blocks++] = first;
+    tree.nodes[n].first_child = -1;
+  }
+}
+
+// places a line at the deepest node that should hold it, searching upwards
+// from node n first
+static void insert_line(const CollisionWorld* collisionWorld, int n,
+                        unsigned int id) {
+  while (tree.nodes[n].parent >= 0 && !node_fits(collisionWorld, n, id)) {
+    n = tree.nodes[n].parent;
+  }
+  int q;
+  while (tree.nodes[n].first_child >= 0
+         && (q = child_quadrant(collisionWorld, n, id)) >= 0) {
+    n = tree.nodes[n].first_child + q;
+  }
+  node_add_line(n, id);
+  adjust_counts(n, 1);
+  if (tree.nodes[n].first_child < 0
+      && tree.nodes[n].num_lines > INCREMENTAL_MAX_BIN
+      && tree.nodes[n].depth < INCREMENTAL_MAX_DEPTH) {
+    split(collisionWorld, n);
+  }
+}
+
+// whether line id still belongs in the node holding it
+static inline bool placement_valid(const CollisionWorld* collisionWorld,
+                                   unsigned int id) {
+  int n = tree.node_of[id];
+  if (tree.nodes[n].parent >= 0 && !node_fits(collisionWorld, n, id)) {
+    return false;
+  }
+  return tree.nodes[n].first_child < 0
+      || child_quadrant(collisionWorld, n, id) < 0;
+}
+
+static void rebuild(const CollisionWorld* collisionWorld) {
+  unsigned int n = collisionWorld->numOfLines;
+  if (tree.line_capacity < n) {
+    tree.line_capacity = n;
+    tree.node_of = grow(tree.node_of, n, sizeof(int));
+    tree.slot_of = grow(tree.slot_of, n, sizeof(int));
+    tree.misplaced = grow(tree.misplaced, n, sizeof(bool));
+  }
+  tree.world = collisionWorld;
+  tree.num_lines = n;
+
+  for (int i = 0; i < tree.num_nodes; i++) {
+    tree.nodes[i].alive = false;
+  }
+  tree.num_nodes = 0;
+  tree.num_free_blocks = 0;
+  int root = alloc_nodes(1);
+  init_node(root, -1, 0, -INFINITY, INFINITY, -INFINITY, INFINITY, BOX_XMIN,
+            BOX_XMAX, BOX_YMIN, BOX_YMAX);
+  for (unsigned int id = 0; id < n; id++) {
+    insert_line(collisionWorld, root, id);
+  }
+  tree.num_merge_candidates = 0;
+}
+
+static int compare_depths(const void* a, const void* b) {
+  return tree.nodes[*(const int*) a].depth - tree.nodes[*(const int*) b].depth;
+}
+
+// moves the lines that left their node and merges nodes that became small
+static void update(const CollisionWorld* collisionWorld) {
+  unsigned int n = collisionWorld->numOfLines;
+  cilk_for(unsigned int id = 0; id < n; id++) {
+    tree.misplaced[id] = !placement_valid(collisionWorld, id);
+  }
+
+  for (unsigned int id = 0; id < n; id++) {
+    if (tree.misplaced[id]) {
+      int from = tree.node_of[id];
+      node_remove_line(id);
+      adjust_counts(from, -1);
+      insert_line(collisionWorld, from, id);
+    }
+  }
+
+  // merge outermost nodes first; their descendants are then already gone
+  if (tree.num_merge_candidates > 1) {
+    qsort(tree.merge_candidates, tree.num_merge_candidates, sizeof(int),
+          compare_depths);
+  }
+  for (int c = 0; c < tree.num_merge_candidates; c++) {
+    int m = tree.merge_candidates[c];
+    IncrementalNode* node = &tree.nodes[m];
+    if (!node->alive) {
+      continue;
+    }
+    node->merge_pending = false;
+    if (node->first_child >= 0
+        && node->subtree_lines <= INCREMENTAL_MERGE_BIN) {
+      collect_subtree(m, m);
+    }
+  }
+  tree.num_merge_candidates = 0;
+}
+
+#ifndef NDEBUG
+// asserts that every line is where insert_line would put it and that the
+// subtree counts add up
+static int check_invariants(const CollisionWorld* collisionWorld, int n) {
+  const IncrementalNode* node = &tree.nodes[n];
+  assert(node->alive);
+  int count = node->num_lines;
+  for (int s = 0; s < node->num_lines; s++) {
+    unsigned int id = node->lines[s];
+    assert(tree.node_of[id] == n && tree.slot_of[id] == s);
+    assert(placement_valid(collisionWorld, id));
+  }
+  if (node->first_child >= 0) {
+    for (int q = 0; q < 4; q++) {
+      assert(tree.nodes[node->first_child + q].parent == n);
+      count += check_invariants(collisionWorld, node->first_child + q);
+    }
+  }
+  assert(count == node->subtree_lines);
+  return count;
+}
+#endif
+
+// checks the lines of node n against each other and against every ancestor
+static void check_node(CollisionWorld* collisionWorld, int n) {
+  const IncrementalNode* node = &tree.nodes[n];
+  const unsigned int* lines = node->lines;
+  int num_lines = node->num_lines;
+  cilk_for(int i = 0; i < num_lines; i++) {
+    BroadPhase_addCandidates(collisionWorld, lines[i], lines + i + 1,
+                             num_lines - i - 1);
+    for (int a = node->parent; a >= 0; a = tree.nodes[a].parent) {
+      BroadPhase_addCandidates(collisionWorld, lines[i], tree.nodes[a].lines,
+                               tree.nodes[a].num_lines);
+    }
+  }
+}
+
+int IncrementalQuadTree_detect(CollisionWorld* collisionWorld,
+                               IntersectionEventList* candidate_pairs) {
+  if (tree.world != collisionWorld
+      || tree.num_lines != collisionWorld->numOfLines) {
+    rebuild(collisionWorld);
+  } else {
+    update(collisionWorld);
+  }
+  assert(check_invariants(collisionWorld, 0) == collisionWorld->numOfLines);
+
+  cilk_for(int n = 0; n < tree.num_nodes; n++) {
+    if (tree.nodes[n].alive && tree.nodes[n].num_lines > 0) {
+      check_node(collisionWorld, n);
+    }
+  }
+  return BroadPhase_collectCandidates(candidate_pairs);
+}
+
+const BroadPhase IncrementalQuadTree_broadPhase = {
+  .name = "incremental",
+  .detect = IncrementalQuadTree_detect,
+};
@@ -0,0 +1,52 @@
+/**
+ * incremental_quadtree.h -- quadtree maintained across frames
+ * Copyright (c) 2012-2019 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef INCREMENTALQUADTREE_H_
+#define INCREMENTALQUADTREE_H_
+
+#include "./broad_phase.h"
+#include "./collision_world.h"
+#include "./intersection_event_list.h"
+
+// a leaf holding more lines than this is split
+#define INCREMENTAL_MAX_BIN 30
+// an internal node whose subtree holds this many lines or fewer is merged
+#define INCREMENTAL_MERGE_BIN (INCREMENTAL_MAX_BIN / 2)
+// nodes at this depth are never split
+#define INCREMENTAL_MAX_DEPTH 7
+
+// Keeps a quadtree over the swept rectangles from one frame to the next.
+// Each frame only the lines whose rectangle no longer belongs in their node
+// are moved.  A leaf splits when it holds more than INCREMENTAL_MAX_BIN lines,
+// and an internal node merges its subtree back into itself when that subtree
+// drops to INCREMENTAL_MERGE_BIN lines.  As with the rebuilt quadtree, a
+// line is stored at the deepest node whose quadrant strictly contains its
+// rectangle, and it is checked against the lines of its own node and of
+// every ancestor.
+int IncrementalQuadTree_detect(CollisionWorld* collisionWorld,
+                               IntersectionEventList* candidate_pairs);
+
+// The incremental quadtree as a selectable broad phase.
+extern const BroadPhase IncrementalQuadTree_broadPhase;
+
+#endif  // INCREMENTALQUADTREE_H_
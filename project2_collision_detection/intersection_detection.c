@@ -97,12 +97,124 @@ IntersectionType intersect(Line *l1, Line *l2, double time) {
   return L1_WITH_L2;
 }
 
+// Whether two sides have strictly opposite signs.
+static inline bool straddles(vec_dimension side1, vec_dimension side2) {
+  return (side1 > 0 && side2 < 0) || (side1 < 0 && side2 > 0);
+}
+
+// intersectLines(a, b, c, d), given the sides of a and b relative to cd and
+// the sides of c and d relative to ab.
+static inline bool segmentsIntersect(vec_dimension side_a,
+                                     vec_dimension side_b,
+                                     vec_dimension side_c,
+                                     vec_dimension side_d,
+                                     Vec a, Vec b, Vec c, Vec d) {
+  if (straddles(side_a, side_b) && straddles(side_c, side_d)) {
+    return true;
+  }
+  return (side_a == 0 && onSegment(c, d, a))
+      || (side_b == 0 && onSegment(c, d, b))
+      || (side_c == 0 && onSegment(a, b, c))
+      || (side_d == 0 && onSegment(a, b, d));
+}
+
+// Whether Vec_argument(a) < Vec_argument(b).  atan2 puts the lower half
+// plane in (-pi, 0) and the upper one in [0, pi]; within a half plane, b is
+// further counterclockwise exactly when a x b is positive.  Only for nearly
+// parallel vectors, where atan2's rounding decides, is atan2 called.
+static inline bool argumentLess(Vec a, Vec b) {
+  bool a_lower = a.y < 0;
+  bool b_lower = b.y < 0;
+  if (a_lower != b_lower) {
+    return a_lower;
+  }
+  double cross = (double) a.x * b.y - (double) a.y * b.x;
+  double scale = ((double) fabs(a.x) + fabs(a.y))
+      * ((double) fabs(b.x) + fabs(b.y));
+  if (fabs(cross) > 1e-12 * scale) {
+    return cross > 0;
+  }
+  return Vec_argument(a) < Vec_argument(b);
+}
+
+IntersectionType intersectShared(Line *l1, Line *l2, double time) {
+  assert(compareLines(l1, l2) < 0);
+
+  // In l1's frame l2 moves from q1 q2 to q1_end q2_end over the step.
+  Vec velocity = Vec_subtract(l2->velocity, l1->velocity);
+  Vec p1 = l1->p1;
+  Vec p2 = l1->p2;
+  Vec q1 = l2->p1;
+  Vec q2 = l2->p2;
+  Vec q1_end = Vec_add(q1, Vec_multiply(velocity, time));
+  Vec q2_end = Vec_add(q2, Vec_multiply(velocity, time));
+
+  // intersect() tests l1 against the four edges of the parallelogram l2
+  // sweeps, and the sides of l2's endpoints relative to l1 are the same in
+  // every test, so each is computed once.  Every side is the same
+  // direction() call intersect() makes, so exact contacts come out the same.
+  vec_dimension side_q1 = direction(p1, p2, q1);
+  vec_dimension side_q2 = direction(p1, p2, q2);
+  vec_dimension start_p1 = direction(q1, q2, p1);
+  vec_dimension start_p2 = direction(q1, q2, p2);
+  if (segmentsIntersect(start_p1, start_p2, side_q1, side_q2, p1, p2, q1,
+                        q2)) {
+    return ALREADY_INTERSECTED;
+  }
+
+  // l1's endpoints relative to l2's final position and to the paths of its
+  // endpoints; a path edge is crossed when an endpoint of l2 passes over l1
+  // during the step
+  vec_dimension side_q1_end = direction(p1, p2, q1_end);
+  vec_dimension side_q2_end = direction(p1, p2, q2_end);
+  vec_dimension end_p1 = direction(q1_end, q2_end, p1);
+  vec_dimension end_p2 = direction(q1_end, q2_end, p2);
+  bool top_intersected =
+      segmentsIntersect(direction(q1_end, q1, p1), direction(q1_end, q1, p2),
+                        side_q1_end, side_q1, p1, p2, q1_end, q1);
+  bool bottom_intersected =
+      segmentsIntersect(direction(q2_end, q2, p1), direction(q2_end, q2, p2),
+                        side_q2_end, side_q2, p1, p2, q2_end, q2);
+  int num_line_intersections =
+      segmentsIntersect(end_p1, end_p2, side_q1_end, side_q2_end, p1, p2,
+                        q1_end, q2_end)
+      + top_intersected + bottom_intersected;
+
+  if (num_line_intersections == 2) {
+    return L2_WITH_L1;
+  }
+
+  // both endpoints of l1 strictly inside the parallelogram, tested in the
+  // order pointInParallelogram() uses; the start and end sides are shared
+  if (straddles(start_p1, end_p1)
+      && straddles(direction(q1, q1_end, p1), direction(q2, q2_end, p1))
+      && straddles(start_p2, end_p2)
+      && straddles(direction(q1, q1_end, p2), direction(q2, q2_end, p2))) {
+    return L1_WITH_L2;
+  }
+
+  if (num_line_intersections == 0) {
+    return NO_INTERSECTION;
+  }
+
+  // intersect() compares the arguments of p1 - p2 of each line
+  Vec v1 = Vec_makeFromLine(*l1);
+  Vec v2 = Vec_makeFromLine(*l2);
+  if (top_intersected) {
+    return argumentLess(v1, v2) ? L2_WITH_L1 : L1_WITH_L2;
+  }
+  if (bottom_intersected) {
+    return argumentLess(v2, v1) ? L2_WITH_L1 : L1_WITH_L2;
+  }
+  return L1_WITH_L2;
+}
+
 // Check if a point is in the parallelogram.
 bool pointInParallelogram(Vec point, Vec p1, Vec p2, Vec p3, Vec p4) {
-  double d1 = direction(p1, p2, point);
-  double d2 = direction(p3, p4, point);
-  double d3 = direction(p1, p3, point);
-  double d4 = direction(p2, p4, point);
+  vec_dimension d1 = direction(p1, p2, point);
+  vec_dimension d2 = direction(p3, p4, point);
+  vec_dimension d3 = direction(p1, p3, point);
+  vec_dimension d4 = direction(p2, p4, point);
 
   if (((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0))
       && ((d3 > 0 && d4 < 0) || (d3 < 0 && d4 > 0))) {
@@ -114,10 +226,10 @@ bool pointInParallelogram(Vec point, Vec p1, Vec p2, Vec p3, Vec p4) {
 // Check if two lines intersect.
 bool intersectLines(Vec p1, Vec p2, Vec p3, Vec p4) {
   // Relative orientation
-  double d1 = direction(p3, p4, p1);
-  double d2 = direction(p3, p4, p2);
-  double d3 = direction(p1, p2, p3);
-  double d4 = direction(p1, p2, p4);
+  vec_dimension d1 = direction(p3, p4, p1);
+  vec_dimension d2 = direction(p3, p4, p2);
+  vec_dimension d3 = direction(p1, p2, p3);
+  vec_dimension d4 = direction(p1, p2, p4);
 
   // If (p1, p2) and (p3, p4) straddle each other, the line segments must
   // intersect.
@@ -151,7 +263,7 @@ Vec getIntersectionPoint(Vec p1, Vec p2, Vec p3, Vec p4) {
 }
 
 // Check the direction of two lines (pi, pj) and (pi, pk).
-double direction(Vec pi, Vec pj, Vec pk) {
+vec_dimension direction(Vec pi, Vec pj, Vec pk) {
   return crossProduct(pk.x - pi.x, pk.y - pi.y, pj.x - pi.x, pj.y - pi.y);
 }
 
@@ -166,7 +278,8 @@ bool onSegment(Vec pi, Vec pj, Vec pk) {
 }
 
 // Calculate the cross product.
-double crossProduct(double x1, double y1, double x2, double y2) {
+vec_dimension crossProduct(vec_dimension x1, vec_dimension y1,
+                           vec_dimension x2, vec_dimension y2) {
   return x1 * y2 - x2 * y1;
 }
 
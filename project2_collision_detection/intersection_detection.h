@@ -37,6 +37,15 @@ typedef enum {
 // Precondition: compareLines(l1, l2) < 0 must be true.
 IntersectionType intersect(Line *l1, Line *l2, double time);
 
+// Same classification as intersect(), with the work intersect() repeats
+// done once.  The sides of l2's endpoints relative to l1 are shared by all
+// four edge tests of the swept parallelogram, the sides of l1's endpoints
+// relative to l2 at the start and end of the step are shared with the
+// parallelogram containment test, and the atan2 comparison of the lines'
+// arguments becomes a half-plane and cross-product test.
+// Precondition: compareLines(l1, l2) < 0 must be true.
+IntersectionType intersectShared(Line *l1, Line *l2, double time);
+
 // Check if a point is in the parallelogram.
 bool pointInParallelogram(Vec point, Vec p1, Vec p2, Vec p3, Vec p4);
 
@@ -44,13 +53,14 @@ bool pointInParallelogram(Vec point, Vec p1, Vec p2, Vec p3, Vec p4);
 bool intersectLines(Vec p1, Vec p2, Vec p3, Vec p4);
 
 // Check the direction of two lines (pi, pj) and (pi, pk).
-double direction(Vec pi, Vec pj, Vec pk);
+vec_dimension direction(Vec pi, Vec pj, Vec pk);
 
 // Check if a point pk is in the line segment (pi, pj).
 bool onSegment(Vec pi, Vec pj, Vec pk);
 
 // Calculate the cross product.
-double crossProduct(double x1, double y1, double x2, double y2);
+vec_dimension crossProduct(vec_dimension x1, vec_dimension y1,
+                           vec_dimension x2, vec_dimension y2);
 
 // Obtain the intersection point for two intersecting line segments.
 Vec getIntersectionPoint(Vec p1, Vec p2, Vec p3, Vec p4);
@@ -23,122 +23,146 @@
 #include "./intersection_event_list.h"
 
 #include <assert.h>
+#include <cilk/cilk.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
-#include <string.h>
-
-int IntersectionEventNode_compareData(IntersectionEventNode* node1,
-                                      IntersectionEventNode* node2) {
-  if (compareLines(node1->l1, node2->l1) < 0) {
-    return -1;
-  } else if (compareLines(node1->l1, node2->l1) == 0) {
-    if (compareLines(node1->l2, node2->l2) < 0) {
-      return -1;
-    } else if (compareLines(node1->l2, node2->l2) == 0) {
-      return 0;
-    } else {
-      return 1;
-    }
-  } else {
-    return 1;
-  }
-}
 
-void IntersectionEventNode_swapData(IntersectionEventNode* node1,
-                                    IntersectionEventNode* node2) {
-  {
-    Line* temp = node1->l1;
-    node1->l1 = node2->l1;
-    node2->l1 = temp;
-  }
-  {
-    Line* temp = node1->l2;
-    node1->l2 = node2->l2;
-    node2->l2 = temp;
-  }
-  {
-    IntersectionType temp = node1->intersectionType;
-    node1->intersectionType = node2->intersectionType;
-    node2->intersectionType = temp;
-  }
+#include "./grow.h"
+
+// bits sorted per radix pass
+#define EVENT_RADIX_BITS 8
+#define EVENT_RADIX_SIZE (1 << EVENT_RADIX_BITS)
+// chunks of events counted independently by each pass
+#define EVENT_SORT_CHUNKS 8
+
+// the sort key: id1 in the high half, id2 in the low half
+static inline uint64_t event_key(const IntersectionEvent* event) {
+  return ((uint64_t) event->id1 << 32) | event->id2;
 }
 
 IntersectionEventList IntersectionEventList_make() {
   IntersectionEventList intersectionEventList;
-  intersectionEventList.head = NULL;
-  intersectionEventList.tail = NULL;
+  intersectionEventList.events = NULL;
   intersectionEventList.size = 0;
+  intersectionEventList.capacity = 0;
+  intersectionEventList.sortBuffer = NULL;
   return intersectionEventList;
 }
 
-void IntersectionEventList_appendNode(
-    IntersectionEventList* intersectionEventList, Line* l1, Line* l2,
-    IntersectionType intersectionType) {
-  assert(compareLines(l1, l2) < 0);
-
-  IntersectionEventNode* newNode = malloc(sizeof(IntersectionEventNode));
-  if (newNode == NULL) {
+void IntersectionEventList_reserve(
+    IntersectionEventList* intersectionEventList, int capacity) {
+  if (intersectionEventList->capacity >= capacity) {
     return;
   }
+  if (capacity < 2 * intersectionEventList->capacity) {
+    capacity = 2 * intersectionEventList->capacity;
+  }
+  intersectionEventList->events = grow(intersectionEventList->events,
+                                       capacity, sizeof(IntersectionEvent));
+  if (intersectionEventList->sortBuffer != NULL) {
+    intersectionEventList->sortBuffer =
+        grow(intersectionEventList->sortBuffer, capacity,
+             sizeof(IntersectionEvent));
+  }
+  intersectionEventList->capacity = capacity;
+}
 
-  newNode->l1 = l1;
-  newNode->l2 = l2;
-  newNode->intersectionType = intersectionType;
-  newNode->next = NULL;
-  if (intersectionEventList->head == NULL) {
-    intersectionEventList->head = newNode;
-  } else {
-    intersectionEventList->tail->next = newNode;
+void IntersectionEventList_append(
+    IntersectionEventList* intersectionEventList, unsigned int id1,
+    unsigned int id2, IntersectionType intersectionType) {
+  assert(id1 < id2);
+
+  if (intersectionEventList->size == intersectionEventList->capacity) {
+    IntersectionEventList_reserve(intersectionEventList,
+                                  intersectionEventList->size + 64);
   }
-  intersectionEventList->tail = newNode;
-  intersectionEventList->size++;
+  IntersectionEvent* event =
+      &intersectionEventList->events[intersectionEventList->size++];
+  event->id1 = id1;
+  event->id2 = id2;
+  event->intersectionType = intersectionType;
 }
 
-void IntersectionEventList_deleteNodes(
+void IntersectionEventList_clear(IntersectionEventList* intersectionEventList) {
+  intersectionEventList->size = 0;
+}
+
+void IntersectionEventList_destroy(
     IntersectionEventList* intersectionEventList) {
-  IntersectionEventNode* curNode = intersectionEventList->head;
-  IntersectionEventNode* nextNode = NULL;
-  while (curNode != NULL) {
-    nextNode = curNode->next;
-    free(curNode);
-    curNode = nextNode;
+  free(intersectionEventList->events);
+  free(intersectionEventList->sortBuffer);
+  *intersectionEventList = IntersectionEventList_make();
+}
+
+// one stable counting-sort pass on the digit at shift, from src into dst
+static void radix_pass(const IntersectionEvent* src, IntersectionEvent* dst,
+                       int size, int shift) {
+  unsigned int counts[EVENT_SORT_CHUNKS][EVENT_RADIX_SIZE];
+  int chunk_size = (size + EVENT_SORT_CHUNKS - 1) / EVENT_SORT_CHUNKS;
+
+  // count each chunk's digits...
+  cilk_for(int c = 0; c < EVENT_SORT_CHUNKS; c++) {
+    for (int d = 0; d < EVENT_RADIX_SIZE; d++) {
+      counts[c][d] = 0;
+    }
+    int end = min((c + 1) * chunk_size, size);
+    for (int e = c * chunk_size; e < end; e++) {
+      counts[c][(event_key(&src[e]) >> shift) & (EVENT_RADIX_SIZE - 1)]++;
+    }
+  }
+
+  // ...turn the counts into each chunk's write position for each digit...
+  unsigned int position = 0;
+  for (int d = 0; d < EVENT_RADIX_SIZE; d++) {
+    for (int c = 0; c < EVENT_SORT_CHUNKS; c++) {
+      unsigned int count = counts[c][d];
+      counts[c][d] = position;
+      position += count;
+    }
+  }
+
+  // ...and scatter each chunk into place
+  cilk_for(int c = 0; c < EVENT_SORT_CHUNKS; c++) {
+    int end = min((c + 1) * chunk_size, size);
+    for (int e = c * chunk_size; e < end; e++) {
+      dst[counts[c][(event_key(&src[e]) >> shift)
+                    & (EVENT_RADIX_SIZE - 1)]++] = src[e];
+    }
   }
-  intersectionEventList->head = NULL;
-  intersectionEventList->tail = NULL;
-  intersectionEventList->size = 0;
 }
 
-void IntersectionEventList_mergeNodes(IntersectionEventList* left, IntersectionEventList* right) {
-  if (right->size == 0) {
+void IntersectionEventList_sort(IntersectionEventList* intersectionEventList) {
+  int size = intersectionEventList->size;
+  if (size < 2) {
     return;
   }
-  if (left->size == 0) {
-    memcpy(left, right, sizeof(IntersectionEventList));
-  } else {
-    left->size += right->size;
-    left->tail->next = right->head;
-    left->tail = right->tail;
+  if (intersectionEventList->sortBuffer == NULL) {
+    intersectionEventList->sortBuffer =
+        grow(NULL, intersectionEventList->capacity, sizeof(IntersectionEvent));
   }
-  right->size = 0;
-  right->head = NULL;
-  right->tail = NULL;
-}
 
-// Evaluates *left = *left OPERATOR *right.
-// Key is passed by Cilk convention.
-void event_list_reduce(void* key, void* left, void* right) {
-  IntersectionEventList_mergeNodes((IntersectionEventList *) left, (IntersectionEventList *) right);
-}
+  // digits that are zero in every key need no pass
+  uint64_t used_bits = 0;
+  for (int e = 0; e < size; e++) {
+    used_bits |= event_key(&intersectionEventList->events[e]);
+  }
 
-// Sets *value to the the identity value.
-// Key is passed by Cilk convention.
-void event_list_identity(void* key, void* value) {
-  IntersectionEventList * value_event = (IntersectionEventList *) value;
-  *value_event = (IntersectionEventList){.head = NULL, .tail = NULL, .size = 0};
-}
+  for (int shift = 0; shift < 64; shift += EVENT_RADIX_BITS) {
+    if (((used_bits >> shift) & (EVENT_RADIX_SIZE - 1)) == 0) {
+      continue;
+    }
+    radix_pass(intersectionEventList->events,
+               intersectionEventList->sortBuffer, size, shift);
+    IntersectionEvent* temp = intersectionEventList->events;
+    intersectionEventList->events = intersectionEventList->sortBuffer;
+    intersectionEventList->sortBuffer = temp;
+  }
 
-// Destroys any dynamically allocated memory.
-// Key is passed by Cilk convention.
-void event_list_destroy(void* key, void* value) {
-  IntersectionEventList * value_event = (IntersectionEventList *) value;
-  IntersectionEventList_deleteNodes(value_event);
+#ifndef NDEBUG
+  for (int e = 1; e < size; e++) {
+    assert(event_key(&intersectionEventList->events[e - 1])
+           < event_key(&intersectionEventList->events[e]));
+  }
+#endif
 }
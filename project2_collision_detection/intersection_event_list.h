@@ -26,52 +26,47 @@
 #include "./line.h"
 #include "./intersection_detection.h"
 
-struct IntersectionEventNode {
-  // This IntersectionEventNode does not own these Line* lines.
-  Line* l1;
-  Line* l2;
+struct IntersectionEvent {
+  // Ids of the two lines, indexing the CollisionWorld line arrays.
+  unsigned int id1;
+  unsigned int id2;
   IntersectionType intersectionType;
-  struct IntersectionEventNode* next;
 };
-typedef struct IntersectionEventNode IntersectionEventNode;
-
-// Compares the nodes by l1's line ID, then l1's line ID.
-// -1 <=> node1 ordered before node2
-//  0 <=> node1 ordered the same as node2
-//  1 <=> node1 ordered after node2
-int IntersectionEventNode_compareData(IntersectionEventNode* node1,
-                                      IntersectionEventNode* node2);
-
-// Swaps the node1's and node2's data (l1, l2, intersectionType).
-void IntersectionEventNode_swapData(IntersectionEventNode* node1,
-                                    IntersectionEventNode* node2);
+typedef struct IntersectionEvent IntersectionEvent;
 
+// A growable array of events.  Appending never allocates once the array has
+// grown to its working size, so a list is meant to be reused across frames.
 struct IntersectionEventList {
-  IntersectionEventNode* head;
-  IntersectionEventNode* tail;
+  IntersectionEvent* events;
   int size;
+  int capacity;
+  // Scratch space for IntersectionEventList_sort.
+  IntersectionEvent* sortBuffer;
 };
 typedef struct IntersectionEventList IntersectionEventList;
 
 // Returns an empty list.
 IntersectionEventList IntersectionEventList_make();
 
-// Appends a new node to the list with the data (l1, l2, intersectionType).
-// Precondition: compareLines(l1, l2) < 0 must be true.
-void IntersectionEventList_appendNode(
-    IntersectionEventList* intersectionEventList, Line* l1, Line* l2,
-    IntersectionType intersectionType);
+// Makes room for at least capacity events.
+void IntersectionEventList_reserve(
+    IntersectionEventList* intersectionEventList, int capacity);
 
-// Deletes all the nodes in the list.
-void IntersectionEventList_deleteNodes(
-    IntersectionEventList* intersectionEventList);
+// Appends an event with the data (id1, id2, intersectionType).
+// Precondition: id1 < id2 must be true.
+void IntersectionEventList_append(
+    IntersectionEventList* intersectionEventList, unsigned int id1,
+    unsigned int id2, IntersectionType intersectionType);
 
-void IntersectionEventList_mergeNodes(IntersectionEventList * left, IntersectionEventList * right);
+// Removes all the events, keeping the memory for reuse.
+void IntersectionEventList_clear(IntersectionEventList* intersectionEventList);
 
-void event_list_reduce(void * key, void * left, void * right);
-
-void event_list_identity(void * key, void * value);
+// Frees the memory held by the list and leaves it empty.
+void IntersectionEventList_destroy(
+    IntersectionEventList* intersectionEventList);
 
-void event_list_destroy(void * key, void * value);
+// Sorts the events by id1, then id2, with a parallel radix sort on the
+// packed 64-bit key (id1, id2).  The pairs in a list must be distinct.
+void IntersectionEventList_sort(IntersectionEventList* intersectionEventList);
 
 #endif  // INTERSECTIONEVENTLIST_H_
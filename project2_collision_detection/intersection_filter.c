@@ -0,0 +1,356 @@
+/**
+ * intersection_filter.c -- batched rejection tests ahead of intersect()
+ * Copyright (c) 2012-2019 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#include "./intersection_filter.h"
+
+#include <stdbool.h>
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "./line.h"
+
+// how far a corner must be from line a before the orientation test trusts
+// its sign, scaled by the length of a
+#ifdef VEC_FLOAT
+#define ORIENTATION_SLACK(edge_x, edge_y) \
+  (margin * (fabsf(edge_x) + fabsf(edge_y)))
+#else
+#define ORIENTATION_SLACK(edge_x, edge_y) 0.0
+#endif
+
+bool IntersectionFilter_pair(const CollisionWorld* collisionWorld,
+                             unsigned int id, unsigned int other) {
+  const vec_dimension epsilon = INTERSECTION_FILTER_EPSILON;
+  const vec_dimension margin = INTERSECTION_FILTER_MARGIN;
+  const vec_dimension* rectXmin = collisionWorld->rectXmin;
+  const vec_dimension* rectXmax = collisionWorld->rectXmax;
+  const vec_dimension* rectYmin = collisionWorld->rectYmin;
+  const vec_dimension* rectYmax = collisionWorld->rectYmax;
+
+  // check if the swept rectangles are exclusive in the x- and y-dimensions
+  bool nonintersecting_in_y = rectYmax[id] - rectYmin[other] < -epsilon
+      || rectYmax[other] - rectYmin[id] < -epsilon;
+  bool nonintersecting_in_x = rectXmax[id] - rectXmin[other] < -epsilon
+      || rectXmax[other] - rectXmin[id] < -epsilon;
+  if (nonintersecting_in_x && nonintersecting_in_y) {
+    return false;
+  }
+
+  // intersect() is always called with the lower id first
+  unsigned int a = min(id, other);
+  unsigned int b = max(id, other);
+  const vec_dimension* p1x = collisionWorld->p1x;
+  const vec_dimension* p1y = collisionWorld->p1y;
+  const vec_dimension* p2x = collisionWorld->p2x;
+  const vec_dimension* p2y = collisionWorld->p2y;
+  double t = collisionWorld->timeStep;
+
+  // corners of the parallelogram b sweeps relative to a
+  vec_dimension velocity_x = collisionWorld->vx[b] - collisionWorld->vx[a];
+  vec_dimension velocity_y = collisionWorld->vy[b] - collisionWorld->vy[a];
+  vec_dimension corner_x[4] = {p1x[b], p2x[b], p1x[b] + velocity_x * t,
+                               p2x[b] + velocity_x * t};
+  vec_dimension corner_y[4] = {p1y[b], p2y[b], p1y[b] + velocity_y * t,
+                               p2y[b] + velocity_y * t};
+
+  // direction(a.p1, a.p2, corner) for each corner
+  vec_dimension edge_x = p2x[a] - p1x[a];
+  vec_dimension edge_y = p2y[a] - p1y[a];
+  vec_dimension slack = ORIENTATION_SLACK(edge_x, edge_y);
+  int num_above = 0;
+  int num_below = 0;
+  for (int k = 0; k < 4; k++) {
+    vec_dimension d = (corner_x[k] - p1x[a]) * edge_y
+        - edge_x * (corner_y[k] - p1y[a]);
+    num_above += d > slack;
+    num_below += d < -slack;
+  }
+  if (num_above != 4 && num_below != 4) {
+    return true;
+  }
+
+  // the parallelogram is on one side of a; keep the pair only if an endpoint
+  // of a could still be reported on one of its edges or inside it
+  vec_dimension xmin = min(min(corner_x[0], corner_x[1]),
+                           min(corner_x[2], corner_x[3]));
+  vec_dimension xmax = max(max(corner_x[0], corner_x[1]),
+                           max(corner_x[2], corner_x[3]));
+  vec_dimension ymin = min(min(corner_y[0], corner_y[1]),
+                           min(corner_y[2], corner_y[3]));
+  vec_dimension ymax = max(max(corner_y[0], corner_y[1]),
+                           max(corner_y[2], corner_y[3]));
+  xmin -= margin;
+  xmax += margin;
+  ymin -= margin;
+  ymax += margin;
+  bool p1_inside = p1x[a] >= xmin && p1x[a] <= xmax
+      && p1y[a] >= ymin && p1y[a] <= ymax;
+  bool p2_inside = p2x[a] >= xmin && p2x[a] <= xmax
+      && p2y[a] >= ymin && p2y[a] <= ymax;
+  return p1_inside || p2_inside;
+}
+
+// The vector kernel is written once against these operations.
+#if defined(VEC_FLOAT) && defined(__AVX512F__)
+#define FILTER_LANES 16
+typedef __m512 vreal;
+typedef __mmask16 vmask;
+typedef __m512i vindex;
+#define V_LOADIDX(p) _mm512_loadu_si512((const void *) (p))
+#define V_GATHER(base, idx) _mm512_i32gather_ps((idx), (base), 4)
+#define V_IDX_TO_REAL(idx) _mm512_cvtepi32_ps(idx)
+#define V_SET1(x) _mm512_set1_ps(x)
+#define V_ADD(a, b) _mm512_add_ps((a), (b))
+#define V_SUB(a, b) _mm512_sub_ps((a), (b))
+#define V_MUL(a, b) _mm512_mul_ps((a), (b))
+#define V_MIN(a, b) _mm512_min_ps((a), (b))
+#define V_MAX(a, b) _mm512_max_ps((a), (b))
+#define V_ABS(a) _mm512_abs_ps(a)
+#define V_CMP(a, b, op) _mm512_cmp_ps_mask((a), (b), (op))
+#define V_BLEND(m, a, b) _mm512_mask_blend_ps((m), (a), (b))
+#define M_AND(a, b) ((vmask) ((a) & (b)))
+#define M_OR(a, b) ((vmask) ((a) | (b)))
+#define M_ANDNOT(a, b) ((vmask) (~(a) & (b)))
+#define M_ALL ((vmask) 0xffff)
+#define M_BITS(m) ((unsigned int) (m))
+#elif defined(VEC_FLOAT) && defined(__AVX2__)
+#define FILTER_LANES 8
+typedef __m256 vreal;
+typedef __m256 vmask;
+typedef __m256i vindex;
+#define V_LOADIDX(p) _mm256_loadu_si256((const __m256i *) (p))
+#define V_GATHER(base, idx) _mm256_i32gather_ps((base), (idx), 4)
+#define V_IDX_TO_REAL(idx) _mm256_cvtepi32_ps(idx)
+#define V_SET1(x) _mm256_set1_ps(x)
+#define V_ADD(a, b) _mm256_add_ps((a), (b))
+#define V_SUB(a, b) _mm256_sub_ps((a), (b))
+#define V_MUL(a, b) _mm256_mul_ps((a), (b))
+#define V_MIN(a, b) _mm256_min_ps((a), (b))
+#define V_MAX(a, b) _mm256_max_ps((a), (b))
+#define V_ABS(a) _mm256_andnot_ps(_mm256_set1_ps(-0.0f), (a))
+#define V_CMP(a, b, op) _mm256_cmp_ps((a), (b), (op))
+#define V_BLEND(m, a, b) _mm256_blendv_ps((a), (b), (m))
+#define M_AND(a, b) _mm256_and_ps((a), (b))
+#define M_OR(a, b) _mm256_or_ps((a), (b))
+#define M_ANDNOT(a, b) _mm256_andnot_ps((a), (b))
+#define M_ALL _mm256_castsi256_ps(_mm256_set1_epi32(-1))
+#define M_BITS(m) ((unsigned int) _mm256_movemask_ps(m))
+#elif defined(__AVX512F__)
+#define FILTER_LANES 8
+typedef __m512d vreal;
+typedef __mmask8 vmask;
+typedef __m256i vindex;
+#define V_LOADIDX(p) _mm256_loadu_si256((const __m256i *) (p))
+#define V_GATHER(base, idx) _mm512_i32gather_pd((idx), (base), 8)
+#define V_IDX_TO_REAL(idx) _mm512_cvtepi32_pd(idx)
+#define V_SET1(x) _mm512_set1_pd(x)
+#define V_ADD(a, b) _mm512_add_pd((a), (b))
+#define V_SUB(a, b) _mm512_sub_pd((a), (b))
+#define V_MUL(a, b) _mm512_mul_pd((a), (b))
+#define V_MIN(a, b) _mm512_min_pd((a), (b))
+#define V_MAX(a, b) _mm512_max_pd((a), (b))
+#define V_CMP(a, b, op) _mm512_cmp_pd_mask((a), (b), (op))
+#define V_BLEND(m, a, b) _mm512_mask_blend_pd((m), (a), (b))
+#define M_AND(a, b) ((vmask) ((a) & (b)))
+#define M_OR(a, b) ((vmask) ((a) | (b)))
+#define M_ANDNOT(a, b) ((vmask) (~(a) & (b)))
+#define M_ALL ((vmask) 0xff)
+#define M_BITS(m) ((unsigned int) (m))
+#elif defined(__AVX2__)
+#define FILTER_LANES 4
+typedef __m256d vreal;
+typedef __m256d vmask;
+typedef __m128i vindex;
+#define V_LOADIDX(p) _mm_loadu_si128((const __m128i *) (p))
+#define V_GATHER(base, idx) _mm256_i32gather_pd((base), (idx), 8)
+#define V_IDX_TO_REAL(idx) _mm256_cvtepi32_pd(idx)
+#define V_SET1(x) _mm256_set1_pd(x)
+#define V_ADD(a, b) _mm256_add_pd((a), (b))
+#define V_SUB(a, b) _mm256_sub_pd((a), (b))
+#define V_MUL(a, b) _mm256_mul_pd((a), (b))
+#define V_MIN(a, b) _mm256_min_pd((a), (b))
+#define V_MAX(a, b) _mm256_max_pd((a), (b))
+#define V_CMP(a, b, op) _mm256_cmp_pd((a), (b), (op))
+#define V_BLEND(m, a, b) _mm256_blendv_pd((a), (b), (m))
+#define M_AND(a, b) _mm256_and_pd((a), (b))
+#define M_OR(a, b) _mm256_or_pd((a), (b))
+#define M_ANDNOT(a, b) _mm256_andnot_pd((a), (b))
+#define M_ALL _mm256_castsi256_pd(_mm256_set1_epi64x(-1))
+#define M_BITS(m) ((unsigned int) _mm256_movemask_pd(m))
+#endif
+
+int IntersectionFilter_batch(const CollisionWorld* collisionWorld,
+                             unsigned int id, const unsigned int* candidates,
+                             int count, unsigned int* survivors) {
+  int num_survivors = 0;
+  int k = 0;
+
+#ifdef FILTER_LANES
+  const vec_dimension* rectXmin = collisionWorld->rectXmin;
+  const vec_dimension* rectXmax = collisionWorld->rectXmax;
+  const vec_dimension* rectYmin = collisionWorld->rectYmin;
+  const vec_dimension* rectYmax = collisionWorld->rectYmax;
+  const vec_dimension* p1x = collisionWorld->p1x;
+  const vec_dimension* p1y = collisionWorld->p1y;
+  const vec_dimension* p2x = collisionWorld->p2x;
+  const vec_dimension* p2y = collisionWorld->p2y;
+  const vec_dimension* vx = collisionWorld->vx;
+  const vec_dimension* vy = collisionWorld->vy;
+
+  const vreal neg_epsilon = V_SET1(-INTERSECTION_FILTER_EPSILON);
+  const vreal margin = V_SET1(INTERSECTION_FILTER_MARGIN);
+  const vreal t = V_SET1(collisionWorld->timeStep);
+  const vreal self_id = V_SET1((vec_dimension) id);
+  const vreal self_xmin = V_SET1(rectXmin[id]);
+  const vreal self_xmax = V_SET1(rectXmax[id]);
+  const vreal self_ymin = V_SET1(rectYmin[id]);
+  const vreal self_ymax = V_SET1(rectYmax[id]);
+  const vreal self_p1x = V_SET1(p1x[id]);
+  const vreal self_p1y = V_SET1(p1y[id]);
+  const vreal self_p2x = V_SET1(p2x[id]);
+  const vreal self_p2y = V_SET1(p2y[id]);
+  const vreal self_vx = V_SET1(vx[id]);
+  const vreal self_vy = V_SET1(vy[id]);
+
+  // the last partial group is padded by repeating its final candidate, and
+  // the padding lanes are masked off at the end
+  for (; k < count; k += FILTER_LANES) {
+    const unsigned int* lanes = candidates + k;
+    unsigned int valid = (1u << FILTER_LANES) - 1;
+    unsigned int padded[FILTER_LANES];
+    if (count - k < FILTER_LANES) {
+      for (int j = 0; j < FILTER_LANES; j++) {
+        padded[j] = candidates[min(k + j, count - 1)];
+      }
+      lanes = padded;
+      valid = (1u << (count - k)) - 1;
+    }
+    vindex idx = V_LOADIDX(lanes);
+
+    // swept-rectangle test
+    vmask nonintersecting_in_y = M_OR(
+        V_CMP(V_SUB(self_ymax, V_GATHER(rectYmin, idx)), neg_epsilon,
+              _CMP_LT_OQ),
+        V_CMP(V_SUB(V_GATHER(rectYmax, idx), self_ymin), neg_epsilon,
+              _CMP_LT_OQ));
+    vmask nonintersecting_in_x = M_OR(
+        V_CMP(V_SUB(self_xmax, V_GATHER(rectXmin, idx)), neg_epsilon,
+              _CMP_LT_OQ),
+        V_CMP(V_SUB(V_GATHER(rectXmax, idx), self_xmin), neg_epsilon,
+              _CMP_LT_OQ));
+    vmask keep =
+        M_ANDNOT(M_AND(nonintersecting_in_x, nonintersecting_in_y), M_ALL);
+    if ((M_BITS(keep) & valid) == 0) {
+      continue;
+    }
+
+    // order each pair as intersect() sees it: a has the lower id
+    vmask self_is_a = V_CMP(V_IDX_TO_REAL(idx), self_id, _CMP_GT_OQ);
+    vreal other_p1x = V_GATHER(p1x, idx);
+    vreal other_p1y = V_GATHER(p1y, idx);
+    vreal other_p2x = V_GATHER(p2x, idx);
+    vreal other_p2y = V_GATHER(p2y, idx);
+    vreal other_vx = V_GATHER(vx, idx);
+    vreal other_vy = V_GATHER(vy, idx);
+    vreal a_p1x = V_BLEND(self_is_a, other_p1x, self_p1x);
+    vreal a_p1y = V_BLEND(self_is_a, other_p1y, self_p1y);
+    vreal a_p2x = V_BLEND(self_is_a, other_p2x, self_p2x);
+    vreal a_p2y = V_BLEND(self_is_a, other_p2y, self_p2y);
+    vreal a_vx = V_BLEND(self_is_a, other_vx, self_vx);
+    vreal a_vy = V_BLEND(self_is_a, other_vy, self_vy);
+    vreal b_p1x = V_BLEND(self_is_a, self_p1x, other_p1x);
+    vreal b_p1y = V_BLEND(self_is_a, self_p1y, other_p1y);
+    vreal b_p2x = V_BLEND(self_is_a, self_p2x, other_p2x);
+    vreal b_p2y = V_BLEND(self_is_a, self_p2y, other_p2y);
+    vreal b_vx = V_BLEND(self_is_a, self_vx, other_vx);
+    vreal b_vy = V_BLEND(self_is_a, self_vy, other_vy);
+
+    // corners of the parallelogram b sweeps relative to a
+    vreal velocity_x = V_SUB(b_vx, a_vx);
+    vreal velocity_y = V_SUB(b_vy, a_vy);
+    vreal b_p3x = V_ADD(b_p1x, V_MUL(velocity_x, t));
+    vreal b_p3y = V_ADD(b_p1y, V_MUL(velocity_y, t));
+    vreal b_p4x = V_ADD(b_p2x, V_MUL(velocity_x, t));
+    vreal b_p4y = V_ADD(b_p2y, V_MUL(velocity_y, t));
+
+    // direction(a.p1, a.p2, corner) for each corner
+    vreal edge_x = V_SUB(a_p2x, a_p1x);
+    vreal edge_y = V_SUB(a_p2y, a_p1y);
+    vreal d1 = V_SUB(V_MUL(V_SUB(b_p1x, a_p1x), edge_y),
+                       V_MUL(edge_x, V_SUB(b_p1y, a_p1y)));
+    vreal d2 = V_SUB(V_MUL(V_SUB(b_p2x, a_p1x), edge_y),
+                       V_MUL(edge_x, V_SUB(b_p2y, a_p1y)));
+    vreal d3 = V_SUB(V_MUL(V_SUB(b_p3x, a_p1x), edge_y),
+                       V_MUL(edge_x, V_SUB(b_p3y, a_p1y)));
+    vreal d4 = V_SUB(V_MUL(V_SUB(b_p4x, a_p1x), edge_y),
+                       V_MUL(edge_x, V_SUB(b_p4y, a_p1y)));
+#ifdef VEC_FLOAT
+    vreal slack = V_MUL(margin, V_ADD(V_ABS(edge_x), V_ABS(edge_y)));
+    vreal neg_slack = V_SUB(V_SET1(0.0f), slack);
+#else
+    vreal slack = V_SET1(0.0);
+    vreal neg_slack = slack;
+#endif
+    vmask all_above = M_AND(
+        M_AND(V_CMP(d1, slack, _CMP_GT_OQ), V_CMP(d2, slack, _CMP_GT_OQ)),
+        M_AND(V_CMP(d3, slack, _CMP_GT_OQ), V_CMP(d4, slack, _CMP_GT_OQ)));
+    vmask all_below = M_AND(
+        M_AND(V_CMP(d1, neg_slack, _CMP_LT_OQ),
+              V_CMP(d2, neg_slack, _CMP_LT_OQ)),
+        M_AND(V_CMP(d3, neg_slack, _CMP_LT_OQ),
+              V_CMP(d4, neg_slack, _CMP_LT_OQ)));
+
+    // endpoints of a inside the parallelogram's bounding box
+    vreal xmin = V_SUB(V_MIN(V_MIN(b_p1x, b_p2x), V_MIN(b_p3x, b_p4x)),
+                       margin);
+    vreal xmax = V_ADD(V_MAX(V_MAX(b_p1x, b_p2x), V_MAX(b_p3x, b_p4x)),
+                       margin);
+    vreal ymin = V_SUB(V_MIN(V_MIN(b_p1y, b_p2y), V_MIN(b_p3y, b_p4y)),
+                       margin);
+    vreal ymax = V_ADD(V_MAX(V_MAX(b_p1y, b_p2y), V_MAX(b_p3y, b_p4y)),
+                       margin);
+    vmask p1_inside = M_AND(
+        M_AND(V_CMP(a_p1x, xmin, _CMP_GE_OQ), V_CMP(a_p1x, xmax, _CMP_LE_OQ)),
+        M_AND(V_CMP(a_p1y, ymin, _CMP_GE_OQ), V_CMP(a_p1y, ymax, _CMP_LE_OQ)));
+    vmask p2_inside = M_AND(
+        M_AND(V_CMP(a_p2x, xmin, _CMP_GE_OQ), V_CMP(a_p2x, xmax, _CMP_LE_OQ)),
+        M_AND(V_CMP(a_p2y, ymin, _CMP_GE_OQ), V_CMP(a_p2y, ymax, _CMP_LE_OQ)));
+
+    vmask reject = M_ANDNOT(M_OR(p1_inside, p2_inside),
+                            M_OR(all_above, all_below));
+    unsigned int bits = M_BITS(M_ANDNOT(reject, keep)) & valid;
+    while (bits != 0) {
+      survivors[num_survivors++] = lanes[__builtin_ctz(bits)];
+      bits &= bits - 1;
+    }
+  }
+#endif
+
+  for (; k < count; k++) {
+    if (IntersectionFilter_pair(collisionWorld, id, candidates[k])) {
+      survivors[num_survivors++] = candidates[k];
+    }
+  }
+  return num_survivors;
+}
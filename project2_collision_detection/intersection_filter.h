@@ -0,0 +1,65 @@
+/**
+ * intersection_filter.h -- batched rejection tests ahead of intersect()
+ * Copyright (c) 2012-2019 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef INTERSECTIONFILTER_H_
+#define INTERSECTIONFILTER_H_
+
+#include <stdbool.h>
+#include "./collision_world.h"
+
+// tolerance for intersecting bounding boxes
+#define INTERSECTION_FILTER_EPSILON 1e-4
+
+// slack on the orientation and endpoint tests; in float builds intersect()
+// rounds its moved endpoints differently from the filter, so a corner must
+// be clear of the line by this fraction of the line's length, and an
+// endpoint clear of the bounding box by this much, before the filter trusts
+// the test
+#ifdef VEC_FLOAT
+#define INTERSECTION_FILTER_MARGIN 1e-5f
+#else
+#define INTERSECTION_FILTER_MARGIN 0.0
+#endif
+
+// Returns false only if intersect() is certain to return NO_INTERSECTION for
+// lines id and other.  Two tests are applied:
+//  - the lines' swept rectangles are separated in both x and y, or
+//  - the parallelogram swept by the higher-id line relative to the lower-id
+//    line lies strictly on one side of the lower-id line (same signs from
+//    direction()), and neither endpoint of the lower-id line lies inside the
+//    parallelogram's bounding box.
+// The arithmetic matches intersect() operation for operation, so no pair that
+// intersect() would report is ever rejected.  Float builds (VEC_FLOAT) cannot
+// match it exactly and widen both tests by INTERSECTION_FILTER_MARGIN.
+bool IntersectionFilter_pair(const CollisionWorld* collisionWorld,
+                             unsigned int id, unsigned int other);
+
+// Applies IntersectionFilter_pair to line id against count candidate ids,
+// writing the ids that survive to survivors (in candidate order) and
+// returning how many did.  Uses AVX-512 (8 lanes, or 16 in float builds) or
+// AVX2 (4 lanes, or 8 in float builds) when the target supports them.
+int IntersectionFilter_batch(const CollisionWorld* collisionWorld,
+                             unsigned int id, const unsigned int* candidates,
+                             int count, unsigned int* survivors);
+
+#endif  // INTERSECTIONFILTER_H_
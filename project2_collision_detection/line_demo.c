@@ -78,24 +78,24 @@ void LineDemo_createLines(LineDemo* lineDemo) {
   while (EOF
       != fscanf(fin, "(%lf, %lf), (%lf, %lf), %lf, %lf, %d\n", &px1, &py1, &px2,
                 &py2, &vx, &vy, &isGray)) {
-    Line *line = malloc(sizeof(Line));
+    Line line;
 
     // convert window coordinates to box coordinates
-    windowToBox(&line->p1.x, &line->p1.y, px1, py1);
-    windowToBox(&line->p2.x, &line->p2.y, px2, py2);
+    windowToBox(&line.p1.x, &line.p1.y, px1, py1);
+    windowToBox(&line.p2.x, &line.p2.y, px2, py2);
 
     // convert window velocity to box velocity
-    velocityWindowToBox(&line->velocity.x, &line->velocity.y, vx, vy);
+    velocityWindowToBox(&line.velocity.x, &line.velocity.y, vx, vy);
 
     // store color
-    line->color = (Color) isGray;
+    line.color = (Color) isGray;
 
     // store line ID
-    line->id = lineId;
+    line.id = lineId;
     lineId++;
 
-    // transfer ownership of line to collisionWorld
-    CollisionWorld_addLine(lineDemo->collisionWorld, line);
+    // copy line into collisionWorld
+    CollisionWorld_addLine(lineDemo->collisionWorld, &line);
   }
   fclose(fin);
 }
@@ -108,7 +108,7 @@ void LineDemo_initLine(LineDemo* lineDemo) {
   LineDemo_createLines(lineDemo);
 }
 
-Line* LineDemo_getLine(LineDemo* lineDemo, const unsigned int index) {
+Line LineDemo_getLine(LineDemo* lineDemo, const unsigned int index) {
   return CollisionWorld_getLine(lineDemo->collisionWorld, index);
 }
 
@@ -124,6 +124,19 @@ unsigned int LineDemo_getNumLineLineCollisions(LineDemo* lineDemo) {
   return CollisionWorld_getNumLineLineCollisions(lineDemo->collisionWorld);
 }
 
+const DetectionStats* LineDemo_getDetectionStats(LineDemo* lineDemo) {
+  return CollisionWorld_getDetectionStats(lineDemo->collisionWorld);
+}
+
+void LineDemo_setBroadPhase(LineDemo* lineDemo, const BroadPhase* broadPhase) {
+  CollisionWorld_setBroadPhase(lineDemo->collisionWorld, broadPhase);
+}
+
+void LineDemo_setNarrowPhase(LineDemo* lineDemo,
+                             const NarrowPhase* narrowPhase) {
+  CollisionWorld_setNarrowPhase(lineDemo->collisionWorld, narrowPhase);
+}
+
 // The main simulation loop
 bool LineDemo_update(LineDemo* lineDemo) {
   lineDemo->count++;
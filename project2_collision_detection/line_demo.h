@@ -51,8 +51,8 @@ void LineDemo_setNumFrames(LineDemo* lineDemo, const unsigned int numFrames);
 // Initialize line simulation.
 void LineDemo_initLine(LineDemo* lineDemo);
 
-// Get ith line.
-Line* LineDemo_getLine(LineDemo* lineDemo, const unsigned int index);
+// Get a copy of the ith line.
+Line LineDemo_getLine(LineDemo* lineDemo, const unsigned int index);
 
 // Get num of lines.
 unsigned int LineDemo_getNumOfLines(LineDemo* lineDemo);
@@ -63,6 +63,16 @@ unsigned int LineDemo_getNumLineWallCollisions(LineDemo* lineDemo);
 // Get number of line-line collisions.
 unsigned int LineDemo_getNumLineLineCollisions(LineDemo* lineDemo);
 
+// Get the per-stage time and pair counts of line-line detection.
+const DetectionStats* LineDemo_getDetectionStats(LineDemo* lineDemo);
+
+// Select the broad phase used for line-line detection.
+void LineDemo_setBroadPhase(LineDemo* lineDemo, const BroadPhase* broadPhase);
+
+// Select the line-line test.
+void LineDemo_setNarrowPhase(LineDemo* lineDemo,
+                             const NarrowPhase* narrowPhase);
+
 // Line simulation update function.
 bool LineDemo_update(LineDemo* lineDemo);
 
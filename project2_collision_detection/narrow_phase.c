@@ -0,0 +1,116 @@
+/**
+ * narrow_phase.c -- line-line tests run over a frame's candidate pairs
+ * Copyright (c) 2012-2019 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#include "./narrow_phase.h"
+
+#include <cilk/cilk.h>
+#include <string.h>
+
+#include "./collision_world.h"
+#include "./grow.h"
+
+// candidates classified by one strand; the chunks are fixed so that the
+// events can be written back in candidate order
+#define NARROW_CHUNK 512
+
+static const NarrowPhase narrow_phases[] = {
+  { .name = "parallelogram", .intersect = intersect },
+  { .name = "shared", .intersect = intersectShared },
+};
+
+// number of events found in each chunk, then each chunk's first event index
+static struct {
+  int* chunk_events;
+  int capacity;
+} narrow;
+
+const NarrowPhase* NarrowPhase_default() {
+  return &narrow_phases[0];
+}
+
+const NarrowPhase* NarrowPhase_get(int index) {
+  if (index < 0 || index >= sizeof(narrow_phases) / sizeof(narrow_phases[0])) {
+    return NULL;
+  }
+  return &narrow_phases[index];
+}
+
+const NarrowPhase* NarrowPhase_find(const char* name) {
+  for (int i = 0; NarrowPhase_get(i) != NULL; i++) {
+    if (strcmp(NarrowPhase_get(i)->name, name) == 0) {
+      return NarrowPhase_get(i);
+    }
+  }
+  return NULL;
+}
+
+int NarrowPhase_run(CollisionWorld* collisionWorld,
+                    IntersectionEventList* candidates,
+                    IntersectionEventList* events) {
+  int num_candidates = candidates->size;
+  int num_chunks = (num_candidates + NARROW_CHUNK - 1) / NARROW_CHUNK;
+  if (narrow.capacity < num_chunks) {
+    narrow.capacity = num_chunks;
+    narrow.chunk_events = grow(narrow.chunk_events, num_chunks, sizeof(int));
+  }
+  IntersectionType (*test)(Line*, Line*, double) =
+      collisionWorld->narrowPhase->intersect;
+  double time = collisionWorld->timeStep;
+
+  // classify each chunk and count its events...
+  cilk_for(int c = 0; c < num_chunks; c++) {
+    int end = min((c + 1) * NARROW_CHUNK, num_candidates);
+    int num_events = 0;
+    for (int i = c * NARROW_CHUNK; i < end; i++) {
+      IntersectionEvent* pair = &candidates->events[i];
+      Line line1 = CollisionWorld_loadLine(collisionWorld, pair->id1);
+      Line line2 = CollisionWorld_loadLine(collisionWorld, pair->id2);
+      pair->intersectionType = test(&line1, &line2, time);
+      num_events += pair->intersectionType != NO_INTERSECTION;
+    }
+    narrow.chunk_events[c] = num_events;
+  }
+
+  // ...turn the counts into each chunk's first event...
+  int position = events->size;
+  for (int c = 0; c < num_chunks; c++) {
+    int count = narrow.chunk_events[c];
+    narrow.chunk_events[c] = position;
+    position += count;
+  }
+  int num_events = position - events->size;
+  IntersectionEventList_reserve(events, position);
+
+  // ...and copy each chunk's events into place
+  cilk_for(int c = 0; c < num_chunks; c++) {
+    int end = min((c + 1) * NARROW_CHUNK, num_candidates);
+    int next = narrow.chunk_events[c];
+    for (int i = c * NARROW_CHUNK; i < end; i++) {
+      if (candidates->events[i].intersectionType != NO_INTERSECTION) {
+        events->events[next++] = candidates->events[i];
+      }
+    }
+  }
+  events->size = position;
+  return num_events;
+}
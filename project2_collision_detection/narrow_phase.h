@@ -0,0 +1,60 @@
+/**
+ * narrow_phase.h -- line-line tests run over a frame's candidate pairs
+ * Copyright (c) 2012-2019 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef NARROWPHASE_H_
+#define NARROWPHASE_H_
+
+#include "./intersection_detection.h"
+#include "./intersection_event_list.h"
+#include "./line.h"
+
+struct CollisionWorld;
+
+// A line-line test, selectable on the command line.
+struct NarrowPhase {
+  // Name used to select the narrow phase on the command line.
+  const char* name;
+
+  // Classifies lines l1 and l2, where compareLines(l1, l2) < 0.
+  IntersectionType (*intersect)(Line *l1, Line *l2, double time);
+};
+typedef struct NarrowPhase NarrowPhase;
+
+// Returns the narrow phase used unless another is selected.
+const NarrowPhase* NarrowPhase_default();
+
+// Returns the index-th registered narrow phase, or NULL past the end.
+const NarrowPhase* NarrowPhase_get(int index);
+
+// Returns the narrow phase with the given name, or NULL if there is none.
+const NarrowPhase* NarrowPhase_find(const char* name);
+
+// Classifies every pair in candidates with the world's narrow phase, in
+// parallel over fixed chunks of the list, and appends the pairs that
+// intersect to events in candidate order.  Each pair's intersectionType is
+// overwritten with its classification.  Returns how many were appended.
+int NarrowPhase_run(struct CollisionWorld* collisionWorld,
+                    IntersectionEventList* candidates,
+                    IntersectionEventList* events);
+
+#endif  // NARROWPHASE_H_
@@ -1,13 +1,13 @@
 #include <assert.h>
 #include <cilk/cilk.h>
-#include <cilk/reducer.h>
-#include <cilk/reducer_opadd.h>
 #include <intersection_detection.h>
 #include <math.h>
 #include <quadtree.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include "./broad_phase.h"
 #include "./collision_world.h"
+#include "./grow.h"
 #include "./intersection_event_list.h"
 #include "./rect.h"
 
@@ -19,51 +19,77 @@
 #define min(a, b) ((a) < (b) ? (a) : (b))
 #endif
 
-// create an array to store all of the nodes of the quadtree
-static QuadTree full_tree[QUADTREE_SIZE];
-
-// declare a type for an intersection event list reducer
-typedef CILK_C_DECLARE_REDUCER(IntersectionEventList)
-    IntersectionEventListReducer;
-
-// create an instance of the reducer for tracking intersection events
-IntersectionEventListReducer EVENT_LIST_REDUCER = CILK_C_INIT_REDUCER(
-    IntersectionEventList, event_list_reduce, event_list_identity,
-    event_list_destroy,
-    (IntersectionEventList){.head = NULL, .tail = NULL, .size = 0});
+// pool of quadtree nodes, kept from frame to frame and grown as the scenes
+// require deeper trees; the root is always node 0
+static struct {
+  QuadTree* nodes;
+  int capacity;
+  int num_nodes;
+  // nodes still to be split at the current level and the next
+  int* frontier;
+  int* next_frontier;
+  int frontier_capacity;
+  // quadrant of each line, indexed like collisionWorld->lineIds
+  int* assignment;
+  unsigned int assignment_capacity;
+} pool;
 
 static void detect_intersections(int index, CollisionWorld *collisionWorld,
-                          IntersectionEventList *intersection_events);
+                          IntersectionEventList *candidate_pairs);
+
+// makes room for at least num_nodes nodes and a frontier of num_frontier
+static void reserve_nodes(int num_nodes, int num_frontier) {
+  if (pool.capacity < num_nodes) {
+    pool.capacity = max(num_nodes, 2 * pool.capacity);
+    pool.nodes = grow(pool.nodes, pool.capacity, sizeof(QuadTree));
+  }
+  if (pool.frontier_capacity < num_frontier) {
+    pool.frontier_capacity = max(num_frontier, 2 * pool.frontier_capacity);
+    pool.frontier = grow(pool.frontier, pool.frontier_capacity, sizeof(int));
+    pool.next_frontier =
+        grow(pool.next_frontier, pool.frontier_capacity, sizeof(int));
+  }
+}
 
 // update the quadtree at position index with the given number of lines in the
-// node, number of lines in the child, pointer to the start of the lines in the
-// node, and pointer to the start of the lines in the child
-static void QuadTree_new(int index, int num_lines, bool has_children, Line **lines) {
-  full_tree[index].lines = lines;
-  full_tree[index].num_lines = num_lines;
-  full_tree[index].child_lines = NULL;
+// node, pointer to the start of the lines in the node, and the quadrant it
+// covers
+static void QuadTree_new(int index, int num_lines, unsigned int *lines,
+                         double xmin, double xmax, double ymin, double ymax,
+                         int depth) {
+  pool.nodes[index].lines = lines;
+  pool.nodes[index].num_lines = num_lines;
+  pool.nodes[index].child_lines = NULL;
+  pool.nodes[index].child_num_lines = 0;
+  pool.nodes[index].first_child = -1;
+  pool.nodes[index].depth = depth;
+  pool.nodes[index].xmin = xmin;
+  pool.nodes[index].xmax = xmax;
+  pool.nodes[index].ymin = ymin;
+  pool.nodes[index].ymax = ymax;
 }
 
 // determines which quadrant a line is completely contained in (0, 1, 2, 3), or
 // returns 4 if not fully contained in any quadrant
-static int get_quadrant_number(Line *line, double xmin, double xmax, double ymin,
-                        double ymax) {
+static int get_quadrant_number(CollisionWorld *collisionWorld, unsigned int id,
+                               double xmin, double xmax, double ymin,
+                               double ymax) {
   // calculate the quadrant divisions
   double mid_x = (xmin + xmax) / 2;
   double mid_y = (ymin + ymax) / 2;
 
   // perform a check for the quadrant of the line
-  if (line->rectangle.xmax < mid_x) { // left half
-    if (line->rectangle.ymax < mid_y) // upper half
+  if (collisionWorld->rectXmax[id] < mid_x) { // left half
+    if (collisionWorld->rectYmax[id] < mid_y) // upper half
       return 0;
-    else if (line->rectangle.ymin > mid_y) // lower half
+    else if (collisionWorld->rectYmin[id] > mid_y) // lower half
       return 2;
     else
       return 4;
-  } else if (line->rectangle.xmin > mid_x) { // right half
-    if (line->rectangle.ymax < mid_y) // upper half
+  } else if (collisionWorld->rectXmin[id] > mid_x) { // right half
+    if (collisionWorld->rectYmax[id] < mid_y) // upper half
       return 1;
-    else if (line->rectangle.ymin > mid_y) // lower half
+    else if (collisionWorld->rectYmin[id] > mid_y) // lower half
       return 3;
     else
       return 4;
@@ -72,8 +98,8 @@ static int get_quadrant_number(Line *line, double xmin, double xmax, double ymin
   }
 }
 
-// sorts array of Line* by quadrant number from 0 to 4 in place
-static void sort_lines_by_quadrant(Line **lines, int assignment[],
+// sorts array of line ids by quadrant number from 0 to 4 in place
+static void sort_lines_by_quadrant(unsigned int *lines, int assignment[],
                             int children_sizes[], int num_lines) {
   // find indices in the quadrant currently being swapped
   int index_in_quadrant = 0;
@@ -82,7 +108,7 @@ static void sort_lines_by_quadrant(Line **lines, int assignment[],
   // mark the start of the quadrant
   int quadrant_start = 0;
   // temporary variable for swaps
-  Line *temp;
+  unsigned int temp;
 
   // sort the first four quadrants (the last one falls into place automatically)
   for (int quadrant = 0; quadrant < 4; quadrant++) {
@@ -112,193 +138,185 @@ static void sort_lines_by_quadrant(Line **lines, int assignment[],
   }
 }
 
-// assign lines to quadtree and make any new quadtrees as needed
-static void QuadTree_buildQuadTree(int index, double xmin, double xmax, double ymin,
-                            double ymax, int depth) { // QuadTree* qtree){
-  // quadtree exceeds max_bin and should be split
-  int num_lines = full_tree[index].num_lines;
-  Line **lines = full_tree[index].lines;
+// split the node at index into the four children starting at child_base,
+// leaving it a leaf if no line fits into a quadrant
+static void QuadTree_split(CollisionWorld *collisionWorld, int index,
+                           int child_base) {
+  QuadTree *node = &pool.nodes[index];
+  int num_lines = node->num_lines;
+  unsigned int *lines = node->lines;
+  double xmin = node->xmin;
+  double xmax = node->xmax;
+  double ymin = node->ymin;
+  double ymax = node->ymax;
 
   double x_mid = (xmin + xmax) / 2;
   double y_mid = (ymin + ymax) / 2;
 
   // determine to which quadrant each line belongs and count how many lines are
   // in each quadrant
-  int assignment[full_tree[index].num_lines];
+  int *assignment = pool.assignment + (lines - collisionWorld->lineIds);
   int children_sizes[5] = {0, 0, 0, 0, 0};
 
   for (unsigned int i = 0; i < num_lines; i++) {
-    int quadrant = get_quadrant_number(lines[i], xmin, xmax, ymin, ymax);
+    int quadrant =
+        get_quadrant_number(collisionWorld, lines[i], xmin, xmax, ymin, ymax);
     assignment[i] = quadrant;
     children_sizes[quadrant]++;
   }
 
+  // splitting would only push every line into an empty child
+  if (children_sizes[4] == num_lines) {
+    return;
+  }
+
   // using these assignments, sort the lines by quadrant
   sort_lines_by_quadrant(lines, assignment, children_sizes, num_lines);
 
   // create pointers to the lines for each of the children and the node itself
-  Line **line_q1 = lines;
-  Line **line_q2 = line_q1 + children_sizes[0];
-  Line **line_q3 = line_q2 + children_sizes[1];
-  Line **line_q4 = line_q3 + children_sizes[2];
-  Line **large_lines = line_q4 + children_sizes[3];
+  unsigned int *line_q1 = lines;
+  unsigned int *line_q2 = line_q1 + children_sizes[0];
+  unsigned int *line_q3 = line_q2 + children_sizes[1];
+  unsigned int *line_q4 = line_q3 + children_sizes[2];
+  unsigned int *large_lines = line_q4 + children_sizes[3];
 
   // reset the properties of the current node for the lines that pass through
   // multiple quadrants
-  full_tree[index].child_lines = lines;
-  full_tree[index].lines = large_lines;
-
-  // set pointer to lines of first child
-  full_tree[index].child_num_lines =
-      full_tree[index].num_lines - children_sizes[4];
-  full_tree[index].num_lines = children_sizes[4];
+  node->child_lines = lines;
+  node->lines = large_lines;
+  node->child_num_lines = num_lines - children_sizes[4];
+  node->num_lines = children_sizes[4];
+  node->first_child = child_base;
 
   // create quadtrees for the children
-  unsigned int new_depth = depth + 1;
-  unsigned int child_base = 4 * index + 1;
-
-  QuadTree_new(child_base, children_sizes[0], false, line_q1);
-  QuadTree_new(child_base + 1, children_sizes[1], false, line_q2);
-  QuadTree_new(child_base + 2, children_sizes[2], false, line_q3);
-  QuadTree_new(child_base + 3, children_sizes[3], false, line_q4);
-
-  // recurse on the children as appropriate
-  if (new_depth < MAX_DEPTH) {
-    if (children_sizes[0] > MAX_BIN) {
-      cilk_spawn QuadTree_buildQuadTree(child_base, xmin, x_mid, ymin, y_mid,
-                                        new_depth);
-    }
-    if (children_sizes[1] > MAX_BIN) {
-      cilk_spawn QuadTree_buildQuadTree(child_base + 1, x_mid, xmax, ymin,
-                                        y_mid, new_depth);
-    }
-    if (children_sizes[2] > MAX_BIN) {
-      cilk_spawn QuadTree_buildQuadTree(child_base + 2, xmin, x_mid, y_mid,
-                                        ymax, new_depth);
-    }
-    if (children_sizes[3] > MAX_BIN) {
-      cilk_spawn QuadTree_buildQuadTree(child_base + 3, x_mid, xmax, y_mid,
-                                        ymax, new_depth);
-    }
-    cilk_sync;
-  }
-  return;
+  int new_depth = node->depth + 1;
+  QuadTree_new(child_base, children_sizes[0], line_q1, xmin, x_mid, ymin,
+               y_mid, new_depth);
+  QuadTree_new(child_base + 1, children_sizes[1], line_q2, x_mid, xmax, ymin,
+               y_mid, new_depth);
+  QuadTree_new(child_base + 2, children_sizes[2], line_q3, xmin, x_mid, y_mid,
+               ymax, new_depth);
+  QuadTree_new(child_base + 3, children_sizes[3], line_q4, x_mid, xmax, y_mid,
+               ymax, new_depth);
 }
 
-// provide a fast path test for bounding box intersection
-static inline bool bounding_box_intersect(Line *line1, Line *line2) {
-  // tolerance for intersecting bounding boxes
-  vec_dimension epsilon = 1e-4;
-
-  // check if the lines are exclusive in the x- and y-dimensions
-  bool line1_above_line2 =
-      line1->rectangle.ymax - line2->rectangle.ymin < -epsilon;
-  bool line2_above_line1 =
-      line2->rectangle.ymax - line1->rectangle.ymin < -epsilon;
-  bool line1_leftof_line2 =
-      line1->rectangle.xmax - line2->rectangle.xmin < -epsilon;
-  bool line2_leftof_line1 =
-      line2->rectangle.xmax - line1->rectangle.xmin < -epsilon;
-
-  bool nonintersecting_in_y = line1_above_line2 || line2_above_line1;
-  bool nonintersecting_in_x = line1_leftof_line2 || line2_leftof_line1;
-
-  // check if the bounding rectangles intersect
-  bool nonintersecting_rectangles =
-      nonintersecting_in_y && nonintersecting_in_x;
-
-  // return the not of the boolean for the rectangles intersecting
-  return !nonintersecting_rectangles;
+// whether a node holds enough lines to be worth splitting
+static inline bool needs_split(int index) {
+  return pool.nodes[index].num_lines > MAX_BIN
+         && pool.nodes[index].depth < MAX_DEPTH;
 }
 
-// check for line intersection
-static void check_line_intersect(Line *line1, Line *line2,
-                          CollisionWorld *collisionWorld,
-                          IntersectionEventList *intersection_events) {
-  if (!bounding_box_intersect(line1, line2)) {
-    return;
+// assign lines to quadtree, one level at a time, until every leaf holds at
+// most MAX_BIN lines or cannot be split any further
+static void QuadTree_buildQuadTree(CollisionWorld *collisionWorld) {
+  unsigned int n = collisionWorld->numOfLines;
+  if (pool.assignment_capacity < n) {
+    pool.assignment_capacity = n;
+    pool.assignment = grow(pool.assignment, n, sizeof(int));
   }
 
-  if (compareLines(line1, line2) >= 0) {
-    Line *temp = line1;
-    line1 = line2;
-    line2 = temp;
+  reserve_nodes(1, 1);
+  QuadTree_new(0, n, collisionWorld->lineIds, BOX_XMIN, BOX_XMAX, BOX_YMIN,
+               BOX_YMAX, 0);
+  pool.num_nodes = 1;
+
+  int num_frontier = 0;
+  if (needs_split(0)) {
+    pool.frontier[num_frontier++] = 0;
   }
-  IntersectionType iType = intersect(line1, line2, collisionWorld->timeStep);
-  if (iType != NO_INTERSECTION) {
-    IntersectionEventList_appendNode(&REDUCER_VIEW(EVENT_LIST_REDUCER), line1,
-                                     line2, iType);
+
+  while (num_frontier > 0) {
+    // every node of this level gets a block of four children up front, so
+    // the splits below can run in parallel without sharing the pool
+    int child_base = pool.num_nodes;
+    reserve_nodes(child_base + 4 * num_frontier, 4 * num_frontier);
+    cilk_for(int k = 0; k < num_frontier; k++) {
+      QuadTree_split(collisionWorld, pool.frontier[k], child_base + 4 * k);
+    }
+    pool.num_nodes = child_base + 4 * num_frontier;
+
+    int num_next = 0;
+    for (int k = 0; k < num_frontier; k++) {
+      int first_child = pool.nodes[pool.frontier[k]].first_child;
+      if (first_child < 0) {
+        continue;
+      }
+      for (int i = 0; i < 4; i++) {
+        if (needs_split(first_child + i)) {
+          pool.next_frontier[num_next++] = first_child + i;
+        }
+      }
+    }
+
+    int *temp = pool.frontier;
+    pool.frontier = pool.next_frontier;
+    pool.next_frontier = temp;
+    num_frontier = num_next;
   }
 }
 
 // check for all pairwise intersections within a quadtree at given index
 static inline void
 check_within_quadtree(int index, CollisionWorld *collisionWorld,
-                      IntersectionEventList *intersection_events) {
-  Line *line1;
-  Line *line2;
+                      IntersectionEventList *candidate_pairs) {
+  unsigned int *lines = pool.nodes[index].lines;
+  int num_lines = pool.nodes[index].num_lines;
 #pragma cilk grainsize 600
-  cilk_for(int i = 0; i < full_tree[index].num_lines; i++) {
-    line1 = full_tree[index].lines[i];
-    for (int j = i + 1; j < full_tree[index].num_lines; j++) {
-      line2 = full_tree[index].lines[j];
-      check_line_intersect(line1, line2, collisionWorld, intersection_events);
-    }
+  cilk_for(int i = 0; i < num_lines; i++) {
+    BroadPhase_addCandidates(collisionWorld, lines[i], lines + i + 1,
+                             num_lines - i - 1);
   }
 }
 
 static void check_with_children(int index, CollisionWorld *collisionWorld,
-                         IntersectionEventList *intersection_events) {
-  Line *line1;
-  Line *line2;
-  Line **child_lines = full_tree[index].child_lines;
-  cilk_for(int i = 0; i < full_tree[index].child_num_lines; i++) {
-    line1 = child_lines[i];
-    for (int j = 0; j < full_tree[index].num_lines; j++) {
-      line2 = full_tree[index].lines[j];
-      check_line_intersect(line1, line2, collisionWorld, intersection_events);
-    }
+                         IntersectionEventList *candidate_pairs) {
+  unsigned int *lines = pool.nodes[index].lines;
+  unsigned int *child_lines = pool.nodes[index].child_lines;
+  int num_lines = pool.nodes[index].num_lines;
+  cilk_for(int i = 0; i < pool.nodes[index].child_num_lines; i++) {
+    BroadPhase_addCandidates(collisionWorld, child_lines[i], lines,
+                             num_lines);
   }
 }
 
 static void recurse_children(int index, CollisionWorld *collisionWorld,
-                      IntersectionEventList *intersection_events) {
-  int child_base = 4 * index + 1;
+                      IntersectionEventList *candidate_pairs) {
+  int child_base = pool.nodes[index].first_child;
   cilk_for(int i = 0; i < 4; i++) {
-    detect_intersections(child_base + i, collisionWorld, intersection_events);
+    detect_intersections(child_base + i, collisionWorld, candidate_pairs);
   }
 }
 
 // detect intersections in the quadtree
 void detect_intersections(int index, CollisionWorld *collisionWorld,
-                          IntersectionEventList *intersection_events) {
+                          IntersectionEventList *candidate_pairs) {
 
   // If not a leaf, then we need to complete three steps in parallel
-  if (full_tree[index].child_lines != NULL) {
+  if (pool.nodes[index].first_child >= 0) {
     // Check for intersections between all pairs within quadtree
     cilk_spawn check_within_quadtree(index, collisionWorld,
-                                     intersection_events);
+                                     candidate_pairs);
     // Check for intersection against all lines in the subtree rooted at this
     // node
-    cilk_spawn check_with_children(index, collisionWorld, intersection_events);
+    cilk_spawn check_with_children(index, collisionWorld, candidate_pairs);
     // Recursively call detect_intersections on all children
-    cilk_spawn recurse_children(index, collisionWorld, intersection_events);
+    cilk_spawn recurse_children(index, collisionWorld, candidate_pairs);
     cilk_sync;
   } else { // If leaf, only need to check all pairs in quadtree
-    check_within_quadtree(index, collisionWorld, intersection_events);
+    check_within_quadtree(index, collisionWorld, candidate_pairs);
   }
 }
 
 // detect intersections with reducer and parallelism
 int detect_intersections_with_quadtree(
     CollisionWorld *collisionWorld,
-    IntersectionEventList *intersection_events) {
-  QuadTree_new(0, collisionWorld->numOfLines, false, collisionWorld->lines);
-  QuadTree_buildQuadTree(0, BOX_XMIN, BOX_XMAX, BOX_YMIN, BOX_YMAX, 0);
-  detect_intersections(0, collisionWorld, intersection_events);
-  int num_collisions = REDUCER_VIEW(EVENT_LIST_REDUCER).size;
-  IntersectionEventList_mergeNodes(intersection_events,
-                                   &REDUCER_VIEW(EVENT_LIST_REDUCER));
-  CILK_C_UNREGISTER_REDUCER(EVENT_LIST_REDUCER);
-  return num_collisions;
+    IntersectionEventList *candidate_pairs) {
+  QuadTree_buildQuadTree(collisionWorld);
+  detect_intersections(0, collisionWorld, candidate_pairs);
+  return BroadPhase_collectCandidates(candidate_pairs);
 }
+
+const BroadPhase QuadTree_broadPhase = {
+  .name = "quadtree",
+  .detect = detect_intersections_with_quadtree,
+};
@@ -9,26 +9,35 @@
 #include "./collision_world.h"
 #include "./intersection_event_list.h"
 #include "./intersection_detection.h"
+#include "./broad_phase.h"
 
 #define MAX_BIN 30
-#define MAX_DEPTH 7
-#define QUADTREE_SIZE 21845 // 4^0 + 4^1 + 4^2 + ... + 4^7 = (4^8 - 1)/(4 - 1)
+// a node is split only while it holds more than MAX_BIN lines and some of
+// them fit in a quadrant; this only bounds degenerate scenes where many
+// identical rectangles keep fitting into ever smaller quadrants
+#define MAX_DEPTH 24
 
 typedef struct QuadTree QuadTree;
 
-typedef struct Node Node;
-struct Node{
-  Line* line;
-  Node* next;
-};
-
+// nodes live in a pool that is reused from frame to frame; the four children
+// of a node are stored next to each other starting at first_child
 struct QuadTree{
-  Line** lines;
-  Line** child_lines;
+  unsigned int* lines;
+  unsigned int* child_lines;
   int num_lines;
   int child_num_lines;
+  // index of the first of the four children, or -1 for a leaf
+  int first_child;
+  int depth;
+  double xmin;
+  double xmax;
+  double ymin;
+  double ymax;
 };
 
-int detect_intersections_with_quadtree(CollisionWorld* collisionWorld, IntersectionEventList* intersection_events);
+int detect_intersections_with_quadtree(CollisionWorld* collisionWorld, IntersectionEventList* candidate_pairs);
+
+// The quadtree as a selectable broad phase.
+extern const BroadPhase QuadTree_broadPhase;
 
 #endif
@@ -26,6 +26,7 @@
 #include <cilk/cilk.h>
 
 
+#include "./broad_phase.h"
 #include "./fasttime.h"
 #include "./line.h"
 #include "./line_demo.h"
@@ -54,17 +55,38 @@ int main(int argc, char *argv[]) {
 #ifndef PROFILE_BUILD
   bool graphicDemoFlag = false;
 #endif
+  bool statsFlag = false;
   unsigned int numFrames = 1;
+  const BroadPhase* broadPhase = BroadPhase_default();
+  const NarrowPhase* narrowPhase = NarrowPhase_default();
+  extern char* optarg;
   extern int optind;
 
   // Process command line options.
-  while ((optchar = getopt(argc, argv, "gi")) != -1) {
+  while ((optchar = getopt(argc, argv, "gib:n:s")) != -1) {
     switch (optchar) {
       case 'g':
 #ifndef PROFILE_BUILD
         graphicDemoFlag = true;
 #endif
         break;
+      case 'b':
+        broadPhase = BroadPhase_find(optarg);
+        if (broadPhase == NULL) {
+          printf("Unknown broad phase: %s\n", optarg);
+          exit(-1);
+        }
+        break;
+      case 's':
+        statsFlag = true;
+        break;
+      case 'n':
+        narrowPhase = NarrowPhase_find(optarg);
+        if (narrowPhase == NULL) {
+          printf("Unknown narrow phase: %s\n", optarg);
+          exit(-1);
+        }
+        break;
       default:
         printf("Ignoring unrecognized option: %c\n", optchar);
         continue;
@@ -79,8 +101,20 @@ int main(int argc, char *argv[]) {
 
   // Check to make sure number of arguments is correct.
   if (remaining_args < 1) {
-    printf("Usage: %s [-g] <numFrames> [inputfile]\n", argv[0]);
+    printf("Usage: %s [-g] [-s] [-b broadphase] [-n narrowphase] "
+           "<numFrames> [inputfile]\n", argv[0]);
     printf("  -g : show graphics\n");
+    printf("  -s : report the phases, time and pairs of each detection stage\n");
+    printf("  -b : broad phase for line-line detection, one of:");
+    for (int i = 0; BroadPhase_get(i) != NULL; i++) {
+      printf(" %s", BroadPhase_get(i)->name);
+    }
+    printf(" (default %s)\n", BroadPhase_default()->name);
+    printf("  -n : narrow phase for line-line detection, one of:");
+    for (int i = 0; NarrowPhase_get(i) != NULL; i++) {
+      printf(" %s", NarrowPhase_get(i)->name);
+    }
+    printf(" (default %s)\n", NarrowPhase_default()->name);
     exit(-1);
   }
 
@@ -99,6 +133,8 @@ int main(int argc, char *argv[]) {
   LineDemo_setInputFile(input_file_path);
   LineDemo_initLine(lineDemo);
   LineDemo_setNumFrames(lineDemo, numFrames);
+  LineDemo_setBroadPhase(lineDemo, broadPhase);
+  LineDemo_setNarrowPhase(lineDemo, narrowPhase);
 
   const fasttime_t start_time = gettime();
 
@@ -125,6 +161,18 @@ int main(int argc, char *argv[]) {
          LineDemo_getNumLineLineCollisions(lineDemo));
   printf("---- END RESULTS ----\n");
 
+  if (statsFlag) {
+    const DetectionStats* stats = LineDemo_getDetectionStats(lineDemo);
+    printf("---- DETECTION STAGES ----\n");
+    printf("Broad phase:  %s, %fs, %llu candidates\n", broadPhase->name,
+           stats->broadPhaseSeconds, stats->candidates);
+    printf("Narrow phase: %s, %fs, %u events\n", narrowPhase->name,
+           stats->narrowPhaseSeconds,
+           LineDemo_getNumLineLineCollisions(lineDemo));
+    printf("Solver:       %fs\n", stats->solverSeconds);
+    printf("---- END DETECTION STAGES ----\n");
+  }
+
   // delete objects
   LineDemo_delete(lineDemo);
 #ifdef CILKSCALE
@@ -0,0 +1,206 @@
+/**
+ * sweep_prune.c -- sort-and-sweep broad phase with temporal coherence
+ * Copyright (c) 2012-2019 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#include "./sweep_prune.h"
+
+#include <assert.h>
+#include <cilk/cilk.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "./grow.h"
+#include "./intersection_filter.h"
+#include "./line.h"
+
+// insertion-sort moves allowed per line before the order is rebuilt with a
+// full sort instead, e.g. after an explosion scrambles it
+#define SWEEP_MAX_MOVES_PER_LINE 16
+// number of candidates gathered before they are checked
+#define SWEEP_CANDIDATE_CHUNK 64
+
+// state kept from frame to frame; entry k of each array describes the line
+// with the k-th smallest left edge
+static struct {
+  unsigned int capacity;
+  unsigned int num_lines;
+  unsigned int* ids;
+  vec_dimension* xmin;
+  vec_dimension* xmax;
+  vec_dimension* ymin;
+  vec_dimension* ymax;
+  // scratch space for full_sort
+  unsigned int* positions;
+  unsigned int* sorted_ids;
+  vec_dimension* sorted_xmin;
+} sweep;
+
+// a degenerate line sorts to the end, past the x extent of every other line
+static inline vec_dimension sort_key(const CollisionWorld* collisionWorld,
+                                     unsigned int id) {
+  if (CollisionWorld_isDegenerate(collisionWorld, id)) {
+    return INFINITY;
+  }
+  return collisionWorld->rectXmin[id];
+}
+
+static int compare_keys(const void* a, const void* b) {
+  unsigned int k1 = *(const unsigned int*) a;
+  unsigned int k2 = *(const unsigned int*) b;
+  if (sweep.xmin[k1] < sweep.xmin[k2]) {
+    return -1;
+  }
+  return sweep.xmin[k1] > sweep.xmin[k2];
+}
+
+// sorts from scratch, used on the first frame and when the order has been
+// scrambled
+static void full_sort(void) {
+  unsigned int n = sweep.num_lines;
+  for (unsigned int k = 0; k < n; k++) {
+    sweep.positions[k] = k;
+  }
+  qsort(sweep.positions, n, sizeof(unsigned int), compare_keys);
+  for (unsigned int k = 0; k < n; k++) {
+    sweep.sorted_ids[k] = sweep.ids[sweep.positions[k]];
+    sweep.sorted_xmin[k] = sweep.xmin[sweep.positions[k]];
+  }
+
+  // the sorted arrays become the live ones
+  unsigned int* ids = sweep.ids;
+  sweep.ids = sweep.sorted_ids;
+  sweep.sorted_ids = ids;
+  vec_dimension* xmin = sweep.xmin;
+  sweep.xmin = sweep.sorted_xmin;
+  sweep.sorted_xmin = xmin;
+}
+
+// repairs the order with an insertion sort, returning false if it gave up
+// because lines moved too far
+static bool insertion_sort(void) {
+  unsigned int n = sweep.num_lines;
+  size_t max_moves = (size_t) n * SWEEP_MAX_MOVES_PER_LINE;
+  size_t moves = 0;
+  for (unsigned int k = 1; k < n; k++) {
+    vec_dimension key = sweep.xmin[k];
+    unsigned int id = sweep.ids[k];
+    unsigned int j = k;
+    while (j > 0 && sweep.xmin[j - 1] > key) {
+      sweep.xmin[j] = sweep.xmin[j - 1];
+      sweep.ids[j] = sweep.ids[j - 1];
+      j--;
+    }
+    sweep.xmin[j] = key;
+    sweep.ids[j] = id;
+    moves += k - j;
+    if (moves > max_moves) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// brings the sorted order up to date with this frame's rectangles
+static void update_order(CollisionWorld* collisionWorld) {
+  unsigned int n = collisionWorld->numOfLines;
+  if (sweep.capacity < n) {
+    sweep.capacity = n;
+    sweep.ids = grow(sweep.ids, n, sizeof(unsigned int));
+    sweep.xmin = grow(sweep.xmin, n, sizeof(vec_dimension));
+    sweep.xmax = grow(sweep.xmax, n, sizeof(vec_dimension));
+    sweep.ymin = grow(sweep.ymin, n, sizeof(vec_dimension));
+    sweep.ymax = grow(sweep.ymax, n, sizeof(vec_dimension));
+    sweep.positions = grow(sweep.positions, n, sizeof(unsigned int));
+    sweep.sorted_ids = grow(sweep.sorted_ids, n, sizeof(unsigned int));
+    sweep.sorted_xmin = grow(sweep.sorted_xmin, n, sizeof(vec_dimension));
+  }
+
+  // a different world: start over from the id order
+  bool fresh = sweep.num_lines != n;
+  if (fresh) {
+    sweep.num_lines = n;
+    for (unsigned int k = 0; k < n; k++) {
+      sweep.ids[k] = k;
+    }
+  }
+
+  // refresh the keys in last frame's order
+  cilk_for(unsigned int k = 0; k < n; k++) {
+    sweep.xmin[k] = sort_key(collisionWorld, sweep.ids[k]);
+  }
+
+  if (fresh || !insertion_sort()) {
+    full_sort();
+  }
+
+  // lay the rest of the rectangles out in sorted order for the sweep
+  cilk_for(unsigned int k = 0; k < n; k++) {
+    unsigned int id = sweep.ids[k];
+    sweep.xmax[k] = collisionWorld->rectXmax[id];
+    sweep.ymin[k] = collisionWorld->rectYmin[id];
+    sweep.ymax[k] = collisionWorld->rectYmax[id];
+  }
+}
+
+// sweeps the k-th line against the lines that start within its x extent;
+// like the intersection filter, rectangles within
+// INTERSECTION_FILTER_EPSILON of each other count as overlapping
+static void sweep_line(CollisionWorld* collisionWorld, unsigned int k) {
+  const vec_dimension epsilon = INTERSECTION_FILTER_EPSILON;
+  unsigned int n = sweep.num_lines;
+  vec_dimension xmax = sweep.xmax[k];
+  vec_dimension ymin = sweep.ymin[k];
+  vec_dimension ymax = sweep.ymax[k];
+  unsigned int candidates[SWEEP_CANDIDATE_CHUNK];
+  int num_candidates = 0;
+
+  for (unsigned int j = k + 1;
+       j < n && xmax - sweep.xmin[j] >= -epsilon; j++) {
+    if (ymax - sweep.ymin[j] < -epsilon || sweep.ymax[j] - ymin < -epsilon) {
+      continue;
+    }
+    candidates[num_candidates++] = sweep.ids[j];
+    if (num_candidates == SWEEP_CANDIDATE_CHUNK) {
+      BroadPhase_addCandidates(collisionWorld, sweep.ids[k], candidates,
+                               num_candidates);
+      num_candidates = 0;
+    }
+  }
+  BroadPhase_addCandidates(collisionWorld, sweep.ids[k], candidates,
+                           num_candidates);
+}
+
+int SweepPrune_detect(CollisionWorld* collisionWorld,
+                      IntersectionEventList* candidate_pairs) {
+  update_order(collisionWorld);
+
+  cilk_for(unsigned int k = 0; k < sweep.num_lines; k++) {
+    sweep_line(collisionWorld, k);
+  }
+  return BroadPhase_collectCandidates(candidate_pairs);
+}
+
+const BroadPhase SweepPrune_broadPhase = {
+  .name = "sap",
+  .detect = SweepPrune_detect,
+};
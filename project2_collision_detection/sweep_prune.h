@@ -0,0 +1,42 @@
+/**
+ * sweep_prune.h -- sort-and-sweep broad phase with temporal coherence
+ * Copyright (c) 2012-2019 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef SWEEPPRUNE_H_
+#define SWEEPPRUNE_H_
+
+#include "./broad_phase.h"
+#include "./collision_world.h"
+#include "./intersection_event_list.h"
+
+// Keeps the lines sorted by the left edge of their swept rectangles from one
+// frame to the next.  Each frame the order is repaired with an insertion
+// sort, which is close to linear because lines move little per time step,
+// and then every line is swept against the lines starting before its right
+// edge.  Pairs whose rectangles also overlap in y are passed on.
+int SweepPrune_detect(CollisionWorld* collisionWorld,
+                      IntersectionEventList* candidate_pairs);
+
+// Sweep-and-prune as a selectable broad phase.
+extern const BroadPhase SweepPrune_broadPhase;
+
+#endif  // SWEEPPRUNE_H_
@@ -0,0 +1,280 @@
+/**
+ * uniform_grid.c -- uniform-grid broad phase built with a counting sort
+ * Copyright (c) 2012-2019 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#include "./uniform_grid.h"
+
+#include <assert.h>
+#include <cilk/cilk.h>
+#include <cilk/reducer_opadd.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "./grow.h"
+#include "./line.h"
+
+// largest number of cells along either axis
+#define GRID_MAX_DIM 1024
+// lines per cell the grid aims for when rectangles are small
+#define GRID_TARGET_OCCUPANCY 4
+// chunks of entries counted independently by the parallel counting sort
+#define GRID_SORT_CHUNKS 8
+// number of candidates gathered before they are checked
+#define GRID_CANDIDATE_CHUNK 64
+
+// the range of cells covered by a line's swept rectangle
+typedef struct {
+  int x0;
+  int x1;
+  int y0;
+  int y1;
+} CellRange;
+
+// buffers reused from frame to frame, grown as needed
+static struct {
+  unsigned int line_capacity;
+  CellRange* ranges;
+  unsigned int* entry_offsets;
+
+  unsigned int entry_capacity;
+  unsigned int* entry_cells;
+  unsigned int* entry_lines;
+  unsigned int* sorted_lines;
+
+  unsigned int cell_capacity;
+  unsigned int* cell_starts;
+  unsigned int* chunk_counts;
+} grid;
+
+// geometry of the grid for the current frame
+static vec_dimension grid_inv_cell;
+static int grid_dim_x;
+static int grid_dim_y;
+
+// maps a coordinate to a cell index along one axis, clamping lines that
+// stray outside the box into the border cells
+static inline int cell_coordinate(vec_dimension v, vec_dimension origin,
+                                  int dim) {
+  vec_dimension f = (v - origin) * grid_inv_cell;
+  if (f < 0) {
+    return 0;
+  }
+  if (f >= dim) {
+    return dim - 1;
+  }
+  return (int) f;
+}
+
+// picks the cell size from the mean size of the swept rectangles, but no
+// smaller than needed to hold GRID_TARGET_OCCUPANCY lines per cell on average
+static void choose_geometry(CollisionWorld* collisionWorld) {
+  unsigned int n = collisionWorld->numOfLines;
+  const vec_dimension* rectXmin = collisionWorld->rectXmin;
+  const vec_dimension* rectXmax = collisionWorld->rectXmax;
+  const vec_dimension* rectYmin = collisionWorld->rectYmin;
+  const vec_dimension* rectYmax = collisionWorld->rectYmax;
+
+  CILK_C_REDUCER_OPADD(extent_sum, double, 0);
+  CILK_C_REGISTER_REDUCER(extent_sum);
+  cilk_for(unsigned int i = 0; i < n; i++) {
+    vec_dimension extent =
+        max(rectXmax[i] - rectXmin[i], rectYmax[i] - rectYmin[i]);
+    if (isfinite(extent)) {
+      REDUCER_VIEW(extent_sum) += extent;
+    }
+  }
+  CILK_C_UNREGISTER_REDUCER(extent_sum);
+
+  vec_dimension span = max(BOX_XMAX - BOX_XMIN, BOX_YMAX - BOX_YMIN);
+  vec_dimension cell = 2 * extent_sum.value / max(n, 1);
+  cell = max(cell, span * sqrt((double) GRID_TARGET_OCCUPANCY / max(n, 1)));
+
+  int dim = (int) ceil(span / cell);
+  dim = max(1, min(dim, GRID_MAX_DIM));
+  grid_dim_x = dim;
+  grid_dim_y = dim;
+  grid_inv_cell = dim / span;
+}
+
+// bins the lines into cells: afterwards the lines overlapping cell c are
+// grid.sorted_lines[grid.cell_starts[c] .. grid.cell_starts[c + 1]), in
+// increasing id order
+static void build_grid(CollisionWorld* collisionWorld) {
+  unsigned int n = collisionWorld->numOfLines;
+  unsigned int num_cells = grid_dim_x * grid_dim_y;
+
+  if (grid.line_capacity < n) {
+    grid.line_capacity = n;
+    grid.ranges = grow(grid.ranges, n, sizeof(CellRange));
+    grid.entry_offsets = grow(grid.entry_offsets, n + 1, sizeof(unsigned int));
+  }
+  if (grid.cell_capacity < num_cells) {
+    grid.cell_capacity = num_cells;
+    grid.cell_starts = grow(grid.cell_starts, num_cells + 1,
+                            sizeof(unsigned int));
+    grid.chunk_counts = grow(grid.chunk_counts,
+                             (size_t) num_cells * GRID_SORT_CHUNKS,
+                             sizeof(unsigned int));
+  }
+
+  // find the cells each line covers
+  cilk_for(unsigned int i = 0; i < n; i++) {
+    CellRange range;
+    // degenerate lines are left out of the grid
+    if (CollisionWorld_isDegenerate(collisionWorld, i)) {
+      range = (CellRange) {.x0 = 0, .x1 = -1, .y0 = 0, .y1 = -1};
+      grid.ranges[i] = range;
+      grid.entry_offsets[i] = 0;
+      continue;
+    }
+    range.x0 = cell_coordinate(collisionWorld->rectXmin[i], BOX_XMIN,
+                               grid_dim_x);
+    range.x1 = cell_coordinate(collisionWorld->rectXmax[i], BOX_XMIN,
+                               grid_dim_x);
+    range.y0 = cell_coordinate(collisionWorld->rectYmin[i], BOX_YMIN,
+                               grid_dim_y);
+    range.y1 = cell_coordinate(collisionWorld->rectYmax[i], BOX_YMIN,
+                               grid_dim_y);
+    grid.ranges[i] = range;
+    grid.entry_offsets[i] =
+        (range.x1 - range.x0 + 1) * (range.y1 - range.y0 + 1);
+  }
+
+  unsigned int num_entries = 0;
+  for (unsigned int i = 0; i < n; i++) {
+    unsigned int count = grid.entry_offsets[i];
+    grid.entry_offsets[i] = num_entries;
+    num_entries += count;
+  }
+  grid.entry_offsets[n] = num_entries;
+
+  if (grid.entry_capacity < num_entries) {
+    grid.entry_capacity = num_entries + num_entries / 4;
+    grid.entry_cells = grow(grid.entry_cells, grid.entry_capacity,
+                            sizeof(unsigned int));
+    grid.entry_lines = grow(grid.entry_lines, grid.entry_capacity,
+                            sizeof(unsigned int));
+    grid.sorted_lines = grow(grid.sorted_lines, grid.entry_capacity,
+                             sizeof(unsigned int));
+  }
+
+  // emit one (cell, line) entry per covered cell
+  cilk_for(unsigned int i = 0; i < n; i++) {
+    CellRange range = grid.ranges[i];
+    unsigned int e = grid.entry_offsets[i];
+    for (int y = range.y0; y <= range.y1; y++) {
+      for (int x = range.x0; x <= range.x1; x++) {
+        grid.entry_cells[e] = y * grid_dim_x + x;
+        grid.entry_lines[e] = i;
+        e++;
+      }
+    }
+  }
+
+  // stable counting sort of the entries by cell: count each chunk...
+  unsigned int chunk_size = (num_entries + GRID_SORT_CHUNKS - 1)
+      / GRID_SORT_CHUNKS;
+  cilk_for(int c = 0; c < GRID_SORT_CHUNKS; c++) {
+    unsigned int* counts = grid.chunk_counts + (size_t) c * num_cells;
+    for (unsigned int cell = 0; cell < num_cells; cell++) {
+      counts[cell] = 0;
+    }
+    unsigned int end = min((c + 1) * chunk_size, num_entries);
+    for (unsigned int e = c * chunk_size; e < end; e++) {
+      counts[grid.entry_cells[e]]++;
+    }
+  }
+
+  // ...turn the counts into each chunk's write position within each cell...
+  unsigned int position = 0;
+  for (unsigned int cell = 0; cell < num_cells; cell++) {
+    grid.cell_starts[cell] = position;
+    for (int c = 0; c < GRID_SORT_CHUNKS; c++) {
+      unsigned int* count = grid.chunk_counts + (size_t) c * num_cells + cell;
+      unsigned int chunk_count = *count;
+      *count = position;
+      position += chunk_count;
+    }
+  }
+  grid.cell_starts[num_cells] = position;
+
+  // ...and scatter each chunk into place
+  cilk_for(int c = 0; c < GRID_SORT_CHUNKS; c++) {
+    unsigned int* positions = grid.chunk_counts + (size_t) c * num_cells;
+    unsigned int end = min((c + 1) * chunk_size, num_entries);
+    for (unsigned int e = c * chunk_size; e < end; e++) {
+      grid.sorted_lines[positions[grid.entry_cells[e]]++] =
+          grid.entry_lines[e];
+    }
+  }
+}
+
+// checks every pair of lines in a cell that this cell owns
+static void check_cell(CollisionWorld* collisionWorld, unsigned int cell) {
+  unsigned int start = grid.cell_starts[cell];
+  unsigned int end = grid.cell_starts[cell + 1];
+  int cell_x = cell % grid_dim_x;
+  int cell_y = cell / grid_dim_x;
+  unsigned int candidates[GRID_CANDIDATE_CHUNK];
+
+  for (unsigned int a = start; a < end; a++) {
+    unsigned int id = grid.sorted_lines[a];
+    CellRange range = grid.ranges[id];
+    int num_candidates = 0;
+    for (unsigned int b = a + 1; b < end; b++) {
+      unsigned int other = grid.sorted_lines[b];
+      CellRange other_range = grid.ranges[other];
+
+      // the pair belongs to the cell holding the minimum corner of the
+      // overlap of the two rectangles
+      if (max(range.x0, other_range.x0) != cell_x
+          || max(range.y0, other_range.y0) != cell_y) {
+        continue;
+      }
+      candidates[num_candidates++] = other;
+      if (num_candidates == GRID_CANDIDATE_CHUNK) {
+        BroadPhase_addCandidates(collisionWorld, id, candidates,
+                                 num_candidates);
+        num_candidates = 0;
+      }
+    }
+    BroadPhase_addCandidates(collisionWorld, id, candidates, num_candidates);
+  }
+}
+
+int UniformGrid_detect(CollisionWorld* collisionWorld,
+                       IntersectionEventList* candidate_pairs) {
+  choose_geometry(collisionWorld);
+  build_grid(collisionWorld);
+
+  unsigned int num_cells = grid_dim_x * grid_dim_y;
+  cilk_for(unsigned int cell = 0; cell < num_cells; cell++) {
+    check_cell(collisionWorld, cell);
+  }
+  return BroadPhase_collectCandidates(candidate_pairs);
+}
+
+const BroadPhase UniformGrid_broadPhase = {
+  .name = "grid",
+  .detect = UniformGrid_detect,
+};
@@ -0,0 +1,42 @@
+/**
+ * uniform_grid.h -- uniform-grid broad phase built with a counting sort
+ * Copyright (c) 2012-2019 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef UNIFORMGRID_H_
+#define UNIFORMGRID_H_
+
+#include "./broad_phase.h"
+#include "./collision_world.h"
+#include "./intersection_event_list.h"
+
+// Bins every line's swept rectangle into each cell of a uniform grid it
+// overlaps, then checks the lines sharing a cell.  A pair sharing several
+// cells is checked only in the cell holding the minimum corner of the
+// overlap of their rectangles.  The cell size is chosen each frame from the
+// mean rectangle size and the number of lines.
+int UniformGrid_detect(CollisionWorld* collisionWorld,
+                       IntersectionEventList* candidate_pairs);
+
+// The uniform grid as a selectable broad phase.
+extern const BroadPhase UniformGrid_broadPhase;
+
+#endif  // UNIFORMGRID_H_
@@ -0,0 +1,46 @@
+#!/bin/sh
+# Runs the double and float builds on every scene in input/ and reports
+# where their collision counts diverge.  Single precision rounds the line
+# positions differently, so small divergence is expected; this shows how much
+# of it each scene can tolerate.
+#
+# Usage: ./validate_float.sh [numFrames]
+# Set SCREENSAVER and FLOAT_SCREENSAVER to compare different binaries.
+
+frames=${1:-500}
+double_binary=${SCREENSAVER:-./screensaver}
+float_binary=${FLOAT_SCREENSAVER:-./screensaver.float}
+diverged=0
+total=0
+
+# prints the wall and line collision counts of one run, or fails if the run
+# fails or does not report both
+counts() {
+  output=$("$1" "$frames" "$2") || return 1
+  walls=$(echo "$output" | sed -n 's/^\([0-9]*\) Line-Wall Collisions$/\1/p')
+  lines=$(echo "$output" | sed -n 's/^\([0-9]*\) Line-Line Collisions$/\1/p')
+  [ -n "$walls" ] && [ -n "$lines" ] || return 1
+  echo "$walls $lines"
+}
+
+printf "%-16s %10s %10s %10s %10s\n" scene walls walls.f lines lines.f
+for scene in input/*.in; do
+  if ! double_counts=$(counts "$double_binary" "$scene"); then
+    echo "$double_binary failed on $scene" >&2
+    exit 1
+  fi
+  if ! float_counts=$(counts "$float_binary" "$scene"); then
+    echo "$float_binary failed on $scene" >&2
+    exit 1
+  fi
+  set -- $double_counts $float_counts
+  note=""
+  if [ "$1 $2" != "$3 $4" ]; then
+    note="  DIVERGED"
+    diverged=$((diverged + 1))
+  fi
+  total=$((total + 1))
+  printf "%-16s %10s %10s %10s %10s%s\n" "$(basename "$scene")" \
+    "$1" "$3" "$2" "$4" "$note"
+done
+echo "$diverged of $total scenes diverged after $frames frames"
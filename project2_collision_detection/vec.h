@@ -27,7 +27,14 @@
 #include <stdbool.h>
 #include <math.h>
 
+// Building with -DVEC_FLOAT stores coordinates and velocities in single
+// precision, which halves the memory traffic of the per-line arrays and
+// doubles the lanes of the vector kernels.
+#ifdef VEC_FLOAT
+typedef float vec_dimension;
+#else
 typedef double vec_dimension;
+#endif
 
 // Forward definition of Line to avoid needing to circularly include Line.h
 //struct Line;
@@ -61,7 +68,6 @@ struct Line {
 
   // The line's current velocity, in units of pixels per time step.
   Vec velocity;
-  Rect rectangle;
 
   Color color;  // The line's color.
 